@@ -119,6 +119,7 @@ int main(int argc, char **argv) {
         mh->add_method(new I3CExceptionHandler(client));
         mh->add_method(new I3CTimeoutHandler(client));
         mh->add_method(new I3CDeniedHandler(client));
+        mh->freeze();
 
 
         xmppsc::SpaceControlClient* scc = new xmppsc::SpaceControlClient(client, mh,
@@ -56,6 +56,8 @@ I2CEndpointBroker::~I2CEndpointBroker() throw()
 
 I2CEndpoint* I2CEndpointBroker::endpoint(const int address) throw(I2CEndpointException, std::out_of_range)
 {
+    std::lock_guard<std::mutex> lock(endpoints_mutex);
+
     // try to get endpoint from the map
     endpoint_map::iterator it = endpoints.find(address);
 
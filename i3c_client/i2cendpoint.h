@@ -20,6 +20,7 @@
 #include <stdexcept>
 #include <string>
 #include <map>
+#include <mutex>
 
 namespace xmppsc {
 
@@ -157,11 +158,15 @@ public:
     ~I2CEndpointBroker() throw();
 
     //! Create (if necessary) and return an I2C endpoint for the specified address.
+    /*!
+     * May be called from several threads.
+     */
     I2CEndpoint* endpoint(const int address) throw(I2CEndpointException, std::out_of_range);
 
 private:
     typedef std::map<int, I2CEndpoint*> endpoint_map;
     endpoint_map endpoints;
+    std::mutex endpoints_mutex;
 
     void free_all_endpoints() throw();
 };
@@ -26,34 +26,39 @@
 
 #include <xmppsc/util.h>
 
-namespace xmppsc {
+namespace {
 
-int retrieveHexParameter(const std::string& parameter, const xmppsc::SpaceCommand& sc, bool required, int def)
-throw (xmppsc::IllegalCommandParameterException, xmppsc::MissingCommandParameterException) {
-    try {
-        const std::string _val = sc.param(parameter);
-
-        // special handling for empty values
-        // This code seems a bit redundant, but we safe throwing an exception if the value is optional.
-        if (_val.empty()) {
-            if (required) {
-                std::ostringstream msg("");
-                msg << "Missing parameter value for " << parameter << "!";
-                throw xmppsc::MissingCommandParameterException(msg.str());
-            } else
-                return def;
-        }
-
-        return  hex2int(_val);
-    } catch (std::invalid_argument& ia) {
-        throw xmppsc::IllegalCommandParameterException(parameter, ia.what());
-    } catch (xmppsc::MissingCommandParameterException& e) {
-        if (required)
-            throw e;
-        return def;
-    }
-}
+// Parameter schemas: name, width in bits, required, default; field
+
+const xmppsc::HexField<xmppsc::I2CReadParams> read_schema[] = {
+    { { "device", 8, true, 0 }, &xmppsc::I2CReadParams::device }
+};
+
+const xmppsc::HexField<xmppsc::I2CReadRegParams> read_reg_schema[] = {
+    { { "device", 8, true, 0 }, &xmppsc::I2CReadRegParams::device },
+    { { "register", 8, true, 0 }, &xmppsc::I2CReadRegParams::reg }
+};
+
+const xmppsc::HexField<xmppsc::I2CWriteParams> write_schema[] = {
+    { { "device", 8, true, 0 }, &xmppsc::I2CWriteParams::device },
+    { { "data", 8, true, 0 }, &xmppsc::I2CWriteParams::data }
+};
+
+const xmppsc::HexField<xmppsc::I2CWriteRegParams> write8_schema[] = {
+    { { "device", 8, true, 0 }, &xmppsc::I2CWriteRegParams::device },
+    { { "register", 8, true, 0 }, &xmppsc::I2CWriteRegParams::reg },
+    { { "data", 8, true, 0 }, &xmppsc::I2CWriteRegParams::data }
+};
 
+const xmppsc::HexField<xmppsc::I2CWriteRegParams> write16_schema[] = {
+    { { "device", 8, true, 0 }, &xmppsc::I2CWriteRegParams::device },
+    { { "register", 8, true, 0 }, &xmppsc::I2CWriteRegParams::reg },
+    { { "data", 16, true, 0 }, &xmppsc::I2CWriteRegParams::data }
+};
+
+} // anonymous namespace
+
+namespace xmppsc {
 
 I2CMethodBase::I2CMethodBase(const std::string& command, I2CEndpointBroker* broker) throw(std::invalid_argument)
     : CommandMethod(command), m_broker(broker)
@@ -71,14 +76,13 @@ I2CMethodBase::~I2CMethodBase() throw () {}
 
 
 
-I2CReadMethod::I2CReadMethod(I2CEndpointBroker* broker): I2CMethodBase("i2c.read", broker) {}
+I2CReadMethod::I2CReadMethod(I2CEndpointBroker* broker): I2CSchemaMethod<I2CReadParams, 1>("i2c.read", broker, read_schema) {}
 
 I2CReadMethod::~I2CReadMethod() throw () {}
 
-void I2CReadMethod::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceCommand& sc, xmppsc::SpaceCommandSink *sink)
+void I2CReadMethod::handle(gloox::JID peer, const params_t& p, xmppsc::SpaceCommandSink *sink)
 {
-    // get parameters
-    const unsigned int device = retrieveHexParameter("device", sc);
+    const unsigned int device = p.device;
 
     try {
         // get the device endpoint
@@ -94,8 +98,7 @@ void I2CReadMethod::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceComma
         xmppsc::SpaceCommand::space_command_params params;
         params["device"] = int2hex(device);
         params["response"] = int2hex(result);
-        const xmppsc::SpaceCommand idcmd("i2c.update", params);
-        sink->sendSpaceCommand(idcmd);
+        sink->sendSpaceCommand(xmppsc::SpaceCommand("i2c.update", std::move(params)));
     } catch (const I2CEndpointException& e) {
         // send exception
         I2C_EX_MSG
@@ -103,16 +106,14 @@ void I2CReadMethod::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceComma
 }
 
 
-I2CRead8Method::I2CRead8Method(I2CEndpointBroker* broker): I2CMethodBase("i2c.read8", broker) {}
+I2CRead8Method::I2CRead8Method(I2CEndpointBroker* broker): I2CSchemaMethod<I2CReadRegParams, 2>("i2c.read8", broker, read_reg_schema) {}
 
 I2CRead8Method::~I2CRead8Method() throw () {}
 
-void I2CRead8Method::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceCommand& sc, xmppsc::SpaceCommandSink *sink)
+void I2CRead8Method::handle(gloox::JID peer, const params_t& p, xmppsc::SpaceCommandSink *sink)
 {
-    // get parameters
-    const unsigned int device = retrieveHexParameter("device", sc);
-    const unsigned int reg = retrieveHexParameter("register", sc);
-
+    const unsigned int device = p.device;
+    const unsigned int reg = p.reg;
 
     try {
         // get the device endpoint
@@ -129,8 +130,7 @@ void I2CRead8Method::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceComm
         params["device"] = int2hex(device);
         params["register"] = int2hex(reg);
         params["response"] = int2hex(result);
-        const xmppsc::SpaceCommand idcmd("i2c.update", params);
-        sink->sendSpaceCommand(idcmd);
+        sink->sendSpaceCommand(xmppsc::SpaceCommand("i2c.update", std::move(params)));
     } catch (const I2CEndpointException& e) {
         // send exception
         I2C_EX_MSG
@@ -138,16 +138,14 @@ void I2CRead8Method::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceComm
 }
 
 
-I2CRead16Method::I2CRead16Method(I2CEndpointBroker* broker): I2CMethodBase("i2c.read16", broker) {}
+I2CRead16Method::I2CRead16Method(I2CEndpointBroker* broker): I2CSchemaMethod<I2CReadRegParams, 2>("i2c.read16", broker, read_reg_schema) {}
 
 I2CRead16Method::~I2CRead16Method() throw () {}
 
-void I2CRead16Method::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceCommand& sc, xmppsc::SpaceCommandSink *sink)
+void I2CRead16Method::handle(gloox::JID peer, const params_t& p, xmppsc::SpaceCommandSink *sink)
 {
-    // get parameters
-    const unsigned int device = retrieveHexParameter("device", sc);
-    const unsigned int reg = retrieveHexParameter("register", sc);
-
+    const unsigned int device = p.device;
+    const unsigned int reg = p.reg;
 
     try {
         // get the device endpoint
@@ -164,8 +162,7 @@ void I2CRead16Method::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceCom
         params["device"] = int2hex(device);
         params["register"] = int2hex(reg);
         params["response"] = int2hex(result);
-        const xmppsc::SpaceCommand idcmd("i2c.update", params);
-        sink->sendSpaceCommand(idcmd);
+        sink->sendSpaceCommand(xmppsc::SpaceCommand("i2c.update", std::move(params)));
     } catch (const I2CEndpointException& e) {
         // send exception
         I2C_EX_MSG
@@ -173,16 +170,14 @@ void I2CRead16Method::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceCom
 }
 
 
-I2CWriteMethod::I2CWriteMethod(I2CEndpointBroker* broker): I2CMethodBase("i2c.write", broker) {}
+I2CWriteMethod::I2CWriteMethod(I2CEndpointBroker* broker): I2CSchemaMethod<I2CWriteParams, 2>("i2c.write", broker, write_schema) {}
 
 I2CWriteMethod::~I2CWriteMethod() throw () {}
 
-void I2CWriteMethod::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceCommand& sc, xmppsc::SpaceCommandSink *sink)
+void I2CWriteMethod::handle(gloox::JID peer, const params_t& p, xmppsc::SpaceCommandSink *sink)
 {
-    // get parameters
-    const unsigned int device = retrieveHexParameter("device", sc);
-    const unsigned int data = retrieveHexParameter("data", sc);
-
+    const unsigned int device = p.device;
+    const unsigned int data = p.data;
 
     try {
         // get the device endpoint
@@ -198,8 +193,7 @@ void I2CWriteMethod::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceComm
         params["device"] = int2hex(device);
         params["value"] = int2hex(data);
         params["response"] = int2hex(result);
-        const xmppsc::SpaceCommand idcmd("i2c.update", params);
-        sink->sendSpaceCommand(idcmd);
+        sink->sendSpaceCommand(xmppsc::SpaceCommand("i2c.update", std::move(params)));
     } catch (const I2CEndpointException& e) {
         // send exception
         I2C_EX_MSG
@@ -207,17 +201,15 @@ void I2CWriteMethod::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceComm
 }
 
 
-I2CWrite8Method::I2CWrite8Method(I2CEndpointBroker* broker): I2CMethodBase("i2c.write8", broker) {}
+I2CWrite8Method::I2CWrite8Method(I2CEndpointBroker* broker): I2CSchemaMethod<I2CWriteRegParams, 3>("i2c.write8", broker, write8_schema) {}
 
 I2CWrite8Method::~I2CWrite8Method() throw () {}
 
-void I2CWrite8Method::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceCommand& sc, xmppsc::SpaceCommandSink *sink)
+void I2CWrite8Method::handle(gloox::JID peer, const params_t& p, xmppsc::SpaceCommandSink *sink)
 {
-    // get parameters
-    const unsigned int device = retrieveHexParameter("device", sc);
-    const unsigned int reg = retrieveHexParameter("register", sc);
-    const unsigned int data = retrieveHexParameter("data", sc);
-
+    const unsigned int device = p.device;
+    const unsigned int reg = p.reg;
+    const unsigned int data = p.data;
 
     try {
         // get the device endpoint
@@ -234,8 +226,7 @@ void I2CWrite8Method::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceCom
         params["register"] = int2hex(reg);
         params["value"] = int2hex(data);
         params["response"] = int2hex(result);
-        const xmppsc::SpaceCommand idcmd("i2c.update", params);
-        sink->sendSpaceCommand(idcmd);
+        sink->sendSpaceCommand(xmppsc::SpaceCommand("i2c.update", std::move(params)));
     } catch (const I2CEndpointException& e) {
         // send exception
         I2C_EX_MSG
@@ -243,17 +234,15 @@ void I2CWrite8Method::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceCom
 }
 
 
-I2CWrite16Method::I2CWrite16Method(I2CEndpointBroker* broker): I2CMethodBase("i2c.write16", broker) {}
+I2CWrite16Method::I2CWrite16Method(I2CEndpointBroker* broker): I2CSchemaMethod<I2CWriteRegParams, 3>("i2c.write16", broker, write16_schema) {}
 
 I2CWrite16Method::~I2CWrite16Method() throw () {}
 
-void I2CWrite16Method::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceCommand& sc, xmppsc::SpaceCommandSink *sink)
+void I2CWrite16Method::handle(gloox::JID peer, const params_t& p, xmppsc::SpaceCommandSink *sink)
 {
-    // get parameters
-    const unsigned int device = retrieveHexParameter("device", sc);
-    const unsigned int reg = retrieveHexParameter("register", sc);
-    const unsigned int data = retrieveHexParameter("data", sc);
-
+    const unsigned int device = p.device;
+    const unsigned int reg = p.reg;
+    const unsigned int data = p.data;
 
     try {
         // get the device endpoint
@@ -270,8 +259,7 @@ void I2CWrite16Method::handleSpaceCommand(gloox::JID peer, const xmppsc::SpaceCo
         params["register"] = int2hex(reg);
         params["value"] = int2hex(data);
         params["response"] = int2hex(result);
-        const xmppsc::SpaceCommand idcmd("i2c.update", params);
-        sink->sendSpaceCommand(idcmd);
+        sink->sendSpaceCommand(xmppsc::SpaceCommand("i2c.update", std::move(params)));
     } catch (const I2CEndpointException& e) {
         // send exception
         I2C_EX_MSG
@@ -20,6 +20,9 @@
 
 #include "i2cendpoint.h"
 #include <xmppsc/spacecontrolclient.h>
+#include <xmppsc/util.h>
+
+#include <utility>
 
 namespace xmppsc {
 
@@ -28,8 +31,7 @@ namespace xmppsc {
         params["what"] = e.what(); \
         params["device"] = int2hex(e.address()); \
 	params["error"] = e.error(); \
-        const xmppsc::SpaceCommand ex("i2c.exception", params); \
-        sink->sendSpaceCommand(ex); \
+        sink->sendSpaceCommand(xmppsc::SpaceCommand("i2c.exception", std::move(params))); \
 
   
 class I2CMethodBase : public CommandMethod {
@@ -46,55 +48,121 @@ private:
   I2CEndpointBroker* m_broker;
 };
 
-class I2CReadMethod : public I2CMethodBase {
+//! Base for I2C methods with a declared parameter schema.
+/*!
+ * The parameters are decoded according to the schema into the fields of
+ * P before handle() is called, so the method does not need to deal with
+ * parameter errors.
+ */
+template<class P, size_t N>
+class I2CSchemaMethod : public I2CMethodBase {
+public:
+  //! The decoded parameters.
+  typedef P params_t;
+
+  I2CSchemaMethod(const std::string& command, I2CEndpointBroker* broker,
+                  const HexField<P> (&schema)[N]) throw(std::invalid_argument)
+      : I2CMethodBase(command, broker), m_schema(schema) {}
+
+  virtual ~I2CSchemaMethod() throw() {}
+
+  virtual void handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc, SpaceCommandSink* sink) {
+      params_t p;
+      ParameterError error;
+
+      if (decode_hex_fields(sc, m_schema, p, error))
+          handle(peer, p, sink);
+      else
+          send_parameter_error(error, sink);
+  }
+
+protected:
+  //! Handle the command with the decoded parameters.
+  virtual void handle(gloox::JID peer, const params_t& p, SpaceCommandSink* sink) = 0;
+
+private:
+  const HexField<P> (&m_schema)[N];
+};
+
+//! Parameters of i2c.read
+struct I2CReadParams {
+  unsigned int device;
+};
+
+//! Parameters of i2c.read8 and i2c.read16
+struct I2CReadRegParams {
+  unsigned int device;
+  unsigned int reg;
+};
+
+//! Parameters of i2c.write
+struct I2CWriteParams {
+  unsigned int device;
+  unsigned int data;
+};
+
+//! Parameters of i2c.write8 and i2c.write16
+struct I2CWriteRegParams {
+  unsigned int device;
+  unsigned int reg;
+  unsigned int data;
+};
+
+class I2CReadMethod : public I2CSchemaMethod<I2CReadParams, 1> {
   public:
     I2CReadMethod(I2CEndpointBroker* broker);
     virtual ~I2CReadMethod() throw();
-    
-    virtual void handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc, SpaceCommandSink* sink);
+
+  protected:
+    virtual void handle(gloox::JID peer, const params_t& p, SpaceCommandSink* sink);
 };
 
-class I2CRead8Method : public I2CMethodBase {
+class I2CRead8Method : public I2CSchemaMethod<I2CReadRegParams, 2> {
   public:
     I2CRead8Method(I2CEndpointBroker* broker);
     virtual ~I2CRead8Method() throw();
-    
-    virtual void handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc, SpaceCommandSink* sink);
+
+  protected:
+    virtual void handle(gloox::JID peer, const params_t& p, SpaceCommandSink* sink);
 };
 
-class I2CRead16Method : public I2CMethodBase {
+class I2CRead16Method : public I2CSchemaMethod<I2CReadRegParams, 2> {
   public:
     I2CRead16Method(I2CEndpointBroker* broker);
     virtual ~I2CRead16Method() throw();
-    
-    virtual void handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc, SpaceCommandSink* sink);
+
+  protected:
+    virtual void handle(gloox::JID peer, const params_t& p, SpaceCommandSink* sink);
 };
 
 
-class I2CWriteMethod : public I2CMethodBase {
+class I2CWriteMethod : public I2CSchemaMethod<I2CWriteParams, 2> {
   public:
     I2CWriteMethod(I2CEndpointBroker* broker);
     virtual ~I2CWriteMethod() throw();
-    
-    virtual void handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc, SpaceCommandSink* sink);
+
+  protected:
+    virtual void handle(gloox::JID peer, const params_t& p, SpaceCommandSink* sink);
 };
 
 
-class I2CWrite8Method : public I2CMethodBase {
+class I2CWrite8Method : public I2CSchemaMethod<I2CWriteRegParams, 3> {
   public:
     I2CWrite8Method(I2CEndpointBroker* broker);
     virtual ~I2CWrite8Method() throw();
-    
-    virtual void handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc, SpaceCommandSink* sink);
+
+  protected:
+    virtual void handle(gloox::JID peer, const params_t& p, SpaceCommandSink* sink);
 };
 
 
-class I2CWrite16Method : public I2CMethodBase {
+class I2CWrite16Method : public I2CSchemaMethod<I2CWriteRegParams, 3> {
   public:
     I2CWrite16Method(I2CEndpointBroker* broker);
     virtual ~I2CWrite16Method() throw();
-    
-    virtual void handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc, SpaceCommandSink* sink);
+
+  protected:
+    virtual void handle(gloox::JID peer, const params_t& p, SpaceCommandSink* sink);
 };
 
 } // namespace xmppsc
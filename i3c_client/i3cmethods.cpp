@@ -25,20 +25,26 @@ union I2C_result {
     unsigned char c[2];
     unsigned short r;
 };
+
+// 3 command bits and 4 data bits, see the register layout in REAME.commands.txt
+const xmppsc::HexField<xmppsc::I3CCallParams> call_schema[] = {
+    { { "device", 8, true, 0 }, &xmppsc::I3CCallParams::device },
+    { { "command", 3, true, 0 }, &xmppsc::I3CCallParams::command },
+    { { "data", 4, false, 0 }, &xmppsc::I3CCallParams::data }
+};
 } // anon namespace
 
 namespace xmppsc {
 
-I3CCallMethod::I3CCallMethod(I2CEndpointBroker* broker): I2CMethodBase("i3c.call", broker) { }
+I3CCallMethod::I3CCallMethod(I2CEndpointBroker* broker): I2CSchemaMethod<I3CCallParams, 3>("i3c.call", broker, call_schema) { }
 
 I3CCallMethod::~I3CCallMethod() throw() {}
 
-void I3CCallMethod::handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc, SpaceCommandSink* sink)
+void I3CCallMethod::handle(gloox::JID peer, const params_t& p, SpaceCommandSink* sink)
 {
-    // get parameters
-    const unsigned int device = retrieveHexParameter("device", sc);
-    const unsigned int command = retrieveHexParameter("command", sc);
-    const unsigned int data = retrieveHexParameter("data", sc, false, 0);
+    const unsigned int device = p.device;
+    const unsigned int command = p.command;
+    const unsigned int data = p.data;
 
     // render the register value
     unsigned char send = (command << 4) + data;
@@ -90,8 +96,7 @@ void I3CCallMethod::handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc,
             params["response"] =  int2hex(result.c[0]);
             params["i2c.register"] = int2hex(send);
             params["i2c.response"] = int2hex(result.r);
-            const xmppsc::SpaceCommand idcmd("i3c.response", params);
-            sink->sendSpaceCommand(idcmd);
+            sink->sendSpaceCommand(xmppsc::SpaceCommand("i3c.response", std::move(params)));
         } else {
             // send error
             xmppsc::SpaceCommand::space_command_params params;
@@ -99,8 +104,7 @@ void I3CCallMethod::handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc,
             params["command"] = int2hex(command);
             params["data"] = int2hex(data);
             params["i2c.register"] = int2hex(send);
-            const xmppsc::SpaceCommand idcmd("i3c.timeout", params);
-            sink->sendSpaceCommand(idcmd);
+            sink->sendSpaceCommand(xmppsc::SpaceCommand("i3c.timeout", std::move(params)));
         }
     } catch (const I2CEndpointException& e) {
         // send exception
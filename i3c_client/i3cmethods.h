@@ -25,12 +25,20 @@
 
 namespace xmppsc {
 
-class I3CCallMethod : public I2CMethodBase {
+//! Parameters of i3c.call
+struct I3CCallParams {
+    unsigned int device;
+    unsigned int command;
+    unsigned int data;
+};
+
+class I3CCallMethod : public I2CSchemaMethod<I3CCallParams, 3> {
 public:
     I3CCallMethod(I2CEndpointBroker* broker);
     virtual ~I3CCallMethod() throw();
 
-    virtual void handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc, SpaceCommandSink* sink);
+protected:
+    virtual void handle(gloox::JID peer, const params_t& p, SpaceCommandSink* sink);
 };
 
 
@@ -1,15 +1,24 @@
 #include <stdlib.h>
 #include <popt.h>
 #include <syslog.h>
+#include <signal.h>
 
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <sstream>
-#include <thread>
-#include <chrono>
 
 #include <xmppsc/configuredclientfactory.h>
 #include <xmppsc/spacecontrolclient.h>
+#include <xmppsc/binaryserializer.h>
 #include <xmppsc/methodhandler.h>
+#include <xmppsc/commandrouter.h>
+#include <xmppsc/workerpool.h>
+#include <xmppsc/eventloop.h>
+#include <xmppsc/clientreactor.h>
+#include <xmppsc/reconnectscheduler.h>
+#include <xmppsc/keepalive.h>
+#include <xmppsc/unixsocketserver.h>
 #include <xmppsc/daemon.h>
 
 
@@ -68,6 +77,169 @@ bool Options::read_options(int argc, const char* argv[]) {
 }
 
 
+//! Signals handled in the event loop
+class SignalEvents : public xmppsc::EventLoop::SignalHandler {
+public:
+    SignalEvents(xmppsc::Daemon* _daemon, bool _foreground, xmppsc::EventLoop* _loop,
+                 const std::string& _config_file)
+        : terminate(false), scc(0), keepalive(0), local(0), daemon(_daemon), foreground(_foreground),
+          loop(_loop), config_file(_config_file) {}
+
+    virtual void handleSignal(int signo);
+
+    bool terminate;
+    xmppsc::SpaceControlClient* scc;
+    xmppsc::KeepAlive* keepalive;
+    xmppsc::UnixSocketServer* local;
+
+private:
+    xmppsc::Daemon* daemon;
+    bool foreground;
+    xmppsc::EventLoop* loop;
+    std::string config_file;
+
+    void log(const std::string& msg);
+
+    //! Read the access rules and limits again, the session is kept.
+    void reload();
+};
+
+void SignalEvents::handleSignal(int signo) {
+    switch (signo) {
+    case SIGHUP:
+        log("SIGHUP received, reloading the configuration.");
+        reload();
+        break;
+    case SIGTERM:
+        log("SIGTERM received.");
+        terminate = true;
+        break;
+    case SIGUSR1: {
+        // report the wakeup statistics
+        const xmppsc::EventLoop::Stats st = loop->stats();
+        std::ostringstream msg;
+        msg << "Wakeups: " << st.wakeups << " in " << st.seconds << " s ("
+            << st.wakeups_per_second() << "/s, " << st.timeouts << " timeouts), "
+            << "events: " << st.events << ", CPU per wakeup: " << st.cpu_us_per_wakeup() << " us";
+
+        if (scc)
+            msg << "; suppressed errors: " << scc->suppressed_errors();
+
+        const xmppsc::WorkerPool* pool = scc ? scc->worker_pool() : 0;
+        if (pool)
+            msg << "; rejected by full worker queues: " << pool->rejected();
+
+        const xmppsc::RateLimiter* rl = scc ? scc->rate_limiter() : 0;
+        if (rl) {
+            const xmppsc::RateLimiter::Stats rs = rl->stats();
+            msg << "; rate limit admitted: " << rs.admitted << ", busy: " << rs.busy
+                << ", dropped: " << rs.dropped << ", blocks: " << rs.blocks
+                << ", peers: " << rs.peers << " (" << rs.blocked_peers << " blocked)";
+        }
+
+        const xmppsc::OutboundQueue* q = scc ? scc->outbound_queue() : 0;
+        if (q) {
+            const xmppsc::OutboundQueue::Stats qs = q->stats();
+            msg << "; outbound sent: " << qs.sent << ", dropped: " << qs.dropped
+                << ", max depth: " << qs.max_depth << ", latency avg/max: "
+                << qs.latency_avg_us << "/" << qs.latency_max_us << " us";
+        }
+        if (keepalive) {
+            const xmppsc::KeepAlive::Stats ks = keepalive->stats();
+            msg << "; pings: " << ks.pings << ", pongs: " << ks.pongs << ", idle timeouts: "
+                << ks.timeouts << ", RTT last/max: " << ks.rtt_ms << "/" << ks.rtt_max_ms << " ms";
+        }
+        log(msg.str());
+        break;
+    }
+    }
+}
+
+void SignalEvents::log(const std::string& msg) {
+    if (foreground)
+        std::cerr << msg << std::endl;
+    else
+        daemon->message(LOG_NOTICE, "%s", msg.c_str());
+}
+
+void SignalEvents::reload() {
+    // e.g. a SIGHUP during start-up, the configuration is read anyway
+    if (!scc && !local) {
+        log("Nothing to reload yet, the configuration is read at start-up.");
+        return;
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::shared_ptr<xmppsc::SpaceControlClient::Policy> next(new xmppsc::SpaceControlClient::Policy());
+    unsigned int error_rate = 0;
+    try {
+        xmppsc::ConfiguredClientFactory ccf(config_file);
+        next->access.reset(ccf.newAccessFilter());
+        next->limiter.reset(ccf.newRateLimiter());
+        next->max_body = ccf.maxBody();
+        error_rate = ccf.errorRate();
+    } catch (xmppsc::ConfiguredClientFactoryException &ccfe) {
+        std::ostringstream msg;
+        msg << "Reload failed, keeping the previous configuration: " << ccfe.what();
+        log(msg.str());
+        return;
+    }
+
+    // keep the buckets and blocks of the peers, only the limits change
+    const std::shared_ptr<const xmppsc::SpaceControlClient::Policy> current(
+        scc ? scc->policy() : std::shared_ptr<const xmppsc::SpaceControlClient::Policy>());
+    if (next->limiter && current && current->limiter) {
+        current->limiter->reconfigure(*next->limiter);
+        next->limiter = current->limiter;
+    }
+
+    // commands in flight finish with the previous policy
+    if (scc) {
+        scc->set_policy(next);
+        scc->set_error_rate(error_rate, 2 * error_rate);
+    }
+    if (local)
+        local->set_policy(next);
+
+    const long us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+    std::ostringstream msg;
+    msg << "Configuration reloaded in " << us / 1000 << "." << (us % 1000) / 100 << " ms.";
+    log(msg.str());
+}
+
+
+//! Timer for the delay until the next connection attempt
+class RetryTimer : public xmppsc::EventLoop::TimerHandler {
+public:
+    RetryTimer() : expired(false) {}
+
+    virtual void handleTimer(int id) {
+        expired = true;
+    }
+
+    bool expired;
+};
+
+//! Wait in the event loop; returns early on termination.
+void wait_for(xmppsc::EventLoop* loop, unsigned int ms, const SignalEvents& signals) {
+    if (!ms)
+        return;
+
+    RetryTimer timer;
+    const int id = loop->add_timer(ms, false, &timer);
+    if (id < 0)
+        return;
+
+    while (!timer.expired && !signals.terminate)
+        loop->run_once(-1);
+
+    if (!timer.expired)
+        loop->cancel_timer(id);
+}
+
+
 int main(int argc, const char* argv[]) {
     Options opt;
     if (!opt.read_options(argc, argv)) {
@@ -89,6 +261,17 @@ int main(int argc, const char* argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    // signals are handled in the event loop; block them before any
+    // thread is started, so the threads inherit the mask
+    xmppsc::EventLoop loop;
+    SignalEvents signals(&daemon, opt.foreground, &loop, opt.config_file);
+    loop.add_signal(SIGHUP, &signals);
+    loop.add_signal(SIGTERM, &signals);
+    loop.add_signal(SIGUSR1, &signals);
+    // caught by the daemon before the loop took over
+    if (const int signo = daemon.take_signal())
+        signals.handleSignal(signo);
+
     xmppsc::I2CEndpointBroker*  broker = new xmppsc::I2CEndpointBroker();
 
     //xmppsc::I2CEndpoint* ep = broker->endpoint(0x22);
@@ -97,10 +280,30 @@ int main(int argc, const char* argv[]) {
 
     gloox::Client* client=0;
     xmppsc::AccessFilter* af=0;
+    // access rules and limits, replaced on SIGHUP
+    std::shared_ptr<xmppsc::SpaceControlClient::Policy> policy(new xmppsc::SpaceControlClient::Policy());
+    unsigned int workers=0;
+    unsigned int worker_queue=0;
+    unsigned int outbound=0;
+    xmppsc::ReconnectScheduler* reconnect=0;
+    xmppsc::SocketProfile socket;
+    std::string local_socket;
+    unsigned int error_rate=0;
+    // the configuration is read on first use
+    xmppsc::ConfiguredClientFactory ccf(opt.config_file);
     try {
-        xmppsc::ConfiguredClientFactory ccf(opt.config_file);
         client = ccf.newClient();
         af = ccf.newAccessFilter();
+        policy->access.reset(af);
+        workers = ccf.workers();
+        worker_queue = ccf.worker_queue();
+        outbound = ccf.outbound_queue();
+        reconnect = ccf.newReconnectScheduler();
+        socket = ccf.socketProfile();
+        local_socket = ccf.localSocket();
+        policy->max_body = ccf.maxBody();
+        error_rate = ccf.errorRate();
+        policy->limiter.reset(ccf.newRateLimiter());
     } catch (xmppsc::ConfiguredClientFactoryException &ccfe) {
         std::ostringstream msg;
         msg << "ConfiguredClientFactoryException: " << ccfe.what();
@@ -119,45 +322,144 @@ int main(int argc, const char* argv[]) {
     i2ch->add_method(new xmppsc::I2CWriteMethod(broker));
     i2ch->add_method(new xmppsc::I2CWrite8Method(broker));
     i2ch->add_method(new xmppsc::I2CWrite16Method(broker));
-    i2ch->add_method(new xmppsc::I3CCallMethod(broker));
+    i2ch->freeze();
+
+    xmppsc::MethodHandler* i3ch = new xmppsc::MethodHandler();
+
+    i3ch->add_method(new xmppsc::I3CCallMethod(broker));
+    i3ch->freeze();
+
+    // route by command namespace
+    xmppsc::CommandRouter* router = new xmppsc::CommandRouter();
+    router->add_namespace("i2c", i2ch);
+    router->add_namespace("i3c", i3ch);
+    router->freeze();
 
 
     if (client) {
-        // Use the "eco" variant
-        xmppsc::set_eco_tcp_client(client);
+        // Use the "eco" variant with low-latency socket options
+        xmppsc::set_eco_tcp_client(client, socket);
+        // start with the first configured server
+        reconnect->apply(client);
 
-        xmppsc::SpaceControlClient* scc = new xmppsc::SpaceControlClient(client, i2ch,
+        xmppsc::SpaceControlClient* scc = new xmppsc::SpaceControlClient(client, router,
                 new xmppsc::TextSpaceCommandSerializer(), af);
+        // scripts and daemons may negotiate the compact format
+        scc->add_serializer("binary", new xmppsc::BinarySpaceCommandSerializer());
+        // reject oversized messages unparsed, keep single peers from
+        // saturating the bus and do not amplify floods with errors
+        scc->set_policy(policy);
+        scc->set_error_rate(error_rate, 2 * error_rate);
+        // keep the per-message allocations off the heap
+        scc->set_message_arena(new xmppsc::MessageArena(16 * 1024));
+
+        // handle slow bus operations off the connection thread
+        xmppsc::WorkerPool* pool = 0;
+        if (workers) {
+            pool = new xmppsc::WorkerPool(workers, worker_queue);
+            scc->set_worker_pool(pool);
+        }
+
+        // send the responses from the connection thread
+        if (outbound)
+            scc->enable_outbound_queue(outbound);
+
+        // the connection is driven by socket events instead of polling
+        xmppsc::ClientReactor reactor(&loop, scc);
+        signals.scc = scc;
+
+        // detect dead connections
+        xmppsc::KeepAlive* keepalive = 0;
+        try {
+            keepalive = ccf.newKeepAlive(&loop, &reactor);
+        } catch (xmppsc::ConfiguredClientFactoryException &ccfe) {
+            std::ostringstream msg;
+            msg << "No keepalive: " << ccfe.what();
+            if (opt.foreground)
+              std::cerr << msg.str() << std::endl;
+            else
+              daemon.message(LOG_ERR, msg.str().c_str());
+        }
+        signals.keepalive = keepalive;
+
+        // local scripts do not need the detour via the XMPP server
+        xmppsc::TextSpaceCommandSerializer local_text;
+        xmppsc::BinarySpaceCommandSerializer local_binary;
+        xmppsc::UnixSocketServer local(&loop, router, &local_text);
+        local.add_serializer(&local_binary);
+        // the same rules and rate limits as for XMPP peers
+        local.set_policy(policy);
+        local.set_error_limiter(scc->error_limiter());
+        // local commands for a device are queued with those from XMPP
+        if (pool)
+            local.set_worker_pool(pool);
+        signals.local = &local;
+        // held by the client and the local socket from here on
+        policy.reset();
+        if (!local_socket.empty() && !local.listen(local_socket)) {
+            std::ostringstream msg;
+            msg << "Cannot serve the local socket " << local_socket << ".";
+            if (opt.foreground)
+              std::cerr << msg.str() << std::endl;
+            else
+              daemon.message(LOG_ERR, msg.str().c_str());
+        }
 
         while ( (scc->conn_error() != gloox::ConnUserDisconnected) &&
-	        (!daemon.sighup()) ) {
-            if (!client->connect(false)) {
+	        (!signals.terminate) ) {
+            if (!reactor.connected() && !reactor.connect()) {
+		const unsigned int delay = reconnect->failed();
+		reconnect->apply(client);
+
 		// print error message
 		std::ostringstream msg;
-		msg << "Could not connect: " << scc->conn_error();
+		msg << "Could not connect: " << scc->conn_error()
+		    << ", next try in " << delay << " ms";
+		if (reconnect->server())
+		    msg << " with " << reconnect->server()->host;
+		msg << ".";
 		if (opt.foreground)
 		  std::cerr << msg.str() << std::endl;
 		else
 		  daemon.message(LOG_ERR, msg.str().c_str());
 
-		// wait 30 seconds
-		if (opt.foreground)
-		  std::cerr << "Waiting 30 seconds until next try." << std::endl;
-		else
-		  syslog(LOG_ERR, "Waiting 30 seconds until next try.");
-		if (scc->conn_error() != gloox::ConnUserDisconnected)
-		    std::this_thread::sleep_for(std::chrono::milliseconds(30*1000));
-	    } else {  
-		client->recv(500);
+		wait_for(&loop, delay, signals);
+	    } else {
+		// sleep until the socket, a timer or a signal fires
+		loop.run_once(-1);
+
+		if (scc->conn_error() == gloox::ConnNoError)
+		    // the session is up, start over with the backoff
+		    reconnect->succeeded();
+		else if (!reactor.connected() && scc->conn_error() != gloox::ConnUserDisconnected) {
+		    // connection lost
+		    const unsigned int delay = reconnect->failed();
+		    reconnect->apply(client);
+		    wait_for(&loop, delay, signals);
+		}
 	    }
         }
 
+        // finish the queued commands before the client goes away
+        local.set_worker_pool(0);
+        if (pool) {
+            pool->stop();
+            delete pool;
+        }
+        scc->flush_outbound();
+
+        signals.scc = 0;
+        signals.keepalive = 0;
+        signals.local = 0;
+        if (keepalive)
+            delete keepalive;
+
         delete scc;
         delete client;
     }
 
-    if (af)
-        delete af;
+    if (reconnect)
+        delete reconnect;
 
     delete broker;
 
@@ -23,6 +23,11 @@ AccessFilter::AccessFilter() throw() {}
 
 AccessFilter::~AccessFilter() throw() {}
 
+bool AccessFilter::accepted(const gloox::JID& jid, const std::string& command) const throw()
+{
+    return accepted(jid);
+}
+
 
 
 ListAccessFilter::ListAccessFilter(const ListAccessFilter::jid_list& jids) throw()
@@ -18,6 +18,7 @@
 #ifndef ACCESSFILTER_H__
 #define ACCESSFILTER_H__
 
+#include <string>
 #include <vector>
 
 #include <gloox/jid.h>
@@ -41,6 +42,16 @@ public:
      * @returns true if the JID can be accepted, otherwise false
      */
     virtual bool accepted(const gloox::JID& jid) const throw() = 0;
+
+    //! Check if JID is accepted for a command.
+    /*!
+     * The default implementation does not distinguish commands.
+     *
+     * @param jid the JID to be checked
+     * @param command the command name
+     * @returns true if the JID may use the command, otherwise false
+     */
+    virtual bool accepted(const gloox::JID& jid, const std::string& command) const throw();
 };
 
 
@@ -55,6 +66,7 @@ public:
 
     const jid_list& jids() const throw();
     
+    using AccessFilter::accepted;
     virtual bool accepted(const gloox::JID& jid) const throw();
 private:
   const jid_list m_jids;
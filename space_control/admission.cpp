@@ -0,0 +1,163 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "admission.h"
+#include "util.h"
+
+#include <vector>
+
+namespace xmppsc {
+
+Admission::Admission(const char* exempt) throw()
+    : m_exempt(exempt), m_verdict(ADMITTED), m_reason(0), m_retry_ms(0), m_checked(false) {}
+
+bool Admission::check(const SpaceControlClient::Policy& policy, const gloox::JID& peer,
+                      const std::string& body, const SpaceCommandSerializer& ser) {
+    m_verdict = ADMITTED;
+    m_reason = 0;
+    m_retry_ms = 0;
+    m_checked = false;
+    m_cmd.clear();
+    m_threadId.clear();
+
+    const AccessFilter* access = policy.access.get();
+    if (access && !access->accepted(peer))
+        return refuse(DENIED, "Denied by access filter!");
+
+    if (policy.max_body && body.size() > policy.max_body)
+        return refuse(OVERSIZED, "Message body exceeds the size limit.");
+
+    if (!access && !policy.limiter) {
+        // nothing to check by name
+        m_checked = true;
+        return true;
+    }
+
+    // envelopes are checked after unpacking
+    if (!ser.peek(body, m_cmd, m_threadId) || m_cmd == SpaceCommandEnvelope::COMMAND) {
+        m_cmd.clear();
+        m_threadId.clear();
+        return true;
+    }
+
+    m_checked = true;
+    return check_command(policy, peer, m_cmd);
+}
+
+bool Admission::check_command(const SpaceControlClient::Policy& policy, const gloox::JID& peer,
+                              const std::string& cmd) {
+    const AccessFilter* access = policy.access.get();
+    if (access && !(m_exempt && cmd == m_exempt) && !access->accepted(peer, cmd))
+        return refuse(DENIED, "Command denied by access filter!");
+
+    RateLimiter* limiter = policy.limiter.get();
+    if (limiter) {
+        switch (limiter->admit(peer, cmd, &m_retry_ms)) {
+        case RateLimiter::ADMITTED:
+            break;
+        case RateLimiter::BUSY:
+            return refuse(BUSY, "Rate limit exceeded!");
+        default:
+            return refuse(BLOCKED, 0);
+        }
+    }
+
+    return true;
+}
+
+bool Admission::check_commands(const SpaceControlClient::Policy& policy, const gloox::JID& peer,
+                               const SpaceCommandEnvelope::batch& cmds) {
+    const AccessFilter* access = policy.access.get();
+    RateLimiter* limiter = policy.limiter.get();
+
+    std::vector<std::string> names;
+    if (limiter)
+        names.reserve(cmds.size());
+
+    for (SpaceCommandEnvelope::batch::const_iterator it = cmds.begin(); it != cmds.end(); ++it) {
+        const std::string& cmd = it->second.cmd();
+        if (access && !(m_exempt && cmd == m_exempt) && !access->accepted(peer, cmd))
+            return refuse(DENIED, "Command denied by access filter!");
+        if (limiter)
+            names.push_back(cmd);
+    }
+
+    if (limiter) {
+        switch (limiter->admit(peer, names, &m_retry_ms)) {
+        case RateLimiter::ADMITTED:
+            break;
+        case RateLimiter::BUSY:
+            return refuse(BUSY, "Rate limit exceeded!");
+        default:
+            return refuse(BLOCKED, 0);
+        }
+    }
+
+    return true;
+}
+
+Admission::Verdict Admission::verdict() const throw() {
+    return m_verdict;
+}
+
+bool Admission::checked() const throw() {
+    return m_checked;
+}
+
+const std::string& Admission::threadId() const throw() {
+    return m_threadId;
+}
+
+bool Admission::error() const throw() {
+    return m_verdict == DENIED || m_verdict == OVERSIZED;
+}
+
+bool Admission::answer(const std::string& body, SpaceCommandSink* sink) const {
+    SpaceCommand::space_command_params par;
+
+    switch (m_verdict) {
+    case DENIED:
+        par["reason"] = m_reason;
+        sink->sendSpaceCommand(SpaceCommand("denied", std::move(par)));
+        return true;
+
+    case OVERSIZED:
+        par["what"] = m_reason;
+        par["body"] = abbreviate(body, SpaceControlClient::ECHO_LIMIT);
+        sink->sendSpaceCommand(SpaceCommand("exception", std::move(par)));
+        return true;
+
+    case BUSY:
+        // tell the peer when to retry
+        par["reason"] = m_reason;
+        par["retry"] = std::to_string(m_retry_ms);
+        sink->sendSpaceCommand(SpaceCommand("busy", std::move(par)));
+        return true;
+
+    default:
+        // admitted or blocked, not worth an answer
+        return false;
+    }
+}
+
+bool Admission::refuse(Verdict verdict, const char* reason) throw() {
+    m_verdict = verdict;
+    m_reason = reason;
+    return false;
+}
+
+} // namespace xmppsc
+
+// End of File
@@ -0,0 +1,136 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADMISSION_H__
+#define ADMISSION_H__
+
+#include <string>
+
+#include <gloox/jid.h>
+
+#include "spacecommand.h"
+#include "spacecontrolclient.h"
+
+namespace xmppsc {
+
+//! Admission of received messages against a policy.
+/*!
+ * Shared by the transports, so XMPP and local peers are checked in the
+ * same order: the peer against the access filter, the body size, the
+ * command name found by peek() against the access filter and finally
+ * the rate limiter. A message is only parsed if it has been admitted.
+ *
+ * Envelopes and bodies that cannot be peeked into are not checked by
+ * command name; their commands are checked with check_command() or
+ * check_commands() after parsing.
+ */
+class Admission {
+public:
+    //! The result of the checks.
+    enum Verdict {
+        //! the message may be handled
+        ADMITTED,
+        //! rejected by the access filter
+        DENIED,
+        //! the body exceeds the size limit
+        OVERSIZED,
+        //! the peer exceeds its rate
+        BUSY,
+        //! the peer is blocked and not answered
+        BLOCKED
+    };
+
+    //! Prepare the admission of a message.
+    /*!
+     * \param exempt A command that is not checked by the access filter,
+     *               e.g. the serializer negotiation, or 0.
+     */
+    explicit Admission(const char* exempt = 0) throw();
+
+    //! Check a received message before it is parsed.
+    /*!
+     * \param policy The policy.
+     * \param peer   The sending peer.
+     * \param body   The message body.
+     * \param ser    The serializer recognizing the body.
+     * \returns true if the message is admitted.
+     */
+    bool check(const SpaceControlClient::Policy& policy, const gloox::JID& peer,
+               const std::string& body, const SpaceCommandSerializer& ser);
+
+    //! Check a parsed command that has not been checked by name.
+    /*!
+     * \param policy The policy.
+     * \param peer   The sending peer.
+     * \param cmd    The command name.
+     * \returns true if the command is admitted.
+     */
+    bool check_command(const SpaceControlClient::Policy& policy, const gloox::JID& peer,
+                       const std::string& cmd);
+
+    //! Check the parsed commands of an envelope as a whole.
+    /*!
+     * Each command is checked by the access filter, then the rate
+     * limiter decides on all of them at once, so a refused envelope
+     * does not use up tokens.
+     *
+     * \param policy The policy.
+     * \param peer   The sending peer.
+     * \param cmds   The unpacked commands.
+     * \returns true if all commands are admitted.
+     */
+    bool check_commands(const SpaceControlClient::Policy& policy, const gloox::JID& peer,
+                        const SpaceCommandEnvelope::batch& cmds);
+
+    //! Get the result of the last check.
+    Verdict verdict() const throw();
+
+    //! Check if the command has been checked by name before parsing.
+    bool checked() const throw();
+
+    //! Get the thread ID found by peek(), empty if not peeked.
+    const std::string& threadId() const throw();
+
+    //! Check if the refusal is answered with an error.
+    /*!
+     * Error responses are subject to the error rate, see ErrorLimiter.
+     *
+     * \returns true if denied or oversized.
+     */
+    bool error() const throw();
+
+    //! Answer a refused message.
+    /*!
+     * \param body The message body, a part is echoed for oversized bodies.
+     * \param sink The sink for the response.
+     * \returns false if the message is not answered, i.e. admitted or blocked.
+     */
+    bool answer(const std::string& body, SpaceCommandSink* sink) const;
+
+private:
+    const char* m_exempt;
+    Verdict m_verdict;
+    const char* m_reason;
+    unsigned int m_retry_ms;
+    bool m_checked;
+    std::string m_cmd;
+    std::string m_threadId;
+
+    bool refuse(Verdict verdict, const char* reason) throw();
+};
+
+}
+
+#endif // ADMISSION_H__
@@ -0,0 +1,72 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+
+Latency::Latency() : m_sorted(true) {}
+
+void Latency::add(clock::duration d) {
+    m_us.push_back(std::chrono::duration<double, std::micro>(d).count());
+    m_sorted = false;
+}
+
+void Latency::clear() {
+    m_us.clear();
+    m_sorted = true;
+}
+
+size_t Latency::size() const throw() {
+    return m_us.size();
+}
+
+double Latency::percentile(double p) {
+    if (m_us.empty())
+        return 0;
+
+    if (!m_sorted) {
+        std::sort(m_us.begin(), m_us.end());
+        m_sorted = true;
+    }
+
+    // nearest rank
+    const size_t rank = static_cast<size_t>(std::ceil(p * m_us.size()));
+    return m_us[rank ? rank - 1 : 0];
+}
+
+void Latency::report(std::ostream& out, const std::string& label, double seconds) {
+    out << std::fixed << std::setprecision(1)
+        << label << ": " << m_us.size() << " cmds in " << seconds << " s, "
+        << (seconds > 0 ? m_us.size() / seconds : 0) << " cmds/s, "
+        << "p50 " << percentile(0.5) << " us, "
+        << "p99 " << percentile(0.99) << " us, "
+        << "p999 " << percentile(0.999) << " us" << std::endl;
+}
+
+void report_rate(std::ostream& out, const std::string& label, unsigned long count, double seconds) {
+    out << std::fixed << std::setprecision(1)
+        << label << ": " << (seconds > 0 ? count / seconds : 0) << " ops/s, "
+        << (count ? seconds * 1e9 / count : 0) << " ns/op" << std::endl;
+}
+
+unsigned long bench_arg(int argc, char** argv, int i, unsigned long def) {
+    return i < argc ? std::strtoul(argv[i], 0, 0) : def;
+}
+
+// End of File
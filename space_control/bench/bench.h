@@ -0,0 +1,94 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BENCH_H__
+#define BENCH_H__
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//! Latencies collected by a benchmark run.
+class Latency {
+public:
+    typedef std::chrono::steady_clock clock;
+
+    Latency();
+
+    //! Add a sample.
+    void add(clock::duration d);
+
+    //! Remove all samples.
+    void clear();
+
+    //! Get the number of samples.
+    size_t size() const throw();
+
+    //! Get a percentile in microseconds.
+    /*!
+     * \param p The percentile as fraction, e.g. 0.99.
+     * \returns the latency or 0 without samples.
+     */
+    double percentile(double p);
+
+    //! Print the number of samples, the rate and the percentiles.
+    /*!
+     * \param out     The output stream.
+     * \param label   The name of the run.
+     * \param seconds The duration of the run.
+     */
+    void report(std::ostream& out, const std::string& label, double seconds);
+
+private:
+    std::vector<double> m_us;
+    bool m_sorted;
+};
+
+//! Print the rate and the time per operation of a loop.
+/*!
+ * \param out     The output stream.
+ * \param label   The name of the loop.
+ * \param count   The number of operations.
+ * \param seconds The duration of the loop.
+ */
+void report_rate(std::ostream& out, const std::string& label, unsigned long count, double seconds);
+
+//! Get a numeric argument of a benchmark.
+/*!
+ * \param argc The number of arguments.
+ * \param argv The arguments.
+ * \param i    The index of the argument.
+ * \param def  The value if the argument is missing.
+ * \returns the value.
+ */
+unsigned long bench_arg(int argc, char** argv, int i, unsigned long def);
+
+//! Round trips through the loopback server, see loopbackbench.cpp.
+int bench_loopback(int argc, char** argv);
+
+//! Two peers sharing a rate limited daemon, see fairnessbench.cpp.
+int bench_fairness(int argc, char** argv);
+
+//! Command dispatch by a MethodHandler, see lookupbench.cpp.
+int bench_lookup(int argc, char** argv);
+
+//! Text and binary serializers, see parserbench.cpp.
+int bench_parser(int argc, char** argv);
+
+//! TCP round trips with socket profiles, see socketbench.cpp.
+int bench_socket(int argc, char** argv);
+
+#endif // BENCH_H__
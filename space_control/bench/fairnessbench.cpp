@@ -0,0 +1,94 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+#include "loopbackharness.h"
+
+#include "ratelimiter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using namespace xmppsc;
+
+namespace {
+
+void report(const std::string& label, BenchPeer& peer) {
+    peer.latency().report(std::cout, label, peer.seconds());
+    std::cout << label << ": busy " << peer.busy() << ", errors " << peer.errors()
+              << ", lost " << peer.lost() << std::endl;
+}
+
+} // anonymous namespace
+
+// xmppsc-bench fairness [count] [rate] [workers]
+//
+// Two peers share a daemon whose rate limiter admits rate commands per
+// second and peer. A polite peer sends one command at a time at half its
+// rate, first alone and then while a flooding peer keeps 64 commands in
+// flight. The flood should get busy responses for anything above its
+// rate, while the polite peer gets no busy responses and keeps its latency.
+// Blocking is not enabled; a blocked flood would simply stop.
+int bench_fairness(int argc, char** argv) {
+    const unsigned long count = bench_arg(argc, argv, 0, 1000);
+    const unsigned long rate = std::max(bench_arg(argc, argv, 1, 1000), 2ul);
+    const unsigned int workers = bench_arg(argc, argv, 2, 2);
+
+    RateLimiter limiter(rate, rate / 10);
+    const Latency::clock::duration interval = std::chrono::microseconds(2000000 / rate);
+
+    LoopbackServer server;
+    BenchDaemon daemon(&server, workers);
+    BenchPeer polite(&server, "polite");
+    BenchPeer flood(&server, "flood");
+    daemon.scc()->set_rate_limiter(&limiter);
+
+    if (!daemon.start() || !polite.start() || !flood.start()) {
+        std::cerr << "Cannot connect to the loopback server!" << std::endl;
+        return 1;
+    }
+
+    polite.run(daemon.jid(), count, 1, interval);
+    report("polite alone", polite);
+
+    // flood in rounds until the polite peer is done
+    std::atomic<bool> done(false);
+    unsigned long admitted = 0, busy = 0;
+    std::thread flooding([&] {
+        while (!done) {
+            flood.run(daemon.jid(), 10000, 64);
+            admitted += flood.latency().size();
+            busy += flood.busy();
+        }
+    });
+
+    polite.run(daemon.jid(), count, 1, interval);
+    done = true;
+    flooding.join();
+
+    report("polite with flood", polite);
+    std::cout << "flood: admitted " << admitted << ", busy " << busy << std::endl;
+
+    flood.stop();
+    polite.stop();
+    daemon.stop();
+    daemon.scc()->set_rate_limiter(0);
+    return 0;
+}
+
+// End of File
@@ -0,0 +1,144 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+
+#include "methodhandler.h"
+#include "util.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+using namespace xmppsc;
+
+namespace {
+
+typedef std::chrono::steady_clock clock;
+
+double since(clock::time_point begin) {
+    return std::chrono::duration<double>(clock::now() - begin).count();
+}
+
+// counts the responses
+class CountingSink : public SpaceCommandSink {
+public:
+    CountingSink() : count(0) {}
+
+    virtual void sendSpaceCommand(const SpaceCommand& sc) {
+        count += sc.params().size();
+    }
+
+    virtual const std::string& threadId() const throw() {
+        return m_threadId;
+    }
+
+    unsigned long count;
+
+private:
+    std::string m_threadId;
+};
+
+const HexParameter WRITE_SCHEMA[] = {
+    { "device", 7, true, 0 },
+    { "register", 8, true, 0 },
+    { "data", 8, true, 0 },
+};
+
+// an I2C style write that decodes its parameters with a schema
+class SchemaMethod : public CommandMethod {
+public:
+    SchemaMethod(const std::string& cmd) : CommandMethod(cmd) {}
+
+    virtual void handleSpaceCommand(gloox::JID, const SpaceCommand& sc, SpaceCommandSink* sink) {
+        unsigned int values[3];
+        ParameterError error;
+        if (!decode_hex_parameters(sc, WRITE_SCHEMA, values, error)) {
+            send_parameter_error(error, sink);
+            return;
+        }
+
+        SpaceCommand::space_command_params par;
+        par["data"] = int2hex(values[2]);
+        sink->sendSpaceCommand(SpaceCommand("i2c.result", std::move(par)));
+    }
+};
+
+// the same write with retrieveHexParameter, which throws on errors
+class ThrowingMethod : public CommandMethod {
+public:
+    ThrowingMethod(const std::string& cmd) : CommandMethod(cmd) {}
+
+    virtual void handleSpaceCommand(gloox::JID, const SpaceCommand& sc, SpaceCommandSink* sink) {
+        retrieveHexParameter("device", sc);
+        retrieveHexParameter("register", sc);
+        const int data = retrieveHexParameter("data", sc);
+
+        SpaceCommand::space_command_params par;
+        par["data"] = int2hex(data);
+        sink->sendSpaceCommand(SpaceCommand("i2c.result", std::move(par)));
+    }
+};
+
+SpaceCommand command(const char* cmd, const char* data) {
+    SpaceCommand::space_command_params par;
+    par["device"] = "0x20";
+    par["register"] = "0x95";
+    par["data"] = data;
+    return SpaceCommand(cmd, par);
+}
+
+void run(const std::string& label, MethodHandler& handler, const SpaceCommand& sc,
+         unsigned long count) {
+    const gloox::JID peer("tux@n39.eu/bench");
+    CountingSink sink;
+
+    const clock::time_point begin = clock::now();
+    for (unsigned long i = 0; i < count; i++)
+        handler.handleSpaceCommand(peer, sc, &sink);
+    report_rate(std::cout, label, count, since(begin));
+}
+
+} // anonymous namespace
+
+// xmppsc-bench lookup [count]
+//
+// Dispatch through a MethodHandler with a dozen I2C style methods:
+// valid commands, unknown commands and commands with an illegal value,
+// the latter for methods with a schema and for methods that throw.
+int bench_lookup(int argc, char** argv) {
+    const unsigned long count = bench_arg(argc, argv, 0, 1000000);
+
+    const char* const names[] = {
+        "i2c.read", "i2c.read8", "i2c.read16", "i2c.read_block",
+        "i2c.write", "i2c.write8", "i2c.write16", "i2c.write_block",
+        "i2c.pec", "i2c.process_call", "i2c.quick",
+    };
+
+    MethodHandler handler;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+        handler.add_method(new SchemaMethod(names[i]));
+    handler.add_method(new ThrowingMethod("i2c.legacy_write8"));
+    handler.freeze();
+
+    run("valid", handler, command("i2c.write8", "0x01"), count);
+    run("unknown", handler, command("i2c.wirte8", "0x01"), count);
+    run("malformed", handler, command("i2c.write8", "0xzz"), count);
+    run("malformed (throwing)", handler, command("i2c.legacy_write8", "0xzz"), count);
+
+    return 0;
+}
+
+// End of File
@@ -0,0 +1,54 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+#include "loopbackharness.h"
+
+#include <iostream>
+
+using namespace xmppsc;
+
+// xmppsc-bench loopback [count] [window] [workers]
+//
+// An i3c_cli-style peer and a space control client with a method handler
+// exchange commands through the loopback server, the whole path from the
+// serializer through the handler and back, without network.
+int bench_loopback(int argc, char** argv) {
+    const unsigned long count = bench_arg(argc, argv, 0, 10000);
+    const unsigned int window = bench_arg(argc, argv, 1, 1);
+    const unsigned int workers = bench_arg(argc, argv, 2, 0);
+
+    LoopbackServer server;
+    BenchDaemon daemon(&server, workers);
+    BenchPeer peer(&server, "cli");
+
+    if (!daemon.start() || !peer.start()) {
+        std::cerr << "Cannot connect to the loopback server!" << std::endl;
+        return 1;
+    }
+
+    peer.run(daemon.jid(), count, window);
+
+    peer.latency().report(std::cout, "loopback", peer.seconds());
+    if (peer.busy() || peer.errors() || peer.lost())
+        std::cout << "busy " << peer.busy() << ", errors " << peer.errors()
+                  << ", lost " << peer.lost() << std::endl;
+
+    peer.stop();
+    daemon.stop();
+    return 0;
+}
+
+// End of File
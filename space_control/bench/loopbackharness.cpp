@@ -0,0 +1,233 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "loopbackharness.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+using namespace xmppsc;
+
+const char BENCH_COMMAND[] = "bench.read";
+const char BENCH_RESULT[] = "bench.result";
+
+namespace {
+
+// Answers BENCH_COMMAND like a register read.
+class BenchMethod : public CommandMethod {
+public:
+    BenchMethod() : CommandMethod(BENCH_COMMAND) {}
+
+    virtual ~BenchMethod() throw() {}
+
+    virtual void handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc, SpaceCommandSink* sink) {
+        SpaceCommand::space_command_params par;
+        par["device"] = sc.param("device");
+        par["data"] = "00";
+        sink->sendSpaceCommand(SpaceCommand(BENCH_RESULT, std::move(par)));
+    }
+};
+
+// Passes all responses to the peer.
+class ResponseMethod : public CommandMethod {
+public:
+    ResponseMethod(BenchPeer* peer, const t_command_set& commands)
+        : CommandMethod(commands), m_peer(peer) {}
+
+    virtual ~ResponseMethod() throw() {}
+
+    virtual void handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc, SpaceCommandSink* sink) {
+        m_peer->response(sink->threadId(), sc.cmd());
+    }
+
+private:
+    BenchPeer* m_peer;
+};
+
+} // anonymous namespace
+
+
+LoopbackClient::LoopbackClient(LoopbackServer* server, const std::string& jid)
+    : m_client(new gloox::Client(gloox::JID(jid), "bench")), m_con(0), m_stop(false) {
+    // the loopback server does not offer TLS
+    m_client->setTls(gloox::TLSDisabled);
+    m_con = server->attach(m_client);
+}
+
+LoopbackClient::~LoopbackClient() {
+    stop();
+    delete m_client;
+}
+
+bool LoopbackClient::start() {
+    m_stop = false;
+    m_thread = std::thread(&LoopbackClient::run, this);
+
+    for (int i = 0; i < 500 && !m_con->bound(); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    return m_con->bound();
+}
+
+void LoopbackClient::stop() {
+    m_stop = true;
+    if (m_thread.joinable()) {
+        m_thread.join();
+        m_client->disconnect();
+    }
+}
+
+const gloox::JID& LoopbackClient::jid() const throw() {
+    return m_con->bound();
+}
+
+void LoopbackClient::run() {
+    if (!m_client->connect(false))
+        return;
+
+    // wake up now and then to see the stop flag
+    while (!m_stop && m_client->recv(100 * 1000) == gloox::ConnNoError)
+        ;
+}
+
+
+BenchDaemon::BenchDaemon(LoopbackServer* server, unsigned int workers)
+    : LoopbackClient(server, "spacecontrol@loopback/daemon"), m_scc(0), m_pool(0) {
+    m_mh.add_method(new BenchMethod());
+    m_mh.freeze();
+
+    m_scc = new SpaceControlClient(m_client, &m_mh, &m_ser, 0);
+
+    if (workers) {
+        m_pool = new WorkerPool(workers);
+        m_scc->set_worker_pool(m_pool);
+    }
+}
+
+BenchDaemon::~BenchDaemon() {
+    stop();
+
+    if (m_pool) {
+        m_pool->stop();
+        delete m_pool;
+    }
+    delete m_scc;
+}
+
+SpaceControlClient* BenchDaemon::scc() throw() {
+    return m_scc;
+}
+
+
+BenchPeer::BenchPeer(LoopbackServer* server, const std::string& name)
+    : LoopbackClient(server, name + "@loopback/bench"), m_scc(0),
+      m_seconds(0), m_busy(0), m_errors(0), m_lost(0) {
+    CommandMethod::t_command_set commands;
+    commands.insert(BENCH_RESULT);
+    commands.insert("busy");
+    commands.insert("denied");
+    commands.insert("exception");
+    m_mh.add_method(new ResponseMethod(this, commands));
+    m_mh.freeze();
+
+    m_scc = new SpaceControlClient(m_client, &m_mh, &m_ser, 0);
+}
+
+BenchPeer::~BenchPeer() {
+    stop();
+    delete m_scc;
+}
+
+void BenchPeer::run(const gloox::JID& to, unsigned long count, unsigned int window,
+                    Latency::clock::duration interval) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.clear();
+        m_latency.clear();
+        m_busy = m_errors = m_lost = 0;
+    }
+
+    const Latency::clock::time_point begin = Latency::clock::now();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (unsigned long seq = 0; seq < count; seq++) {
+        if (interval > Latency::clock::duration::zero()) {
+            lock.unlock();
+            std::this_thread::sleep_until(begin + interval * seq);
+            lock.lock();
+        }
+
+        // give up if the daemon does not answer any more
+        if (!m_cond.wait_for(lock, std::chrono::seconds(1),
+                             [this, window] { return m_pending.size() < std::max(window, 1u); }))
+            break;
+
+        m_pending[seq] = Latency::clock::now();
+        lock.unlock();
+
+        SpaceCommand::space_command_params par;
+        par["device"] = "0x20";
+        std::unique_ptr<SpaceCommandSink> sink(m_scc->create_sink(to, std::to_string(seq)));
+        sink->sendSpaceCommand(SpaceCommand(BENCH_COMMAND, std::move(par)));
+
+        lock.lock();
+    }
+
+    m_cond.wait_for(lock, std::chrono::seconds(1), [this] { return m_pending.empty(); });
+
+    m_lost = m_pending.size();
+    m_seconds = std::chrono::duration<double>(Latency::clock::now() - begin).count();
+}
+
+void BenchPeer::response(const std::string& threadId, const std::string& cmd) {
+    const Latency::clock::time_point now = Latency::clock::now();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    pending_map::iterator it = m_pending.find(std::strtoul(threadId.c_str(), 0, 10));
+    if (threadId.empty() || it == m_pending.end())
+        return;
+
+    if (cmd == BENCH_RESULT)
+        m_latency.add(now - it->second);
+    else if (cmd == "busy")
+        m_busy++;
+    else
+        m_errors++;
+
+    m_pending.erase(it);
+    m_cond.notify_one();
+}
+
+Latency& BenchPeer::latency() throw() {
+    return m_latency;
+}
+
+double BenchPeer::seconds() const throw() {
+    return m_seconds;
+}
+
+unsigned long BenchPeer::busy() const throw() {
+    return m_busy;
+}
+
+unsigned long BenchPeer::errors() const throw() {
+    return m_errors;
+}
+
+unsigned long BenchPeer::lost() const throw() {
+    return m_lost;
+}
+
+// End of File
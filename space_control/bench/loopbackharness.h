@@ -0,0 +1,169 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOPBACKHARNESS_H__
+#define LOOPBACKHARNESS_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <gloox/client.h>
+#include <gloox/jid.h>
+
+#include "loopbackserver.h"
+#include "methodhandler.h"
+#include "spacecontrolclient.h"
+#include "workerpool.h"
+
+#include "bench.h"
+
+//! Command sent by the benchmark peers.
+extern const char BENCH_COMMAND[];
+
+//! Response of the benchmark daemon.
+extern const char BENCH_RESULT[];
+
+//! A gloox client attached to a loopback server, driven by its own thread.
+class LoopbackClient {
+public:
+    //! Create the client.
+    /*!
+     * \param server The server; ownership is not transferred.
+     * \param jid    The JID of the client.
+     */
+    LoopbackClient(xmppsc::LoopbackServer* server, const std::string& jid);
+
+    virtual ~LoopbackClient();
+
+    //! Connect and wait for the resource binding.
+    /*!
+     * \returns false if the client has not been bound within a few seconds.
+     */
+    bool start();
+
+    //! Stop the thread and disconnect.
+    void stop();
+
+    //! Get the bound JID.
+    const gloox::JID& jid() const throw();
+
+protected:
+    gloox::Client* m_client;
+
+private:
+    xmppsc::LoopbackConnection* m_con;
+    std::thread m_thread;
+    std::atomic<bool> m_stop;
+
+    void run();
+
+    LoopbackClient(const LoopbackClient& other);
+    LoopbackClient& operator=(const LoopbackClient& other);
+};
+
+
+//! Space control client answering BENCH_COMMAND, like the i3c client daemon.
+class BenchDaemon : public LoopbackClient {
+public:
+    //! Create the daemon.
+    /*!
+     * \param server  The server; ownership is not transferred.
+     * \param workers Worker threads for the commands, 0 to handle them on the client thread.
+     */
+    BenchDaemon(xmppsc::LoopbackServer* server, unsigned int workers = 0);
+
+    virtual ~BenchDaemon();
+
+    //! Get the space control client, e.g. to set a policy.
+    xmppsc::SpaceControlClient* scc() throw();
+
+private:
+    xmppsc::TextSpaceCommandSerializer m_ser;
+    xmppsc::MethodHandler m_mh;
+    xmppsc::SpaceControlClient* m_scc;
+    xmppsc::WorkerPool* m_pool;
+};
+
+
+//! Peer sending BENCH_COMMAND and waiting for the responses, like i3c_cli.
+class BenchPeer : public LoopbackClient {
+public:
+    //! Create the peer.
+    /*!
+     * \param server The server; ownership is not transferred.
+     * \param name   The node of the JID.
+     */
+    BenchPeer(xmppsc::LoopbackServer* server, const std::string& name);
+
+    virtual ~BenchPeer();
+
+    //! Send commands and wait for the responses.
+    /*!
+     * The sequence number of a command is sent as thread ID, which the
+     * responses carry back. The run ends when all commands have been
+     * answered, or when no response has arrived for a second, e.g. for
+     * a blocked peer.
+     *
+     * \param to     The receiving daemon.
+     * \param count  The number of commands.
+     * \param window The maximal number of unanswered commands.
+     * \param interval The time between two commands, zero to send as fast as the window allows.
+     */
+    void run(const gloox::JID& to, unsigned long count, unsigned int window,
+             Latency::clock::duration interval = Latency::clock::duration::zero());
+
+    //! Get the latencies of the results of the last run.
+    Latency& latency() throw();
+
+    //! Get the duration of the last run in seconds.
+    double seconds() const throw();
+
+    //! Get the number of "busy" responses of the last run.
+    unsigned long busy() const throw();
+
+    //! Get the number of other error responses of the last run.
+    unsigned long errors() const throw();
+
+    //! Get the number of commands without response in the last run.
+    unsigned long lost() const throw();
+
+    //! Record a response; called on the client thread.
+    void response(const std::string& threadId, const std::string& cmd);
+
+private:
+    typedef std::map<unsigned long, Latency::clock::time_point> pending_map;
+
+    xmppsc::TextSpaceCommandSerializer m_ser;
+    xmppsc::MethodHandler m_mh;
+    xmppsc::SpaceControlClient* m_scc;
+
+    //! guards the members below
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    //! send times of unanswered commands by sequence number
+    pending_map m_pending;
+    Latency m_latency;
+    double m_seconds;
+    unsigned long m_busy;
+    unsigned long m_errors;
+    unsigned long m_lost;
+};
+
+#endif // LOOPBACKHARNESS_H__
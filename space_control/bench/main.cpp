@@ -0,0 +1,59 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+struct Benchmark {
+    const char* name;
+    int (*run)(int argc, char** argv);
+    const char* usage;
+};
+
+const Benchmark benchmarks[] = {
+    { "loopback", bench_loopback, "[count] [window] [workers]" },
+    { "fairness", bench_fairness, "[count] [rate] [workers]" },
+    { "lookup", bench_lookup, "[count]" },
+    { "parser", bench_parser, "[count]" },
+    { "socket", bench_socket, "[count] [busy_poll]" },
+};
+
+void usage() {
+    std::cout << "Usage:" << std::endl;
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+        std::cout << "\txmppsc-bench " << benchmarks[i].name << " " << benchmarks[i].usage << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        usage();
+        return -1;
+    }
+
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+        if (std::strcmp(argv[1], benchmarks[i].name) == 0)
+            return benchmarks[i].run(argc - 2, argv + 2);
+
+    usage();
+    return -1;
+}
+
+// End of File
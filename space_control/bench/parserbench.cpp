@@ -0,0 +1,82 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+
+#include "binaryserializer.h"
+#include "spacecommand.h"
+
+#include <chrono>
+#include <iostream>
+
+using namespace xmppsc;
+
+namespace {
+
+typedef std::chrono::steady_clock clock;
+
+double since(clock::time_point begin) {
+    return std::chrono::duration<double>(clock::now() - begin).count();
+}
+
+// parse, serialize and peek a body count times
+void run(const std::string& label, SpaceCommandSerializer& ser, const SpaceCommand& sc,
+         unsigned long count) {
+    const std::string body(ser.to_body(sc, "xmpp:tux@n39.eu/psi:1"));
+    // keeps the loops from being optimized away
+    volatile size_t sink = 0;
+
+    clock::time_point begin = clock::now();
+    for (unsigned long i = 0; i < count; i++)
+        sink += ser.to_command(body).second.params().size();
+    report_rate(std::cout, label + " to_command", count, since(begin));
+
+    begin = clock::now();
+    for (unsigned long i = 0; i < count; i++)
+        sink += ser.to_body(sc, "xmpp:tux@n39.eu/psi:1").size();
+    report_rate(std::cout, label + " to_body", count, since(begin));
+
+    std::string cmd;
+    std::string threadId;
+    begin = clock::now();
+    for (unsigned long i = 0; i < count; i++)
+        sink += ser.peek(body, cmd, threadId) ? cmd.size() : 0;
+    report_rate(std::cout, label + " peek", count, since(begin));
+}
+
+} // anonymous namespace
+
+// xmppsc-bench parser [count]
+//
+// A typical request, an I2C register write, through both serializers.
+int bench_parser(int argc, char** argv) {
+    const unsigned long count = bench_arg(argc, argv, 0, 1000000);
+
+    SpaceCommand::space_command_params par;
+    par["device"] = "0x20";
+    par["register"] = "0x95";
+    par["data"] = "0x1234";
+    const SpaceCommand sc("i2c.write16", par);
+
+    TextSpaceCommandSerializer text;
+    run("text", text, sc, count);
+
+    BinarySpaceCommandSerializer binary;
+    run("binary", binary, sc, count);
+
+    return 0;
+}
+
+// End of File
@@ -0,0 +1,208 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+
+#include "socketprofile.h"
+#include "spacecontrolclient.h"
+
+#include <gloox/connectiondatahandler.h>
+#include <gloox/logsink.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace xmppsc;
+
+namespace {
+
+const char STANZA_END[] = "</message>";
+
+// number of stanzas in a text
+size_t count_stanzas(const std::string& text) {
+    size_t n = 0;
+    for (size_t pos = text.find(STANZA_END); pos != std::string::npos;
+            pos = text.find(STANZA_END, pos + 1))
+        n++;
+    return n;
+}
+
+std::string stanza(const std::string& body) {
+    return "<message to='ctl@n39.eu/daemon'><body>" + body + "</body>" + STANZA_END;
+}
+
+// Stand-in for the XMPP server: answers each pair of stanzas with one
+// stanza. The socket keeps the system defaults, i.e. delayed ACKs.
+class StandInServer {
+public:
+    StandInServer() : m_listen(-1), m_port(0) {}
+
+    ~StandInServer() {
+        // wakes the thread if nobody has connected
+        if (m_listen >= 0)
+            shutdown(m_listen, SHUT_RDWR);
+        if (m_thread.joinable())
+            m_thread.join();
+        if (m_listen >= 0)
+            close(m_listen);
+    }
+
+    //! Listen on a free port of the loopback interface.
+    bool start() {
+        m_listen = socket(AF_INET, SOCK_STREAM, 0);
+        if (m_listen < 0)
+            return false;
+
+        sockaddr_in addr = sockaddr_in();
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (bind(m_listen, reinterpret_cast<sockaddr*>(&addr), len) != 0 || listen(m_listen, 1) != 0 ||
+                getsockname(m_listen, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+            return false;
+
+        m_port = ntohs(addr.sin_port);
+        m_thread = std::thread(&StandInServer::run, this);
+        return true;
+    }
+
+    int port() const throw() {
+        return m_port;
+    }
+
+private:
+    int m_listen;
+    int m_port;
+    std::thread m_thread;
+
+    // serve a single connection until it is closed
+    void run() {
+        const int fd = accept(m_listen, 0, 0);
+        if (fd < 0)
+            return;
+
+        const std::string response(stanza("1 response\n0x01\n"));
+        std::string in;
+        char buf[4096];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            in.append(buf, n);
+            if (count_stanzas(in) >= 2) {
+                in.clear();
+                if (write(fd, response.data(), response.size()) < 0)
+                    break;
+            }
+        }
+
+        close(fd);
+    }
+};
+
+// collects the received data of a connection
+class Receiver : public gloox::ConnectionDataHandler {
+public:
+    virtual void handleReceivedData(const gloox::ConnectionBase*, const std::string& data) {
+        received += data;
+    }
+
+    virtual void handleConnect(const gloox::ConnectionBase*) {}
+
+    virtual void handleDisconnect(const gloox::ConnectionBase*, gloox::ConnectionError) {}
+
+    std::string received;
+};
+
+// Each round trip sends two stanzas in separate writes, like a command
+// followed by a keepalive ping, and waits for the response.
+bool run(const std::string& label, const SocketProfile& profile, bool corked, unsigned long count) {
+    StandInServer server;
+    if (!server.start()) {
+        std::cerr << "Could not start the stand-in server!" << std::endl;
+        return false;
+    }
+
+    gloox::LogSink log;
+    Receiver receiver;
+    EcoConnectionTCPClient con(&receiver, log, "127.0.0.1", server.port(), profile);
+    if (con.connect() != gloox::ConnNoError) {
+        std::cerr << "Could not connect to the stand-in server!" << std::endl;
+        return false;
+    }
+
+    const std::string command(stanza("i2c.write8\n1\n1 device\n0x20\n1 data\n0x01\n"));
+    const std::string ping(stanza("ping\n2\n"));
+
+    Latency latency;
+    const Latency::clock::time_point begin = Latency::clock::now();
+    for (unsigned long i = 0; i < count; i++) {
+        const Latency::clock::time_point sent = Latency::clock::now();
+        if (corked)
+            con.cork();
+        con.send(command);
+        con.send(ping);
+        if (corked)
+            con.uncork();
+
+        while (count_stanzas(receiver.received) == 0)
+            if (con.recv(1000) != gloox::ConnNoError) {
+                std::cerr << label << ": connection lost!" << std::endl;
+                return false;
+            }
+        receiver.received.clear();
+
+        latency.add(Latency::clock::now() - sent);
+    }
+
+    latency.report(std::cout, label,
+                   std::chrono::duration<double>(Latency::clock::now() - begin).count());
+    con.disconnect();
+    return true;
+}
+
+} // anonymous namespace
+
+// xmppsc-bench socket [count] [busy_poll]
+//
+// Round trips to a stand-in server on the loopback interface with the
+// system defaults, with the defaults and corked writes, and with the low
+// latency socket profile. Without TCP_NODELAY the second write waits for
+// the delayed ACK of the first. The latency profile optionally polls for
+// busy_poll microseconds.
+int bench_socket(int argc, char** argv) {
+    const unsigned long count = bench_arg(argc, argv, 0, 200);
+
+    SocketProfile system;
+    system.nodelay = false;
+    system.quickack = false;
+
+    SocketProfile latency;
+    latency.busy_poll = static_cast<int>(bench_arg(argc, argv, 1, 0));
+
+    if (!run("system defaults", system, false, count) ||
+            !run("system defaults, corked", system, true, count) ||
+            !run("latency profile", latency, false, count))
+        return 1;
+
+    return 0;
+}
+
+// End of File
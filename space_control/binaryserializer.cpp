@@ -0,0 +1,264 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "binaryserializer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace {
+
+const char b64_alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+//! Reverse base64 table, 0xff marks invalid characters
+struct B64Table {
+    unsigned char v[256];
+
+    B64Table() {
+        memset(v, 0xff, sizeof(v));
+        for (int i = 0; i < 64; i++)
+            v[static_cast<unsigned char>(b64_alphabet[i])] = i;
+    }
+};
+
+const B64Table b64_table;
+
+//! Size of a value as LEB128 varint
+inline size_t varint_size(size_t v) {
+    size_t s = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        s++;
+    }
+    return s;
+}
+
+inline void put_varint(std::string& out, size_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+inline void put_field(std::string& out, const std::string& s) {
+    put_varint(out, s.size());
+    out.append(s);
+}
+
+//! Append the base64 encoding of [p, p+n) to out
+void b64_encode(std::string& out, const unsigned char* p, size_t n) {
+    out.reserve(out.size() + (n + 2) / 3 * 4);
+
+    size_t i = 0;
+    for (; i + 3 <= n; i += 3) {
+        const unsigned int v = (p[i] << 16) | (p[i+1] << 8) | p[i+2];
+        out.push_back(b64_alphabet[(v >> 18) & 0x3f]);
+        out.push_back(b64_alphabet[(v >> 12) & 0x3f]);
+        out.push_back(b64_alphabet[(v >> 6) & 0x3f]);
+        out.push_back(b64_alphabet[v & 0x3f]);
+    }
+
+    if (i < n) {
+        unsigned int v = p[i] << 16;
+        if (i + 1 < n)
+            v |= p[i+1] << 8;
+        out.push_back(b64_alphabet[(v >> 18) & 0x3f]);
+        out.push_back(b64_alphabet[(v >> 12) & 0x3f]);
+        out.push_back(i + 1 < n ? b64_alphabet[(v >> 6) & 0x3f] : '=');
+        out.push_back('=');
+    }
+}
+
+//! Decode base64 from [p, p+n) into out
+/*!
+ * \returns false if the input is not valid base64.
+ */
+bool b64_decode(std::string& out, const char* p, size_t n) {
+    // strip padding
+    while (n && p[n-1] == '=')
+        n--;
+    if (n % 4 == 1)
+        return false;
+
+    out.reserve(n / 4 * 3 + 2);
+
+    unsigned int acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < n; i++) {
+        const unsigned char v = b64_table.v[static_cast<unsigned char>(p[i])];
+        if (v == 0xff)
+            return false;
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<char>((acc >> bits) & 0xff));
+        }
+    }
+
+    return true;
+}
+
+//! Reader for the decoded payload
+class Reader {
+public:
+    Reader(const std::string& payload, const std::string& body)
+        : m_pos(payload.data()), m_end(payload.data() + payload.size()), m_body(body) {}
+
+    size_t varint() {
+        size_t v = 0;
+        for (unsigned int shift = 0; shift < sizeof(size_t) * 8; shift += 7) {
+            if (m_pos == m_end)
+                fail("Truncated length field.");
+            const unsigned char c = *m_pos++;
+            v |= static_cast<size_t>(c & 0x7f) << shift;
+            if (!(c & 0x80))
+                return v;
+        }
+        fail("Length field overflow.");
+        return 0;
+    }
+
+    void field(std::string& out) {
+        const size_t len = varint();
+        if (len > static_cast<size_t>(m_end - m_pos))
+            fail("Field exceeds the message size.");
+        out.assign(m_pos, len);
+        m_pos += len;
+    }
+
+    bool done() const {
+        return m_pos == m_end;
+    }
+
+    void fail(const char* what) const {
+        throw xmppsc::SpaceCommandFormatException(what, m_body, 0);
+    }
+
+private:
+    const char* m_pos;
+    const char* const m_end;
+    const std::string& m_body;
+};
+
+} // anonymous namespace
+
+namespace xmppsc {
+
+const char BinarySpaceCommandSerializer::MARKER[] = "SCB1:";
+
+BinarySpaceCommandSerializer::BinarySpaceCommandSerializer() {}
+
+BinarySpaceCommandSerializer::~BinarySpaceCommandSerializer() {}
+
+std::string BinarySpaceCommandSerializer::to_body(const SpaceCommand& cmd, const std::string& threadId) const {
+    const SpaceCommand::space_command_params& params = cmd.params();
+    SpaceCommand::space_command_params::const_iterator iter;
+
+    // assemble the payload
+    size_t size = varint_size(cmd.cmd().size()) + cmd.cmd().size()
+                  + varint_size(threadId.size()) + threadId.size()
+                  + varint_size(params.size());
+    for (iter = params.begin(); iter != params.end(); ++iter)
+        size += varint_size(iter->first.size()) + iter->first.size()
+                + varint_size(iter->second.size()) + iter->second.size();
+
+    std::string payload;
+    payload.reserve(size);
+    put_field(payload, cmd.cmd());
+    put_field(payload, threadId);
+    put_varint(payload, params.size());
+    for (iter = params.begin(); iter != params.end(); ++iter) {
+        put_field(payload, iter->first);
+        put_field(payload, iter->second);
+    }
+
+    // wrap for the XMPP body
+    std::string body(MARKER);
+    b64_encode(body, reinterpret_cast<const unsigned char*>(payload.data()), payload.size());
+
+    return body;
+}
+
+BinarySpaceCommandSerializer::Incoming BinarySpaceCommandSerializer::to_command(const std::string& body)
+throw(SpaceCommandFormatException) {
+    if (!recognizes(body))
+        throw SpaceCommandFormatException("Missing binary message marker.", body, 0);
+
+    const size_t skip = sizeof(MARKER) - 1;
+    std::string payload;
+    if (!b64_decode(payload, body.data() + skip, body.size() - skip))
+        throw SpaceCommandFormatException("Invalid base64 encoding.", body, 0);
+
+    Reader r(payload, body);
+
+    std::string command;
+    std::string threadId;
+    r.field(command);
+    r.field(threadId);
+
+    SpaceCommand::space_command_params params;
+    size_t count = r.varint();
+    if (count > MAX_PARAMS)
+        r.fail("Too many parameters.");
+    while (count--) {
+        std::string key;
+        r.field(key);
+        r.field(params[key]);
+    }
+
+    if (!r.done())
+        r.fail("Trailing data after the last parameter.");
+
+    return Incoming(std::move(threadId), SpaceCommand(std::move(command), std::move(params)));
+}
+
+bool BinarySpaceCommandSerializer::recognizes(const std::string& body) const throw() {
+    return !body.compare(0, sizeof(MARKER) - 1, MARKER);
+}
+
+bool BinarySpaceCommandSerializer::peek(const std::string& body, std::string& cmd, std::string& threadId) const throw() {
+    if (!recognizes(body))
+        return false;
+
+    // 4 base64 characters per 3 payload bytes
+    const size_t skip = sizeof(MARKER) - 1;
+    const size_t len = std::min(body.size() - skip, PEEK_LIMIT / 3 * 4);
+
+    try {
+        std::string head;
+        if (!b64_decode(head, body.data() + skip, len))
+            return false;
+
+        Reader r(head, body);
+        r.field(cmd);
+        r.field(threadId);
+    } catch (const SpaceCommandFormatException& scfe) {
+        // truncated by the limit or malformed
+        return false;
+    } catch (const std::bad_alloc& ba) {
+        return false;
+    }
+
+    return true;
+}
+
+} // namespace xmppsc
+
+// End of File
@@ -0,0 +1,63 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BINARYSERIALIZER_H__
+#define BINARYSERIALIZER_H__
+
+#include "spacecommand.h"
+
+namespace xmppsc {
+
+//! Serializer for compact binary messages
+/*!
+ * Intended for scripts and daemons that exchange commands at high rates.
+ * The command is encoded as a sequence of length-prefixed fields:
+ *
+ *   <len> command, <len> thread ID, <count>, count * (<len> key, <len> value)
+ *
+ * Lengths and the count are unsigned LEB128 varints. The result is base64
+ * encoded and prefixed with BinarySpaceCommandSerializer::MARKER, so it can
+ * travel as an XMPP message body and is recognized on reception.
+ */
+class BinarySpaceCommandSerializer : public SpaceCommandSerializer {
+public:
+    //! Prefix of every binary message body.
+    static const char MARKER[];
+
+    BinarySpaceCommandSerializer();
+
+    virtual ~BinarySpaceCommandSerializer();
+
+    virtual std::string to_body(const SpaceCommand& cmd, const std::string& threadId) const;
+
+    virtual Incoming to_command(const std::string& body)
+    throw(SpaceCommandFormatException);
+
+    //! Check for the binary marker.
+    virtual bool recognizes(const std::string& body) const throw();
+
+    //! Decode only the head of the payload.
+    /*!
+     * Fails if command and thread ID together exceed PEEK_LIMIT bytes.
+     */
+    virtual bool peek(const std::string& body, std::string& cmd, std::string& threadId) const throw();
+
+    //! Maximal number of payload bytes decoded by peek().
+    static const size_t PEEK_LIMIT = 384;
+};
+
+} // namespace xmppsc
+
+#endif // BINARYSERIALIZER_H__
@@ -0,0 +1,111 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "clientreactor.h"
+#include "loopbackserver.h"
+
+#include <gloox/connectiontcpbase.h>
+
+namespace xmppsc {
+
+ClientReactor::ClientReactor(EventLoop* loop, SpaceControlClient* scc)
+    : m_loop(loop), m_scc(scc), m_socket(-1), m_outbound_fd(-1), m_connections(0) {
+    const OutboundQueue* queue = m_scc->outbound_queue();
+    if (queue && m_loop->add_fd(queue->fd(), EPOLLIN, this))
+        m_outbound_fd = queue->fd();
+}
+
+ClientReactor::~ClientReactor() {
+    unwatch();
+    if (m_outbound_fd >= 0)
+        m_loop->remove_fd(m_outbound_fd);
+}
+
+bool ClientReactor::connect() {
+    gloox::Client* client = m_scc->client();
+
+    unwatch();
+    if (!client->connect(false))
+        return false;
+
+    // only TCP based and loopback connections expose a descriptor
+    int fd = -1;
+    if (gloox::ConnectionTCPBase* con = dynamic_cast<gloox::ConnectionTCPBase*>(client->connectionImpl()))
+        fd = con->socket();
+    else if (LoopbackConnection* con = dynamic_cast<LoopbackConnection*>(client->connectionImpl()))
+        fd = con->fd();
+
+    if (fd < 0 || !m_loop->add_fd(fd, EPOLLIN, this)) {
+        client->disconnect();
+        return false;
+    }
+
+    m_socket = fd;
+    m_last_receive = std::chrono::steady_clock::now();
+    m_connections++;
+    return true;
+}
+
+void ClientReactor::disconnect(gloox::ConnectionError reason) {
+    unwatch();
+    m_scc->client()->disconnect();
+
+    // gloox reports every disconnect() as ConnUserDisconnected
+    if (reason != gloox::ConnUserDisconnected)
+        m_scc->onDisconnect(reason);
+}
+
+bool ClientReactor::connected() const throw() {
+    return m_socket >= 0;
+}
+
+std::chrono::steady_clock::time_point ClientReactor::last_receive() const throw() {
+    return m_last_receive;
+}
+
+unsigned long ClientReactor::connections() const throw() {
+    return m_connections;
+}
+
+SpaceControlClient* ClientReactor::space_control() const throw() {
+    return m_scc;
+}
+
+void ClientReactor::handleFdEvent(int fd, unsigned int events) {
+    if (fd == m_socket) {
+        m_last_receive = std::chrono::steady_clock::now();
+
+        // data is available, so this does not block
+        const gloox::ConnectionError err = m_scc->client()->recv(0);
+
+        // the connection is closed, gloox has notified the client already
+        if (err != gloox::ConnNoError)
+            unwatch();
+    }
+
+    // send the responses queued by handlers on this thread or by workers
+    m_scc->flush_outbound();
+}
+
+void ClientReactor::unwatch() throw() {
+    if (m_socket >= 0) {
+        m_loop->remove_fd(m_socket);
+        m_socket = -1;
+    }
+}
+
+} // namespace xmppsc
+
+// End of File
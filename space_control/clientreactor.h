@@ -0,0 +1,84 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CLIENTREACTOR_H__
+#define CLIENTREACTOR_H__
+
+#include <chrono>
+
+#include "eventloop.h"
+#include "spacecontrolclient.h"
+
+namespace xmppsc {
+
+//! Drive the XMPP connection of a space control client from an event loop.
+/*!
+ * The reactor watches the connection socket and lets gloox read only
+ * when data has arrived, instead of polling with receive timeouts. The
+ * outbound queue of the client, if enabled, is flushed when responses
+ * are queued.
+ */
+class ClientReactor : public EventLoop::FdHandler {
+public:
+    //! Create the reactor.
+    /*!
+     * \param loop The event loop; ownership is not transferred.
+     * \param scc  The space control client; ownership is not transferred.
+     */
+    ClientReactor(EventLoop* loop, SpaceControlClient* scc);
+
+    virtual ~ClientReactor();
+
+    //! Connect the client and watch the connection.
+    /*!
+     * \returns false if the connection could not be established.
+     */
+    bool connect();
+
+    //! Stop watching and disconnect the client.
+    /*!
+     * \param reason The reason reported to the client. Anything but
+     *               ConnUserDisconnected leads to a reconnect.
+     */
+    void disconnect(gloox::ConnectionError reason = gloox::ConnUserDisconnected);
+
+    //! Check if the connection is watched.
+    bool connected() const throw();
+
+    //! Get the time data has been received last, or the time of connecting.
+    std::chrono::steady_clock::time_point last_receive() const throw();
+
+    //! Get the number of established connections.
+    unsigned long connections() const throw();
+
+    //! Get the space control client.
+    SpaceControlClient* space_control() const throw();
+
+    virtual void handleFdEvent(int fd, unsigned int events);
+
+private:
+    EventLoop* m_loop;
+    SpaceControlClient* m_scc;
+    int m_socket;
+    int m_outbound_fd;
+    std::chrono::steady_clock::time_point m_last_receive;
+    unsigned long m_connections;
+
+    void unwatch() throw();
+};
+
+}
+
+#endif // CLIENTREACTOR_H__
@@ -0,0 +1,74 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "commandrouter.h"
+#include "util.h"
+
+namespace xmppsc {
+
+uint32_t command_hash(const char* name, size_t len) throw() {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= static_cast<unsigned char>(name[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+
+CommandRouter::CommandRouter() : m_default(0) {}
+
+CommandRouter::~CommandRouter() {}
+
+void CommandRouter::add_namespace(const std::string& ns, SpaceControlHandler* hnd) throw(std::logic_error) {
+    m_namespaces.insert(ns, hnd);
+}
+
+void CommandRouter::set_default(SpaceControlHandler* hnd) {
+    m_default = hnd;
+}
+
+void CommandRouter::freeze() {
+    m_namespaces.freeze();
+}
+
+SpaceControlHandler* CommandRouter::route(const std::string& cmd) const throw() {
+    const void* dot = std::memchr(cmd.data(), '.', cmd.size());
+    if (dot) {
+        const size_t len = static_cast<const char*>(dot) - cmd.data();
+        SpaceControlHandler* hnd = m_namespaces.find(cmd.data(), len);
+        if (hnd)
+            return hnd;
+    }
+
+    return m_default;
+}
+
+void CommandRouter::handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc, SpaceCommandSink* sink) {
+    // freezing here would race with other workers
+    if (!m_namespaces.frozen())
+        throw std::logic_error("CommandRouter used before freeze()");
+
+    SpaceControlHandler* hnd = route(sc.cmd());
+
+    if (hnd)
+        hnd->handleSpaceCommand(peer, sc, sink);
+    else
+        send_unknown_command(sc.cmd(), sink);
+}
+
+} // namespace xmppsc
+
+// End of file
@@ -0,0 +1,208 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMMANDROUTER_H__
+#define COMMANDROUTER_H__
+
+#include "spacecontrolclient.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace xmppsc {
+
+//! Hash function for command names (FNV-1a).
+uint32_t command_hash(const char* name, size_t len) throw();
+
+
+//! Lookup table for command names that is frozen after setup.
+/*!
+ * Names are collected with insert() and the table is built once by
+ * freeze(). After that the table is read-only: a lookup costs one hash
+ * over the name and usually one string comparison, without allocation,
+ * and may be done from several threads.
+ *
+ * The table does not own the values.
+ */
+template<class T>
+class CommandTable {
+public:
+    CommandTable() : m_mask(0), m_frozen(false) {}
+
+    //! Add or replace an entry.
+    /*!
+     * \throws std::logic_error if the table has been frozen.
+     */
+    void insert(const std::string& name, T* value) throw(std::logic_error) {
+        if (m_frozen)
+            throw std::logic_error("Command table is frozen: " + name);
+
+        for (typename std::vector<entry>::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+            if (it->name == name) {
+                it->value = value;
+                return;
+            }
+
+        m_entries.push_back(entry(name, value));
+    }
+
+    //! Build the hash table; no entries can be added afterwards.
+    void freeze() {
+        if (m_frozen)
+            return;
+
+        // power of two with a load factor of at most 1/2
+        size_t size = 4;
+        while (size < 2 * m_entries.size())
+            size <<= 1;
+
+        m_slots.assign(size, slot());
+        m_mask = size - 1;
+
+        for (size_t i = 0; i < m_entries.size(); i++) {
+            entry& e = m_entries[i];
+            e.hash = command_hash(e.name.data(), e.name.size());
+
+            size_t pos = e.hash & m_mask;
+            while (m_slots[pos].index)
+                pos = (pos + 1) & m_mask;
+
+            m_slots[pos].hash = e.hash;
+            m_slots[pos].index = i + 1;
+        }
+
+        m_frozen = true;
+    }
+
+    //! Check if the table has been frozen.
+    bool frozen() const throw() {
+        return m_frozen;
+    }
+
+    //! Find an entry.
+    /*!
+     * The table must be frozen.
+     *
+     * \param name the name, need not be 0-terminated
+     * \param len  the length of the name
+     * \returns the value or 0 if there is no such entry.
+     */
+    T* find(const char* name, size_t len) const throw() {
+        if (!m_frozen)
+            return 0;
+
+        const uint32_t h = command_hash(name, len);
+        for (size_t pos = h & m_mask; m_slots[pos].index; pos = (pos + 1) & m_mask) {
+            const slot& s = m_slots[pos];
+            if (s.hash != h)
+                continue;
+
+            const entry& e = m_entries[s.index - 1];
+            if (e.name.size() == len && std::memcmp(e.name.data(), name, len) == 0)
+                return e.value;
+        }
+
+        return 0;
+    }
+
+    //! Find an entry.
+    T* find(const std::string& name) const throw() {
+        return find(name.data(), name.size());
+    }
+
+    //! Get the number of entries.
+    size_t size() const throw() {
+        return m_entries.size();
+    }
+
+private:
+    struct entry {
+        entry(const std::string& _name, T* _value) : name(_name), value(_value), hash(0) {}
+
+        std::string name;
+        T* value;
+        uint32_t hash;
+    };
+
+    struct slot {
+        slot() : hash(0), index(0) {}
+
+        uint32_t hash;
+        //! Entry index + 1, 0 for an empty slot
+        uint32_t index;
+    };
+
+    std::vector<entry> m_entries;
+    std::vector<slot> m_slots;
+    size_t m_mask;
+    bool m_frozen;
+};
+
+
+//! Route commands to handlers by their namespace.
+/*!
+ * Commands are grouped in namespaces by the part of the name before the
+ * first dot, e.g. "i2c" for "i2c.read8". The router passes each command to
+ * the handler registered for its namespace, usually a MethodHandler, or
+ * to the default handler if there is none.
+ *
+ * The router must be frozen after setup, before the first command is
+ * handled. Handlers are not owned by the router.
+ */
+class CommandRouter : public xmppsc::SpaceControlHandler {
+public:
+    CommandRouter();
+    virtual ~CommandRouter();
+
+    //! Add the handler for a namespace.
+    /*!
+     * \param ns  the namespace without the trailing dot
+     * \param hnd the handler
+     * \throws std::logic_error if the router has been frozen.
+     */
+    void add_namespace(const std::string& ns, SpaceControlHandler* hnd) throw(std::logic_error);
+
+    //! Set the handler for commands without a registered namespace.
+    void set_default(SpaceControlHandler* hnd);
+
+    //! Build the lookup tables; no namespaces can be added afterwards.
+    void freeze();
+
+    //! Find the handler for a command.
+    /*!
+     * \returns the handler or 0 if the command cannot be routed.
+     */
+    SpaceControlHandler* route(const std::string& cmd) const throw();
+
+    /**
+     * Pass the command to the handler of its namespace. Commands that
+     * cannot be routed are answered with the unknown command exception.
+     *
+     * \throws std::logic_error if the router has not been frozen.
+     */
+    virtual void handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc, SpaceCommandSink* sink);
+
+private:
+    CommandTable<SpaceControlHandler> m_namespaces;
+    SpaceControlHandler* m_default;
+};
+
+}
+
+#endif // COMMANDROUTER_H__
@@ -28,6 +28,16 @@
 using namespace xmppsc;
 
 
+namespace {
+
+void read_jids(const libconfig::Setting& s_jids, ListAccessFilter::jid_list& jids) {
+    for (int i = 0; i < s_jids.getLength(); i++)
+        jids.push_back(gloox::JID(s_jids[i]));
+}
+
+} // anonymous namespace
+
+
 ConfiguredClientFactoryException::ConfiguredClientFactoryException(std::string _what)
     : m_what(_what) {}
 
@@ -77,24 +87,272 @@ AccessFilter* ConfiguredClientFactory::newAccessFilter() throw(ConfiguredClientF
     if (!m_cfg)
         loadConfig();
 
-    ListAccessFilter* af = NULL;
+    // without any list, access is completely open
+    const bool has_access = m_cfg->exists("xmpp.access");
+    const bool has_acl = m_cfg->exists("xmpp.acl");
+    if (!has_access && !has_acl)
+        return NULL;
+
+    IndexedAccessFilter* af = NULL;
 
     try {
-        // load JID list from config
-        libconfig::Setting& s_access = m_cfg->lookup("xmpp.access");
+        if (has_access) {
+            // load JID list from config
+            IndexedAccessFilter::jid_list jidlist;
+            read_jids(m_cfg->lookup("xmpp.access"), jidlist);
+            af = new IndexedAccessFilter(jidlist);
+        } else
+            af = new IndexedAccessFilter();
+
+        if (has_acl) {
+            libconfig::Setting& s_acl = m_cfg->lookup("xmpp.acl");
+
+            for (int i = 0; i < s_acl.getLength(); i++) {
+                libconfig::Setting& s_rule = s_acl[i];
+
+                std::string commands;
+                if (!s_rule.lookupValue("commands", commands) || commands.empty())
+                    throw ConfiguredClientFactoryException("Rules in xmpp.acl need a command pattern!");
+
+                IndexedAccessFilter::jid_list jidlist;
+                if (s_rule.exists("jids"))
+                    read_jids(s_rule["jids"], jidlist);
+
+                af->add_rule(commands, jidlist);
+            }
+        }
+    } catch (const libconfig::SettingTypeException& stex) {
+        delete af;
+        throw ConfiguredClientFactoryException("Settings xmpp.access and xmpp.acl must contain lists of JIDs!");
+    } catch (const ConfiguredClientFactoryException& ccfe) {
+        delete af;
+        throw;
+    }
+
+    // compile the rules
+    af->freeze();
+    return af;
+}
+
+unsigned int ConfiguredClientFactory::workers() throw(ConfiguredClientFactoryException)
+{
+    // check config
+    if (!m_cfg)
+        loadConfig();
+
+    int workers = 0;
+    if (m_cfg->lookupValue("xmpp.workers", workers) && workers < 0)
+        throw ConfiguredClientFactoryException("Setting xmpp.workers must not be negative!");
+
+    return workers;
+}
+
+unsigned int ConfiguredClientFactory::worker_queue() throw(ConfiguredClientFactoryException)
+{
+    // check config
+    if (!m_cfg)
+        loadConfig();
+
+    int capacity = WorkerPool::DEFAULT_CAPACITY;
+    if (m_cfg->lookupValue("xmpp.worker_queue", capacity) && capacity < 0)
+        throw ConfiguredClientFactoryException("Setting xmpp.worker_queue must not be negative!");
+
+    return capacity;
+}
+
+unsigned int ConfiguredClientFactory::outbound_queue() throw(ConfiguredClientFactoryException)
+{
+    // check config
+    if (!m_cfg)
+        loadConfig();
+
+    int capacity = 0;
+    if (m_cfg->lookupValue("xmpp.outbound_queue", capacity) && capacity < 0)
+        throw ConfiguredClientFactoryException("Setting xmpp.outbound_queue must not be negative!");
 
-        // target list for found JIDs
-        ListAccessFilter::jid_list jidlist;
-	
-        for (int i = 0; i < s_access.getLength(); i++)
-           jidlist.push_back(gloox::JID(s_access[i]));
+    return capacity;
+}
+
+ReconnectScheduler* ConfiguredClientFactory::newReconnectScheduler() throw(ConfiguredClientFactoryException)
+{
+    // check config
+    if (!m_cfg)
+        loadConfig();
 
-        af = new ListAccessFilter(jidlist);
+    unsigned int initial = 1000;
+    unsigned int max = 60000;
+    m_cfg->lookupValue("xmpp.reconnect.initial", initial);
+    m_cfg->lookupValue("xmpp.reconnect.max", max);
+
+    ReconnectScheduler::server_list servers;
+    try {
+        libconfig::Setting& s_servers = m_cfg->lookup("xmpp.servers");
+
+        for (int i = 0; i < s_servers.getLength(); i++) {
+            const std::string address = s_servers[i];
+            ServerAddress srv;
+            if (!srv.parse(address))
+                throw ConfiguredClientFactoryException("Invalid server address: " + address);
+            servers.push_back(srv);
+        }
     } catch (const libconfig::SettingNotFoundException& snfex) {
-        // af is already null;
+        // use the server of the JID
+    } catch (const libconfig::SettingTypeException& stex) {
+        throw ConfiguredClientFactoryException("Setting xmpp.servers must be a list of strings!");
     }
 
-    return af;
+    ReconnectScheduler* rs = new ReconnectScheduler(initial, max);
+    rs->set_servers(servers);
+    return rs;
+}
+
+KeepAlive* ConfiguredClientFactory::newKeepAlive(EventLoop* loop, ClientReactor* reactor) throw(ConfiguredClientFactoryException)
+{
+    // check config
+    if (!m_cfg)
+        loadConfig();
+
+    if (!m_cfg->exists("xmpp.keepalive"))
+        return 0;
+
+    // in seconds
+    unsigned int interval = 60;
+    std::string mode("ping");
+    m_cfg->lookupValue("xmpp.keepalive.interval", interval);
+    m_cfg->lookupValue("xmpp.keepalive.mode", mode);
+
+    // without a timeout a dead connection would never be detected
+    unsigned int timeout = 2 * interval;
+    m_cfg->lookupValue("xmpp.keepalive.timeout", timeout);
+
+    if (mode != "ping" && mode != "whitespace")
+        throw ConfiguredClientFactoryException("Setting xmpp.keepalive.mode must be \"ping\" or \"whitespace\"!");
+    if (!interval)
+        throw ConfiguredClientFactoryException("Setting xmpp.keepalive.interval must not be 0!");
+
+    return new KeepAlive(loop, reactor, interval * 1000, timeout * 1000,
+                         mode == "ping" ? KeepAlive::XMPP_PING : KeepAlive::WHITESPACE);
+}
+
+
+SocketProfile ConfiguredClientFactory::socketProfile() throw(ConfiguredClientFactoryException)
+{
+    // check config
+    if (!m_cfg)
+        loadConfig();
+
+    SocketProfile profile;
+    if (!m_cfg->exists("xmpp.socket"))
+        return profile;
+
+    m_cfg->lookupValue("xmpp.socket.nodelay", profile.nodelay);
+    m_cfg->lookupValue("xmpp.socket.quickack", profile.quickack);
+    m_cfg->lookupValue("xmpp.socket.keepalive.idle", profile.keepalive_idle);
+    m_cfg->lookupValue("xmpp.socket.keepalive.interval", profile.keepalive_interval);
+    m_cfg->lookupValue("xmpp.socket.keepalive.count", profile.keepalive_count);
+    m_cfg->lookupValue("xmpp.socket.sndbuf", profile.sndbuf);
+    m_cfg->lookupValue("xmpp.socket.rcvbuf", profile.rcvbuf);
+    m_cfg->lookupValue("xmpp.socket.busy_poll", profile.busy_poll);
+
+    if (profile.keepalive_idle < 0 || profile.keepalive_interval < 0 || profile.keepalive_count < 0)
+        throw ConfiguredClientFactoryException("Settings in xmpp.socket.keepalive must not be negative!");
+    if (profile.sndbuf < 0 || profile.rcvbuf < 0 || profile.busy_poll < 0)
+        throw ConfiguredClientFactoryException("Settings in xmpp.socket must not be negative!");
+
+    return profile;
+}
+
+
+size_t ConfiguredClientFactory::maxBody() throw(ConfiguredClientFactoryException)
+{
+    // check config
+    if (!m_cfg)
+        loadConfig();
+
+    int max = SpaceControlClient::DEFAULT_MAX_BODY;
+    if (m_cfg->lookupValue("xmpp.max_body", max) && max < 0)
+        throw ConfiguredClientFactoryException("Setting xmpp.max_body must not be negative!");
+
+    return max;
+}
+
+unsigned int ConfiguredClientFactory::errorRate() throw(ConfiguredClientFactoryException)
+{
+    // check config
+    if (!m_cfg)
+        loadConfig();
+
+    int rate = SpaceControlClient::DEFAULT_ERROR_RATE;
+    if (m_cfg->lookupValue("xmpp.error_rate", rate) && rate < 0)
+        throw ConfiguredClientFactoryException("Setting xmpp.error_rate must not be negative!");
+
+    return rate;
+}
+
+RateLimiter* ConfiguredClientFactory::newRateLimiter() throw(ConfiguredClientFactoryException)
+{
+    // check config
+    if (!m_cfg)
+        loadConfig();
+
+    if (!m_cfg->exists("xmpp.ratelimit"))
+        return 0;
+
+    // commands per second, bursts default to twice the rate
+    int rate = 0;
+    m_cfg->lookupValue("xmpp.ratelimit.rate", rate);
+    int burst = 2 * rate;
+    m_cfg->lookupValue("xmpp.ratelimit.burst", burst);
+    if (rate < 0 || burst < 0)
+        throw ConfiguredClientFactoryException("Settings xmpp.ratelimit.rate and burst must not be negative!");
+
+    // blocking, times in seconds
+    int strikes = 0;
+    int window = 10;
+    int time = 60;
+    m_cfg->lookupValue("xmpp.ratelimit.block.strikes", strikes);
+    m_cfg->lookupValue("xmpp.ratelimit.block.window", window);
+    m_cfg->lookupValue("xmpp.ratelimit.block.time", time);
+    if (strikes < 0 || window < 0 || time < 0)
+        throw ConfiguredClientFactoryException("Settings in xmpp.ratelimit.block must not be negative!");
+
+    RateLimiter* limiter = new RateLimiter(rate, burst);
+    limiter->set_blocking(strikes, window * 1000, time * 1000);
+
+    try {
+        libconfig::Setting& s_ns = m_cfg->lookup("xmpp.ratelimit.namespaces");
+
+        for (int i = 0; i < s_ns.getLength(); i++) {
+            libconfig::Setting& s_limit = s_ns[i];
+
+            std::string name;
+            int ns_rate = 0;
+            if (!s_limit.lookupValue("name", name) || !s_limit.lookupValue("rate", ns_rate) || ns_rate <= 0)
+                throw ConfiguredClientFactoryException("Limits in xmpp.ratelimit.namespaces need a name and a positive rate!");
+            int ns_burst = 2 * ns_rate;
+            s_limit.lookupValue("burst", ns_burst);
+
+            limiter->set_namespace_limit(name, ns_rate, ns_burst);
+        }
+    } catch (const libconfig::SettingNotFoundException& snfex) {
+        // no namespace limits
+    } catch (const ConfiguredClientFactoryException& ccfe) {
+        delete limiter;
+        throw;
+    }
+
+    return limiter;
+}
+
+std::string ConfiguredClientFactory::localSocket() throw(ConfiguredClientFactoryException)
+{
+    // check config
+    if (!m_cfg)
+        loadConfig();
+
+    std::string path;
+    m_cfg->lookupValue("xmpp.local_socket", path);
+    return path;
 }
 
 
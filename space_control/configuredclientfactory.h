@@ -19,6 +19,12 @@
 #define CONFIGUREDCLIENTFACTORY_H__
 
 #include "accessfilter.h"
+#include "indexedaccessfilter.h"
+#include "reconnectscheduler.h"
+#include "keepalive.h"
+#include "socketprofile.h"
+#include "ratelimiter.h"
+#include "workerpool.h"
 
 #include <exception>
 
@@ -89,8 +95,91 @@ public:
     gloox::Client* newClient(const char* _resource = 0) throw(ConfiguredClientFactoryException);
     
     //! Create a new access filter from the configuration.
+    /*!
+     * The JIDs in xmpp.access may use the client, the rules in xmpp.acl
+     * restrict commands to further JIDs.
+     *
+     * \returns the access filter or 0 if neither is set, i.e. access is open.
+     * \throws ConfiguredClientFactoryException if a setting is invalid.
+     */
     AccessFilter* newAccessFilter() throw(ConfiguredClientFactoryException);
 
+    //! Get the number of worker threads for command handling.
+    /*!
+     * \returns the value of xmpp.workers or 0 if not set, i.e. commands
+     *          are handled on the connection thread.
+     */
+    unsigned int workers() throw(ConfiguredClientFactoryException);
+
+    //! Get the number of commands queued per worker thread.
+    /*!
+     * \returns the value of xmpp.worker_queue or WorkerPool::DEFAULT_CAPACITY
+     *          if not set; 0 means no limit.
+     */
+    unsigned int worker_queue() throw(ConfiguredClientFactoryException);
+
+    //! Get the capacity of the outbound queue.
+    /*!
+     * \returns the value of xmpp.outbound_queue or 0 if not set, i.e.
+     *          responses are sent directly by the handlers.
+     */
+    unsigned int outbound_queue() throw(ConfiguredClientFactoryException);
+
+    //! Create a new reconnect scheduler from the configuration.
+    /*!
+     * The servers are taken from xmpp.servers, the delays from the
+     * xmpp.reconnect group.
+     * \throws ConfiguredClientFactoryException if a server address is invalid.
+     */
+    ReconnectScheduler* newReconnectScheduler() throw(ConfiguredClientFactoryException);
+
+    //! Create a new keepalive from the configuration.
+    /*!
+     * \param loop    The event loop for the keepalive timer.
+     * \param reactor The reactor of the connection.
+     * \returns the keepalive or 0 if xmpp.keepalive is not set.
+     * \throws ConfiguredClientFactoryException if the setting is invalid.
+     */
+    KeepAlive* newKeepAlive(EventLoop* loop, ClientReactor* reactor) throw(ConfiguredClientFactoryException);
+
+    //! Get the socket options for the XMPP connection.
+    /*!
+     * \returns the options from the xmpp.socket group, the defaults for
+     *          settings that are not present.
+     * \throws ConfiguredClientFactoryException if a setting is invalid.
+     */
+    SocketProfile socketProfile() throw(ConfiguredClientFactoryException);
+
+    //! Get the size limit for message bodies.
+    /*!
+     * \returns the value of xmpp.max_body or SpaceControlClient::DEFAULT_MAX_BODY
+     *          if not set; 0 means no limit.
+     * \throws ConfiguredClientFactoryException if the value is negative.
+     */
+    size_t maxBody() throw(ConfiguredClientFactoryException);
+
+    //! Get the rate of error responses per second.
+    /*!
+     * \returns the value of xmpp.error_rate or SpaceControlClient::DEFAULT_ERROR_RATE
+     *          if not set; 0 means no limit.
+     * \throws ConfiguredClientFactoryException if the value is negative.
+     */
+    unsigned int errorRate() throw(ConfiguredClientFactoryException);
+
+    //! Create a new rate limiter from the configuration.
+    /*!
+     * \returns the limiter for the xmpp.ratelimit group or 0 if not set.
+     * \throws ConfiguredClientFactoryException if a setting is invalid.
+     */
+    RateLimiter* newRateLimiter() throw(ConfiguredClientFactoryException);
+
+    //! Get the path of the socket for local clients.
+    /*!
+     * \returns the value of xmpp.local_socket or an empty string if not set,
+     *          i.e. no local socket is served.
+     */
+    std::string localSocket() throw(ConfiguredClientFactoryException);
+
 private:
     std::string m_filename;
     libconfig::Config* m_cfg;
@@ -19,23 +19,18 @@
 
 namespace {
 
-bool hup_received = false;
+volatile sig_atomic_t hup_received = 0;
+volatile sig_atomic_t term_received = 0;
 
-// Signal handler for SIGHUP
+// Signal handler for SIGHUP and SIGTERM
+// Only sets a flag, anything else is not async-signal-safe. The signals
+// are logged by Daemon::take_signal().
 void sig_handler(int signo)
 {
-    switch(signo) {
-    case SIGHUP:
-        hup_received = true;
-        syslog(LOG_NOTICE, "SIGHUP received.");
-        break;
-    case SIGTERM:
-        hup_received = true;
-        syslog(LOG_NOTICE, "SIGTERM received.");
-        break;
-    default:
-        syslog(LOG_ERR, "Unknown signal: %d", signo);
-    }
+    if (signo == SIGHUP)
+        hup_received = 1;
+    else if (signo == SIGTERM)
+        term_received = 1;
 }
 
 } // anon namespace
@@ -54,8 +49,13 @@ Daemon::Daemon(const std::string& _name, const std::string& pid_path)
 {
     openlog(m_name.c_str(), LOG_PID, LOG_USER);
 
-    signal(SIGHUP, sig_handler);
-    signal(SIGTERM, sig_handler);
+    // until the signals are handled elsewhere, e.g. by an EventLoop
+    struct sigaction sa;
+    sa.sa_handler = sig_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGHUP, &sa, 0);
+    sigaction(SIGTERM, &sa, 0);
 }
 
 Daemon::~Daemon()
@@ -154,7 +154,24 @@ void Daemon::message(const int level, const char *msg, ...)
 
 bool Daemon::sighup()
 {
-    return hup_received;
+    return hup_received || term_received;
+}
+
+int Daemon::take_signal()
+{
+    int signo = 0;
+    // termination first, a reload does not matter then
+    if (term_received) {
+        term_received = 0;
+        signo = SIGTERM;
+    } else if (hup_received) {
+        hup_received = 0;
+        signo = SIGHUP;
+    } else
+        return 0;
+
+    message(LOG_NOTICE, "%s received.", signo == SIGTERM ? "SIGTERM" : "SIGHUP");
+    return signo;
 }
 
 } // namespace xmppsc
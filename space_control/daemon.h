@@ -19,9 +19,18 @@ public:
 
     void message(const int level, const char *msg, ...);
 
-    /// SigHUP received?
+    /// SigHUP or SigTERM received?
     bool sighup();
 
+    /// Take a signal received by the handler of the daemon
+    /*!
+     * The handler only records the signal; it is logged here, outside of
+     * the signal context. A pending SIGTERM is returned before a SIGHUP.
+     *
+     * @returns the signal number and resets it, 0 if none is pending.
+     */
+    int take_signal();
+
 protected:
     /// Store the PID in PID_FILE
     /*!
@@ -0,0 +1,308 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "eventloop.h"
+
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <iostream>
+
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+// CPU time of the calling thread
+unsigned long long thread_cpu_ns() throw() {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) < 0)
+        return 0;
+    return static_cast<unsigned long long>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+} // anonymous namespace
+
+namespace xmppsc {
+
+double EventLoop::Stats::wakeups_per_second() const throw() {
+    return seconds > 0 ? wakeups / seconds : 0;
+}
+
+double EventLoop::Stats::cpu_us_per_wakeup() const throw() {
+    return wakeups ? cpu_ns / 1000.0 / wakeups : 0;
+}
+
+
+EventLoop::FdHandler::~FdHandler() {}
+
+EventLoop::TimerHandler::~TimerHandler() {}
+
+EventLoop::SignalHandler::~SignalHandler() {}
+
+
+EventLoop::EventLoop() throw(std::runtime_error)
+    : m_epoll(-1), m_wakeup(-1), m_signal(-1), m_stop(false) {
+    sigemptyset(&m_signal_mask);
+    reset_stats();
+
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll < 0)
+        throw std::runtime_error(std::string("Cannot create epoll instance: ") + strerror(errno));
+
+    m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeup < 0 || !watch(m_wakeup, EPOLLIN, WAKEUP, 0)) {
+        const std::string msg(strerror(errno));
+        if (m_wakeup >= 0)
+            close(m_wakeup);
+        close(m_epoll);
+        throw std::runtime_error("Cannot create wakeup event: " + msg);
+    }
+}
+
+EventLoop::~EventLoop() throw() {
+    // close timers and the signal descriptor, watched descriptors belong to their owners
+    for (source_map::iterator it = m_sources.begin(); it != m_sources.end(); ++it)
+        if (it->second.type != FD)
+            close(it->first);
+
+    close(m_epoll);
+}
+
+bool EventLoop::watch(int fd, unsigned int events, SourceType type, void* hnd) throw() {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) < 0)
+        return false;
+
+    Source src;
+    src.type = type;
+    src.hnd = hnd;
+    m_sources[fd] = src;
+    return true;
+}
+
+bool EventLoop::add_fd(int fd, unsigned int events, FdHandler* hnd) throw() {
+    return fd >= 0 && hnd && watch(fd, events, FD, hnd);
+}
+
+bool EventLoop::modify_fd(int fd, unsigned int events) throw() {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+
+    return epoll_ctl(m_epoll, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EventLoop::remove_fd(int fd) throw() {
+    source_map::iterator it = m_sources.find(fd);
+    if (it == m_sources.end() || it->second.type != FD)
+        return;
+
+    // fails if the descriptor has already been closed, which is fine
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, 0);
+    m_sources.erase(it);
+}
+
+int EventLoop::add_timer(unsigned int ms, bool periodic, TimerHandler* hnd) throw() {
+    if (!hnd)
+        return -1;
+
+    const int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = ms / 1000;
+    spec.it_value.tv_nsec = (ms % 1000) * 1000000L;
+    // a zero value would disarm the timer
+    if (!ms)
+        spec.it_value.tv_nsec = 1;
+    if (periodic)
+        spec.it_interval = spec.it_value;
+
+    if (timerfd_settime(fd, 0, &spec, 0) < 0 || !watch(fd, EPOLLIN, TIMER, hnd)) {
+        close(fd);
+        return -1;
+    }
+
+    m_periodic[fd] = periodic;
+    return fd;
+}
+
+void EventLoop::cancel_timer(int id) throw() {
+    source_map::iterator it = m_sources.find(id);
+    if (it == m_sources.end() || it->second.type != TIMER)
+        return;
+
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, id, 0);
+    close(id);
+    m_sources.erase(it);
+    m_periodic.erase(id);
+}
+
+bool EventLoop::add_signal(int signo, SignalHandler* hnd) throw() {
+    if (!hnd)
+        return false;
+
+    sigaddset(&m_signal_mask, signo);
+    if (pthread_sigmask(SIG_BLOCK, &m_signal_mask, 0) != 0)
+        return false;
+
+    const int fd = signalfd(m_signal, &m_signal_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    if (m_signal < 0) {
+        if (!watch(fd, EPOLLIN, SIGNAL, 0)) {
+            close(fd);
+            return false;
+        }
+        m_signal = fd;
+    }
+
+    m_signal_handlers[signo] = hnd;
+    return true;
+}
+
+int EventLoop::run_once(int timeout_ms) throw() {
+    const int MAX_EVENTS = 16;
+    struct epoll_event events[MAX_EVENTS];
+
+    const int n = epoll_wait(m_epoll, events, MAX_EVENTS, timeout_ms);
+    m_stats.wakeups++;
+
+    if (n < 0) {
+        if (errno == EINTR)
+            m_stats.interrupts++;
+        else
+            std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+        return 0;
+    }
+
+    if (n == 0) {
+        m_stats.timeouts++;
+        return 0;
+    }
+
+    const unsigned long long cpu_start = thread_cpu_ns();
+
+    for (int i = 0; i < n; i++)
+        dispatch(events[i].data.fd, events[i].events);
+
+    m_stats.events += n;
+    m_stats.cpu_ns += thread_cpu_ns() - cpu_start;
+
+    return n;
+}
+
+void EventLoop::run() throw() {
+    m_stop = false;
+    while (!m_stop)
+        run_once(-1);
+}
+
+void EventLoop::stop() throw() {
+    m_stop = true;
+    wakeup();
+}
+
+void EventLoop::wakeup() throw() {
+    const uint64_t one = 1;
+    if (write(m_wakeup, &one, sizeof(one)) < 0) {
+        // the counter is saturated, a wakeup is pending anyway
+    }
+}
+
+EventLoop::Stats EventLoop::stats() const throw() {
+    Stats s = m_stats;
+    s.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_stats_since).count();
+    return s;
+}
+
+void EventLoop::reset_stats() throw() {
+    m_stats.wakeups = 0;
+    m_stats.events = 0;
+    m_stats.timeouts = 0;
+    m_stats.interrupts = 0;
+    m_stats.cpu_ns = 0;
+    m_stats.seconds = 0;
+    m_stats_since = std::chrono::steady_clock::now();
+}
+
+void EventLoop::dispatch(int fd, unsigned int events) throw() {
+    // the source may have been removed by a previous handler
+    source_map::iterator it = m_sources.find(fd);
+    if (it == m_sources.end())
+        return;
+
+    const Source src = it->second;
+
+    try {
+        switch (src.type) {
+        case FD:
+            static_cast<FdHandler*>(src.hnd)->handleFdEvent(fd, events);
+            break;
+
+        case TIMER: {
+            uint64_t expirations;
+            if (read(fd, &expirations, sizeof(expirations)) < 0)
+                break;
+
+            // one-shot timers are gone before the handler runs
+            if (!m_periodic[fd])
+                cancel_timer(fd);
+
+            static_cast<TimerHandler*>(src.hnd)->handleTimer(fd);
+            break;
+        }
+
+        case SIGNAL: {
+            struct signalfd_siginfo info;
+            while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+                std::map<int, SignalHandler*>::iterator sh = m_signal_handlers.find(info.ssi_signo);
+                if (sh != m_signal_handlers.end())
+                    sh->second->handleSignal(info.ssi_signo);
+            }
+            break;
+        }
+
+        case WAKEUP: {
+            uint64_t value;
+            if (read(fd, &value, sizeof(value)) < 0) {
+                // spurious
+            }
+            break;
+        }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Exception in event handler: " << e.what() << std::endl;
+    } catch (...) {
+        std::cerr << "Unknown exception in event handler!" << std::endl;
+    }
+}
+
+} // namespace xmppsc
+
+// End of File
@@ -0,0 +1,200 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVENTLOOP_H__
+#define EVENTLOOP_H__
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <stdexcept>
+
+#include <signal.h>
+#include <sys/epoll.h>
+
+namespace xmppsc {
+
+//! Event loop based on epoll.
+/*!
+ * The loop waits for file descriptors, timers (timerfd) and signals
+ * (signalfd) and calls the registered handlers. It sleeps until one of
+ * these fires, so an idle process does not wake up periodically.
+ *
+ * All methods except wakeup() must be called from the loop thread.
+ */
+class EventLoop {
+public:
+    //! Handler for file descriptor events.
+    class FdHandler {
+    public:
+        virtual ~FdHandler();
+
+        //! Handle events on a file descriptor.
+        /*!
+         * \param fd     The file descriptor.
+         * \param events The epoll events, e.g. EPOLLIN.
+         */
+        virtual void handleFdEvent(int fd, unsigned int events) = 0;
+    };
+
+    //! Handler for expired timers.
+    class TimerHandler {
+    public:
+        virtual ~TimerHandler();
+
+        //! Handle an expired timer.
+        /*!
+         * \param id The timer ID as returned by add_timer().
+         */
+        virtual void handleTimer(int id) = 0;
+    };
+
+    //! Handler for signals.
+    class SignalHandler {
+    public:
+        virtual ~SignalHandler();
+
+        //! Handle a signal; called from the loop, not from a signal handler.
+        virtual void handleSignal(int signo) = 0;
+    };
+
+    //! Wakeup statistics.
+    /*!
+     * Used to check that an idle process really sleeps: without traffic
+     * and timers, the number of wakeups should not grow.
+     */
+    struct Stats {
+        //! Returns from the wait
+        unsigned long wakeups;
+        //! Handled events
+        unsigned long events;
+        //! Wakeups by timeout without events
+        unsigned long timeouts;
+        //! Wakeups by signal handlers (EINTR)
+        unsigned long interrupts;
+        //! CPU time of the loop thread spent handling events, in nanoseconds
+        unsigned long long cpu_ns;
+        //! Time since the loop has been created or the statistics were reset, in seconds
+        double seconds;
+
+        //! Average wakeups per second.
+        double wakeups_per_second() const throw();
+
+        //! Average CPU time per wakeup in microseconds.
+        double cpu_us_per_wakeup() const throw();
+    };
+
+    //! Create the loop.
+    /*!
+     * \throws std::runtime_error if the epoll instance cannot be created.
+     */
+    EventLoop() throw(std::runtime_error);
+
+    ~EventLoop() throw();
+
+    //! Watch a file descriptor.
+    /*!
+     * \param fd     The file descriptor.
+     * \param events The epoll events to wait for, e.g. EPOLLIN.
+     * \param hnd    The handler; ownership is not transferred.
+     * \returns false if the descriptor cannot be watched.
+     */
+    bool add_fd(int fd, unsigned int events, FdHandler* hnd) throw();
+
+    //! Change the events for a watched file descriptor.
+    bool modify_fd(int fd, unsigned int events) throw();
+
+    //! Stop watching a file descriptor.
+    void remove_fd(int fd) throw();
+
+    //! Start a timer.
+    /*!
+     * \param ms       The time until the timer expires in milliseconds.
+     * \param periodic true to restart the timer after expiry.
+     * \param hnd      The handler; ownership is not transferred.
+     * \returns the timer ID or -1 on error.
+     */
+    int add_timer(unsigned int ms, bool periodic, TimerHandler* hnd) throw();
+
+    //! Stop and remove a timer.
+    void cancel_timer(int id) throw();
+
+    //! Handle a signal in the loop.
+    /*!
+     * The signal is blocked for the calling thread and delivered via a
+     * signalfd instead. Call this before other threads are started, so
+     * they inherit the signal mask.
+     *
+     * \param signo The signal number.
+     * \param hnd   The handler; ownership is not transferred.
+     * \returns false if the signal cannot be handled by the loop.
+     */
+    bool add_signal(int signo, SignalHandler* hnd) throw();
+
+    //! Wait for events and handle them.
+    /*!
+     * \param timeout_ms Maximal waiting time, -1 to wait until an event arrives.
+     * \returns the number of handled events, 0 on timeout or interruption.
+     */
+    int run_once(int timeout_ms = -1) throw();
+
+    //! Handle events until stop() is called.
+    void run() throw();
+
+    //! Let run() return; may be called from any thread.
+    void stop() throw();
+
+    //! Interrupt the current or next wait; may be called from any thread.
+    void wakeup() throw();
+
+    //! Get the wakeup statistics.
+    Stats stats() const throw();
+
+    //! Reset the wakeup statistics.
+    void reset_stats() throw();
+
+private:
+    enum SourceType { FD, TIMER, SIGNAL, WAKEUP };
+
+    struct Source {
+        SourceType type;
+        void* hnd;
+    };
+
+    typedef std::map<int, Source> source_map;
+
+    int m_epoll;
+    int m_wakeup;
+    int m_signal;
+    sigset_t m_signal_mask;
+    std::atomic<bool> m_stop;
+    source_map m_sources;
+    //! periodic flag by timer ID
+    std::map<int, bool> m_periodic;
+    std::map<int, SignalHandler*> m_signal_handlers;
+
+    Stats m_stats;
+    std::chrono::steady_clock::time_point m_stats_since;
+
+    bool watch(int fd, unsigned int events, SourceType type, void* hnd) throw();
+    void dispatch(int fd, unsigned int events) throw();
+
+    EventLoop(const EventLoop& other);
+    EventLoop& operator=(const EventLoop& other);
+};
+
+}
+
+#endif // EVENTLOOP_H__
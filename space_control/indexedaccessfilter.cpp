@@ -0,0 +1,138 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "indexedaccessfilter.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace xmppsc {
+
+void IndexedAccessFilter::JidSet::add(const gloox::JID& jid)
+{
+    // if a ressource is not specified, match the user@host part only
+    if (jid.resource().empty())
+        m_bare.insert(jid.bare());
+    else
+        m_full.insert(jid.full());
+}
+
+void IndexedAccessFilter::JidSet::add(const jid_list& jids)
+{
+    for (jid_list::const_iterator it = jids.begin(); it != jids.end(); ++it)
+        add(*it);
+}
+
+bool IndexedAccessFilter::JidSet::contains(const gloox::JID& jid) const throw()
+{
+    return (!m_bare.empty() && m_bare.count(jid.bare()))
+           || (!m_full.empty() && m_full.count(jid.full()));
+}
+
+
+IndexedAccessFilter::IndexedAccessFilter()
+    : m_open(true), m_any(0) {}
+
+IndexedAccessFilter::IndexedAccessFilter(const jid_list& jids)
+    : m_open(false), m_any(0)
+{
+    m_jids.add(jids);
+}
+
+IndexedAccessFilter::~IndexedAccessFilter() throw()
+{
+    for (rule_map::iterator it = m_rules.begin(); it != m_rules.end(); ++it)
+        delete it->second;
+}
+
+void IndexedAccessFilter::add_rule(const std::string& pattern, const jid_list& jids) throw(std::logic_error)
+{
+    if (m_exact.frozen())
+        throw std::logic_error("Access filter is frozen: " + pattern);
+
+    JidSet*& set = m_rules[pattern];
+    if (!set)
+        set = new JidSet();
+    set->add(jids);
+}
+
+void IndexedAccessFilter::freeze()
+{
+    if (m_exact.frozen())
+        return;
+
+    for (rule_map::const_iterator it = m_rules.begin(); it != m_rules.end(); ++it) {
+        const std::string& pattern = it->first;
+
+        if (pattern == "*")
+            m_any = it->second;
+        else if (!pattern.empty() && pattern[pattern.size() - 1] == '*') {
+            const std::string prefix(pattern, 0, pattern.size() - 1);
+            m_prefix.insert(prefix, it->second);
+            if (std::find(m_prefix_lengths.begin(), m_prefix_lengths.end(), prefix.size()) == m_prefix_lengths.end())
+                m_prefix_lengths.push_back(prefix.size());
+        } else
+            m_exact.insert(pattern, it->second);
+    }
+
+    std::sort(m_prefix_lengths.begin(), m_prefix_lengths.end(), std::greater<size_t>());
+
+    m_exact.freeze();
+    m_prefix.freeze();
+}
+
+size_t IndexedAccessFilter::rules() const throw()
+{
+    return m_rules.size();
+}
+
+bool IndexedAccessFilter::accepted(const gloox::JID& jid) const throw()
+{
+    return m_open || m_jids.contains(jid);
+}
+
+bool IndexedAccessFilter::accepted(const gloox::JID& jid, const std::string& command) const throw()
+{
+    if (!accepted(jid))
+        return false;
+
+    if (m_rules.empty())
+        return true;
+
+    // rules that have not been compiled cannot be checked
+    if (!m_exact.frozen())
+        return false;
+
+    const JidSet* set = rule(command);
+    return !set || set->contains(jid);
+}
+
+const IndexedAccessFilter::JidSet* IndexedAccessFilter::rule(const std::string& command) const throw()
+{
+    if (const JidSet* set = m_exact.find(command))
+        return set;
+
+    // one lookup per prefix length, the longest match wins
+    for (std::vector<size_t>::const_iterator it = m_prefix_lengths.begin(); it != m_prefix_lengths.end(); ++it)
+        if (*it <= command.size())
+            if (const JidSet* set = m_prefix.find(command.data(), *it))
+                return set;
+
+    return m_any;
+}
+
+} // namespace xmppsc
+
+// End of File
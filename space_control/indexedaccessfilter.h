@@ -0,0 +1,121 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INDEXEDACCESSFILTER_H__
+#define INDEXEDACCESSFILTER_H__
+
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <gloox/jid.h>
+
+#include "accessfilter.h"
+#include "commandrouter.h"
+
+namespace xmppsc {
+
+//! Access filter with hashed JID lists and per-command rules.
+/*!
+ * JIDs without resource match all resources of the bare JID, others
+ * match the full JID only, as with the ListAccessFilter. Both are kept
+ * in hash sets, so a check does not depend on the number of entries.
+ *
+ * Rules restrict commands to further JID lists. A rule pattern is a
+ * command name, a prefix ending with '*' (e.g. "i2c.write*") or "*" for
+ * all commands. Only the most specific rule applies: the exact name,
+ * then the longest prefix. Commands without a rule are accepted for all
+ * JIDs that pass the general list.
+ *
+ * The filter must be frozen after adding the rules; before that, all
+ * commands are denied if there are rules.
+ */
+class IndexedAccessFilter : public AccessFilter {
+public:
+    typedef ListAccessFilter::jid_list jid_list;
+
+    //! Create a filter that accepts all JIDs, but applies the rules.
+    IndexedAccessFilter();
+
+    //! Create a filter that accepts the listed JIDs.
+    /*!
+     * @param jids the accepted JIDs; an empty list blocks all access
+     */
+    IndexedAccessFilter(const jid_list& jids);
+
+    virtual ~IndexedAccessFilter() throw();
+
+    //! Restrict commands to a list of JIDs.
+    /*!
+     * Rules with the same pattern are merged.
+     *
+     * @param pattern the command name, a prefix ending with '*' or "*"
+     * @param jids the JIDs that may use the commands
+     * @throws std::logic_error if the filter has been frozen.
+     */
+    void add_rule(const std::string& pattern, const jid_list& jids) throw(std::logic_error);
+
+    //! Build the rule tables; no rules can be added afterwards.
+    void freeze();
+
+    //! Get the number of rules.
+    size_t rules() const throw();
+
+    virtual bool accepted(const gloox::JID& jid) const throw();
+
+    virtual bool accepted(const gloox::JID& jid, const std::string& command) const throw();
+
+private:
+    //! JIDs normalized into bare and full JID hash sets
+    class JidSet {
+    public:
+        void add(const gloox::JID& jid);
+        void add(const jid_list& jids);
+        bool contains(const gloox::JID& jid) const throw();
+
+    private:
+        std::unordered_set<std::string> m_bare;
+        std::unordered_set<std::string> m_full;
+    };
+
+    typedef std::map<std::string, JidSet*> rule_map;
+
+    //! true if no general list has been set
+    const bool m_open;
+    JidSet m_jids;
+
+    //! rules by pattern, owns the sets
+    rule_map m_rules;
+    CommandTable<JidSet> m_exact;
+    //! prefix rules without the '*'
+    CommandTable<JidSet> m_prefix;
+    //! prefix lengths, longest first
+    std::vector<size_t> m_prefix_lengths;
+    JidSet* m_any;
+
+    //! Find the rule for a command.
+    const JidSet* rule(const std::string& command) const throw();
+
+    IndexedAccessFilter(const IndexedAccessFilter& other);
+    IndexedAccessFilter& operator=(const IndexedAccessFilter& other);
+};
+
+} // namespace xmppsc
+
+#endif // INDEXEDACCESSFILTER_H__
+
+// End of File
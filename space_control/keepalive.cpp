@@ -0,0 +1,113 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "keepalive.h"
+
+#include <gloox/jid.h>
+
+namespace xmppsc {
+
+KeepAlive::KeepAlive(EventLoop* loop, ClientReactor* reactor, unsigned int interval_ms,
+                     unsigned int timeout_ms, Mode mode)
+    : m_loop(loop), m_reactor(reactor), m_interval(interval_ms), m_timeout(timeout_ms),
+      m_mode(mode), m_timer(-1), m_ping_pending(false), m_ping_connection(0) {
+    m_stats.pings = 0;
+    m_stats.pongs = 0;
+    m_stats.timeouts = 0;
+    m_stats.rtt_ms = -1;
+    m_stats.rtt_max_ms = -1;
+
+    if (interval_ms)
+        m_timer = m_loop->add_timer(interval_ms, true, this);
+}
+
+KeepAlive::~KeepAlive() {
+    if (m_timer >= 0)
+        m_loop->cancel_timer(m_timer);
+}
+
+KeepAlive::Stats KeepAlive::stats() const throw() {
+    return m_stats;
+}
+
+void KeepAlive::handleTimer(int id) {
+    if (!m_reactor->connected())
+        return;
+
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const std::chrono::steady_clock::duration idle = now - m_reactor->last_receive();
+
+    // a ping of a previous connection will not be answered
+    if (m_ping_pending && m_ping_connection != m_reactor->connections())
+        m_ping_pending = false;
+
+    // an unanswered ping counts even if other stanzas arrive
+    const bool ping_lost = m_ping_pending && now - m_ping_sent >= (m_timeout.count() ? m_timeout : m_interval);
+
+    if (m_timeout.count() && (idle >= m_timeout || ping_lost)) {
+        m_stats.timeouts++;
+        m_ping_pending = false;
+        m_reactor->disconnect(gloox::ConnIoError);
+        return;
+    }
+
+    // without timeout, a lost ping is replaced by the next one
+    if (ping_lost)
+        m_ping_pending = false;
+
+    // traffic proves the connection as well as a ping
+    if (idle < m_interval)
+        return;
+
+    gloox::Client* client = m_reactor->space_control()->client();
+    if (m_mode == XMPP_PING) {
+        // one ping at a time, for a meaningful round-trip time
+        if (!m_ping_pending) {
+            m_ping_pending = true;
+            m_ping_connection = m_reactor->connections();
+            m_ping_sent = std::chrono::steady_clock::now();
+            client->xmppPing(gloox::JID(client->jid().server()), this);
+            m_stats.pings++;
+        }
+    } else {
+        client->whitespacePing();
+        m_stats.pings++;
+    }
+}
+
+void KeepAlive::handleEvent(const gloox::Event& event) {
+    switch (event.eventType()) {
+    case gloox::Event::PingPong:
+    // an error response proves the connection as well
+    case gloox::Event::PingError: {
+        if (!m_ping_pending)
+            break;
+
+        m_ping_pending = false;
+        m_stats.pongs++;
+        m_stats.rtt_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                             std::chrono::steady_clock::now() - m_ping_sent).count();
+        if (m_stats.rtt_ms > m_stats.rtt_max_ms)
+            m_stats.rtt_max_ms = m_stats.rtt_ms;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+} // namespace xmppsc
+
+// End of File
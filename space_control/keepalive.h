@@ -0,0 +1,99 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KEEPALIVE_H__
+#define KEEPALIVE_H__
+
+#include <chrono>
+
+#include <gloox/eventhandler.h>
+
+#include "clientreactor.h"
+#include "eventloop.h"
+
+namespace xmppsc {
+
+//! Keepalive and dead connection detection.
+/*!
+ * If nothing has been received for the keepalive interval, a ping is
+ * sent to the server. If nothing has been received for the idle timeout,
+ * or an XMPP ping has not been answered within the timeout, the
+ * connection is considered dead and dropped with ConnIoError, which
+ * leads to the usual reconnect. A dead connection is thus detected after
+ * at most idle timeout + interval.
+ *
+ * XMPP pings (XEP-0199) are answered by the server, so they are needed
+ * to detect a dead connection and to measure the round-trip time.
+ * Whitespace pings only keep NAT mappings alive; with them, the idle
+ * timeout fires if the server stays silent.
+ */
+class KeepAlive : public EventLoop::TimerHandler, public gloox::EventHandler {
+public:
+    //! Kind of ping.
+    enum Mode {
+        XMPP_PING,
+        WHITESPACE
+    };
+
+    //! Keepalive statistics.
+    struct Stats {
+        unsigned long pings;
+        unsigned long pongs;
+        //! Connections dropped by the idle timeout
+        unsigned long timeouts;
+        //! Last round-trip time in milliseconds, -1 if not measured yet
+        long rtt_ms;
+        //! Maximal round-trip time in milliseconds
+        long rtt_max_ms;
+    };
+
+    //! Create and start the keepalive.
+    /*!
+     * \param loop        The event loop for the timer.
+     * \param reactor     The reactor of the connection.
+     * \param interval_ms Idle time until a ping is sent.
+     * \param timeout_ms  Idle time or ping round-trip time until the connection is dropped,
+     *                    0 to never drop it.
+     * \param mode        The kind of ping.
+     */
+    KeepAlive(EventLoop* loop, ClientReactor* reactor, unsigned int interval_ms,
+              unsigned int timeout_ms, Mode mode = XMPP_PING);
+
+    virtual ~KeepAlive();
+
+    //! Get the statistics.
+    Stats stats() const throw();
+
+    virtual void handleTimer(int id);
+
+    //! Handle the ping responses.
+    virtual void handleEvent(const gloox::Event& event);
+
+private:
+    EventLoop* m_loop;
+    ClientReactor* m_reactor;
+    const std::chrono::milliseconds m_interval;
+    const std::chrono::milliseconds m_timeout;
+    const Mode m_mode;
+    int m_timer;
+    bool m_ping_pending;
+    unsigned long m_ping_connection;
+    std::chrono::steady_clock::time_point m_ping_sent;
+    Stats m_stats;
+};
+
+}
+
+#endif // KEEPALIVE_H__
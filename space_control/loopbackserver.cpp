@@ -0,0 +1,341 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "loopbackserver.h"
+
+#include <chrono>
+#include <sstream>
+
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+
+const char XMLNS_SASL[] = "urn:ietf:params:xml:ns:xmpp-sasl";
+const char XMLNS_BIND[] = "urn:ietf:params:xml:ns:xmpp-bind";
+const char XMLNS_SESSION[] = "urn:ietf:params:xml:ns:xmpp-session";
+const char XMLNS_ROSTER[] = "jabber:iq:roster";
+const char XMLNS_PING[] = "urn:xmpp:ping";
+const char XMLNS_STANZAS[] = "urn:ietf:params:xml:ns:xmpp-stanzas";
+
+const char STREAM_CLOSE[] = "</stream:stream>";
+
+} // anonymous namespace
+
+namespace xmppsc {
+
+LoopbackServer::LoopbackServer() : m_next_id(0) {
+    m_stats.connections = 0;
+    m_stats.routed = 0;
+    m_stats.dropped = 0;
+}
+
+LoopbackServer::~LoopbackServer() {}
+
+LoopbackConnection* LoopbackServer::attach(gloox::Client* client) {
+    LoopbackConnection* con = new LoopbackConnection(client, this, client->jid());
+    client->setConnectionImpl(con);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.connections++;
+    return con;
+}
+
+LoopbackServer::Stats LoopbackServer::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::string LoopbackServer::stream_id() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::ostringstream id;
+    id << "loopback" << ++m_next_id;
+    return id.str();
+}
+
+void LoopbackServer::bind(LoopbackConnection* con) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bound[con->bound().full()] = con;
+}
+
+void LoopbackServer::unbind(LoopbackConnection* con) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    connection_map::iterator it = m_bound.find(con->bound().full());
+    if (it != m_bound.end() && it->second == con)
+        m_bound.erase(it);
+}
+
+bool LoopbackServer::route(const gloox::JID& to, const std::string& xml) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    connection_map::const_iterator it = m_bound.find(to.full());
+    if (it == m_bound.end() && to.resource().empty())
+        // any resource of the bare JID
+        for (it = m_bound.begin(); it != m_bound.end(); ++it)
+            if (it->second->bound().bare() == to.bare())
+                break;
+
+    if (it == m_bound.end()) {
+        m_stats.dropped++;
+        return false;
+    }
+
+    it->second->deliver(xml);
+    m_stats.routed++;
+    return true;
+}
+
+
+LoopbackConnection::LoopbackConnection(gloox::ConnectionDataHandler* cdh, LoopbackServer* server,
+                                       const gloox::JID& jid)
+    : ConnectionBase(cdh), m_loopback(server), m_jid(jid), m_authenticated(false), m_parser(0),
+      m_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), m_total_in(0), m_total_out(0) {
+    m_server = m_jid.server();
+}
+
+LoopbackConnection::~LoopbackConnection() {
+    disconnect();
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+gloox::ConnectionError LoopbackConnection::connect() {
+    if (!m_handler)
+        return gloox::ConnNotConnected;
+    if (connected())
+        return gloox::ConnNoError;
+
+    {
+        std::lock_guard<std::mutex> lock(m_send_mutex);
+        delete m_parser;
+        m_parser = new gloox::Parser(this);
+        m_authenticated = false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_inbox_mutex);
+        m_state = gloox::StateConnected;
+    }
+    m_handler->handleConnect(this);
+    return gloox::ConnNoError;
+}
+
+gloox::ConnectionError LoopbackConnection::recv(int timeout) {
+    std::string data;
+    {
+        std::unique_lock<std::mutex> lock(m_inbox_mutex);
+        if (m_inbox.empty() && timeout < 0)
+            m_inbox_cond.wait(lock, [this] { return !m_inbox.empty() || m_state != gloox::StateConnected; });
+        else if (m_inbox.empty() && timeout > 0)
+            m_inbox_cond.wait_for(lock, std::chrono::microseconds(timeout),
+                                  [this] { return !m_inbox.empty() || m_state != gloox::StateConnected; });
+
+        if (m_state != gloox::StateConnected)
+            return gloox::ConnNotConnected;
+
+        data.swap(m_inbox);
+
+        uint64_t count;
+        if (!data.empty() && ::read(m_fd, &count, sizeof(count)) < 0) {
+            // not signalled, nothing to clear
+        }
+    }
+
+    if (!data.empty()) {
+        m_total_in += data.size();
+        m_handler->handleReceivedData(this, data);
+    }
+
+    return gloox::ConnNoError;
+}
+
+bool LoopbackConnection::send(const std::string& data) {
+    std::lock_guard<std::mutex> lock(m_send_mutex);
+    if (!connected() || !m_parser)
+        return false;
+
+    m_total_out += data.size();
+
+    std::string xml(data);
+    const std::string::size_type close = xml.find(STREAM_CLOSE);
+    if (close != std::string::npos)
+        xml.erase(close);
+
+    // the answers are queued, the client is not called back from here
+    if (!xml.empty() && m_parser->feed(xml) >= 0)
+        return false;
+
+    if (close != std::string::npos)
+        deliver(STREAM_CLOSE);
+
+    return true;
+}
+
+gloox::ConnectionError LoopbackConnection::receive() {
+    gloox::ConnectionError err = gloox::ConnNoError;
+    while (err == gloox::ConnNoError)
+        err = recv(-1);
+
+    return err;
+}
+
+void LoopbackConnection::disconnect() {
+    {
+        std::lock_guard<std::mutex> lock(m_inbox_mutex);
+        m_state = gloox::StateDisconnected;
+        m_inbox.clear();
+    }
+    m_inbox_cond.notify_all();
+
+    m_loopback->unbind(this);
+
+    std::lock_guard<std::mutex> lock(m_send_mutex);
+    m_bound = gloox::JID();
+    delete m_parser;
+    m_parser = 0;
+}
+
+void LoopbackConnection::getStatistics(long int& totalIn, long int& totalOut) {
+    totalIn = m_total_in;
+    totalOut = m_total_out;
+}
+
+gloox::ConnectionBase* LoopbackConnection::newInstance() const {
+    return new LoopbackConnection(m_handler, m_loopback, m_jid);
+}
+
+int LoopbackConnection::fd() const throw() {
+    return m_fd;
+}
+
+const gloox::JID& LoopbackConnection::bound() const throw() {
+    return m_bound;
+}
+
+bool LoopbackConnection::connected() const {
+    std::lock_guard<std::mutex> lock(m_inbox_mutex);
+    return m_state == gloox::StateConnected;
+}
+
+void LoopbackConnection::deliver(const std::string& data) {
+    bool signal = false;
+    {
+        std::lock_guard<std::mutex> lock(m_inbox_mutex);
+        if (m_state != gloox::StateConnected)
+            return;
+
+        signal = m_inbox.empty();
+        m_inbox.append(data);
+    }
+    m_inbox_cond.notify_one();
+
+    // the descriptor stays readable until the data has been taken
+    const uint64_t one = 1;
+    if (signal && ::write(m_fd, &one, sizeof(one)) < 0) {
+        // counter overflow, still readable
+    }
+}
+
+void LoopbackConnection::handleTag(gloox::Tag* tag) {
+    const std::string& name = tag->name();
+
+    if (name == "stream")
+        open_stream();
+    else if (name == "auth" && tag->xmlns() == XMLNS_SASL) {
+        // any credentials are accepted; the client restarts the stream
+        m_authenticated = true;
+        gloox::Tag success("success");
+        success.setXmlns(XMLNS_SASL);
+        deliver(success.xml());
+    } else if (name == "iq")
+        handle_iq(tag);
+    else if (name == "message" || name == "presence")
+        forward(tag);
+}
+
+void LoopbackConnection::open_stream() {
+    std::ostringstream xml;
+    xml << "<?xml version='1.0'?>"
+        << "<stream:stream xmlns='jabber:client' xmlns:stream='http://etherx.jabber.org/streams'"
+        << " id='" << m_loopback->stream_id() << "' from='" << m_jid.server() << "' version='1.0'>"
+        << "<stream:features>";
+
+    if (m_authenticated)
+        xml << "<bind xmlns='" << XMLNS_BIND << "'/><session xmlns='" << XMLNS_SESSION << "'/>";
+    else
+        xml << "<mechanisms xmlns='" << XMLNS_SASL << "'><mechanism>PLAIN</mechanism></mechanisms>";
+
+    xml << "</stream:features>";
+    deliver(xml.str());
+}
+
+void LoopbackConnection::handle_iq(gloox::Tag* iq) {
+    const gloox::JID to(iq->findAttribute("to"));
+    if (!to.username().empty()) {
+        forward(iq);
+        return;
+    }
+
+    // addressed to the server
+    const std::string& type = iq->findAttribute("type");
+    if (type != "get" && type != "set")
+        return;
+
+    gloox::Tag reply("iq");
+    reply.addAttribute("id", iq->findAttribute("id"));
+
+    if (gloox::Tag* bind = iq->findChild("bind", "xmlns", XMLNS_BIND)) {
+        const gloox::Tag* res = bind->findChild("resource");
+        m_bound = gloox::JID(m_jid.bare() + "/" + (res && !res->cdata().empty() ? res->cdata() : "loopback"));
+        m_loopback->bind(this);
+
+        reply.addAttribute("type", "result");
+        gloox::Tag* b = new gloox::Tag(&reply, "bind");
+        b->setXmlns(XMLNS_BIND);
+        new gloox::Tag(b, "jid", m_bound.full());
+    } else if (iq->findChild("query", "xmlns", XMLNS_ROSTER)) {
+        reply.addAttribute("type", "result");
+        gloox::Tag* q = new gloox::Tag(&reply, "query");
+        q->setXmlns(XMLNS_ROSTER);
+    } else if (iq->findChild("session", "xmlns", XMLNS_SESSION) || iq->findChild("ping", "xmlns", XMLNS_PING))
+        reply.addAttribute("type", "result");
+    else {
+        reply.addAttribute("type", "error");
+        gloox::Tag* error = new gloox::Tag(&reply, "error");
+        error->addAttribute("type", "cancel");
+        gloox::Tag* condition = new gloox::Tag(error, "service-unavailable");
+        condition->setXmlns(XMLNS_STANZAS);
+    }
+
+    if (m_bound)
+        reply.addAttribute("to", m_bound.full());
+    deliver(reply.xml());
+}
+
+void LoopbackConnection::forward(gloox::Tag* stanza) {
+    const gloox::JID to(stanza->findAttribute("to"));
+
+    // presences without recipient are broadcasts, there are no subscribers
+    if (to.username().empty())
+        return;
+
+    stanza->addAttribute("from", m_bound ? m_bound.full() : m_jid.full());
+    m_loopback->route(to, stanza->xml());
+}
+
+} // namespace xmppsc
+
+// End of File
@@ -0,0 +1,192 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOPBACKSERVER_H__
+#define LOOPBACKSERVER_H__
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <gloox/client.h>
+#include <gloox/connectionbase.h>
+#include <gloox/jid.h>
+#include <gloox/parser.h>
+#include <gloox/tag.h>
+#include <gloox/taghandler.h>
+
+namespace xmppsc {
+
+class LoopbackConnection;
+
+//! In-process stand-in for an XMPP server.
+/*!
+ * Clients attached to the server exchange stanzas in memory, without
+ * network and without a real server, e.g. a command line client and a
+ * space control client in one process for end-to-end tests and
+ * benchmarks.
+ *
+ * The server implements just enough of a stream for gloox: SASL PLAIN
+ * without password check, resource binding, sessions, an empty roster
+ * and pings. Messages, presences and IQs addressed to other clients are
+ * routed by full JID, or by bare JID to the first matching resource.
+ * TLS is not offered, so the clients must not require it.
+ *
+ * The server must outlive the attached clients.
+ */
+class LoopbackServer {
+public:
+    //! Routing statistics.
+    struct Stats {
+        //! Attached connections
+        unsigned long connections;
+        //! Stanzas delivered to another client
+        unsigned long routed;
+        //! Stanzas without recipient
+        unsigned long dropped;
+    };
+
+    LoopbackServer();
+
+    ~LoopbackServer();
+
+    //! Connect a client through this server.
+    /*!
+     * Replaces the connection of the client; connect() and recv() work as
+     * usual afterwards.
+     *
+     * \param client The client; ownership is not transferred.
+     * \returns the connection, which is owned by the client.
+     */
+    LoopbackConnection* attach(gloox::Client* client);
+
+    //! Get the routing statistics.
+    Stats stats() const;
+
+private:
+    typedef std::map<std::string, LoopbackConnection*> connection_map;
+
+    //! guards all members
+    mutable std::mutex m_mutex;
+    //! bound connections by full JID
+    connection_map m_bound;
+    unsigned long m_next_id;
+    Stats m_stats;
+
+    friend class LoopbackConnection;
+
+    //! Get a new stream ID.
+    std::string stream_id();
+
+    //! Make a connection reachable by its bound JID.
+    void bind(LoopbackConnection* con);
+
+    //! Remove a connection from the routing.
+    void unbind(LoopbackConnection* con);
+
+    //! Deliver a stanza to a client.
+    /*!
+     * \returns false if there is no such client.
+     */
+    bool route(const gloox::JID& to, const std::string& xml);
+
+    LoopbackServer(const LoopbackServer& other);
+    LoopbackServer& operator=(const LoopbackServer& other);
+};
+
+
+//! Client connection to a LoopbackServer.
+/*!
+ * Data sent by the client is parsed and answered by the server; the
+ * answers and stanzas from other clients are queued and handed to the
+ * client by recv(). The connection may be watched for incoming data with
+ * the descriptor from fd().
+ */
+class LoopbackConnection : public gloox::ConnectionBase, gloox::TagHandler {
+public:
+    //! Create the connection.
+    /*!
+     * \param cdh    The data handler, usually the client.
+     * \param server The server; ownership is not transferred.
+     * \param jid    The JID of the client.
+     */
+    LoopbackConnection(gloox::ConnectionDataHandler* cdh, LoopbackServer* server, const gloox::JID& jid);
+
+    virtual ~LoopbackConnection();
+
+    virtual gloox::ConnectionError connect();
+
+    //! Hand queued data to the client.
+    /*!
+     * \param timeout Waiting time in microseconds if no data is queued, -1 to wait for data.
+     */
+    virtual gloox::ConnectionError recv(int timeout = -1);
+
+    virtual bool send(const std::string& data);
+
+    virtual gloox::ConnectionError receive();
+
+    virtual void disconnect();
+
+    virtual void getStatistics(long int& totalIn, long int& totalOut);
+
+    virtual gloox::ConnectionBase* newInstance() const;
+
+    //! Get a descriptor that is readable while data is queued.
+    int fd() const throw();
+
+    //! Get the JID bound by the client, empty before binding.
+    const gloox::JID& bound() const throw();
+
+    virtual void handleTag(gloox::Tag* tag);
+
+private:
+    LoopbackServer* m_loopback;
+    const gloox::JID m_jid;
+    gloox::JID m_bound;
+    bool m_authenticated;
+    gloox::Parser* m_parser;
+    //! serializes sending, the parser is not thread-safe
+    std::mutex m_send_mutex;
+
+    //! guards m_inbox and m_state, which is accessed from several threads
+    mutable std::mutex m_inbox_mutex;
+    std::condition_variable m_inbox_cond;
+    std::string m_inbox;
+    int m_fd;
+
+    long int m_total_in;
+    long int m_total_out;
+
+    friend class LoopbackServer;
+
+    //! Queue data for the client; may be called from any thread.
+    void deliver(const std::string& data);
+
+    //! Check the state; may be called from any thread.
+    bool connected() const;
+
+    void open_stream();
+    void handle_iq(gloox::Tag* iq);
+    void forward(gloox::Tag* stanza);
+
+    LoopbackConnection(const LoopbackConnection& other);
+    LoopbackConnection& operator=(const LoopbackConnection& other);
+};
+
+}
+
+#endif // LOOPBACKSERVER_H__
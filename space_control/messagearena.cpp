@@ -0,0 +1,93 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "messagearena.h"
+
+namespace {
+
+// the arena active for this thread
+thread_local xmppsc::MessageArena* active_arena = 0;
+
+} // anonymous namespace
+
+namespace xmppsc {
+
+MessageArena::MessageArena(size_t size)
+    : m_buf(new char[size]), m_size(size), m_used(0), m_high_water(0), m_overflows(0) {}
+
+MessageArena::~MessageArena() throw() {
+    delete[] m_buf;
+}
+
+void* MessageArena::allocate(size_t n, size_t align) throw() {
+    // align the current position
+    const size_t start = (m_used + align - 1) & ~(align - 1);
+
+    if (start > m_size || n > m_size - start)
+        return 0;
+
+    m_used = start + n;
+    if (m_used > m_high_water)
+        m_high_water = m_used;
+
+    return m_buf + start;
+}
+
+bool MessageArena::owns(const void* p) const throw() {
+    const char* c = static_cast<const char*>(p);
+    return c >= m_buf && c < m_buf + m_size;
+}
+
+void MessageArena::reset() throw() {
+    m_used = 0;
+}
+
+size_t MessageArena::capacity() const throw() {
+    return m_size;
+}
+
+size_t MessageArena::high_water() const throw() {
+    return m_high_water;
+}
+
+size_t MessageArena::overflows() const throw() {
+    return m_overflows;
+}
+
+void MessageArena::overflow() throw() {
+    m_overflows++;
+}
+
+MessageArena* MessageArena::current() throw() {
+    return active_arena;
+}
+
+
+MessageArenaScope::MessageArenaScope(MessageArena* arena) throw()
+    : m_arena(arena), m_previous(active_arena) {
+    if (m_arena)
+        active_arena = m_arena;
+}
+
+MessageArenaScope::~MessageArenaScope() throw() {
+    if (m_arena) {
+        active_arena = m_previous;
+        m_arena->reset();
+    }
+}
+
+} // namespace xmppsc
+
+// End of File
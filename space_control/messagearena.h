@@ -0,0 +1,178 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MESSAGEARENA_H__
+#define MESSAGEARENA_H__
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+namespace xmppsc {
+
+//! Monotonic memory arena for the processing of one message.
+/*!
+ * The arena hands out memory from one pre-allocated block and releases
+ * everything at once on reset(). This keeps the short-lived allocations of
+ * a received message (parameter sets of the command and its responses) off
+ * the heap, which otherwise fragments over long uptimes on small boards.
+ *
+ * An arena is activated for the current thread with a MessageArenaScope.
+ * Allocations that do not fit fall back to the heap.
+ */
+class MessageArena {
+public:
+    //! Create an arena.
+    /*!
+     * \param size The size of the memory block in bytes.
+     */
+    explicit MessageArena(size_t size);
+
+    ~MessageArena() throw();
+
+    //! Allocate memory from the arena.
+    /*!
+     * \param n     The number of bytes.
+     * \param align The alignment, must be a power of 2.
+     * \returns the memory or 0 if the arena is exhausted.
+     */
+    void* allocate(size_t n, size_t align) throw();
+
+    //! Check if memory has been allocated from this arena.
+    bool owns(const void* p) const throw();
+
+    //! Release all allocations at once.
+    void reset() throw();
+
+    //! Get the arena size.
+    size_t capacity() const throw();
+
+    //! Get the maximal number of bytes used between two resets.
+    size_t high_water() const throw();
+
+    //! Get the number of allocations that did not fit into the arena.
+    size_t overflows() const throw();
+
+    //! Count an allocation that did not fit, see ArenaAllocator.
+    void overflow() throw();
+
+    //! Get the arena active for the calling thread.
+    /*!
+     * \returns the active arena or 0 if there is none.
+     */
+    static MessageArena* current() throw();
+
+private:
+    // No copies, not implemented
+    MessageArena(const MessageArena& other);
+    MessageArena& operator=(const MessageArena& other);
+
+    friend class MessageArenaScope;
+
+    char* m_buf;
+    const size_t m_size;
+    size_t m_used;
+    size_t m_high_water;
+    size_t m_overflows;
+};
+
+
+//! Activate an arena for the current thread while the scope exists.
+/*!
+ * On destruction the previously active arena is restored and the arena is
+ * reset. Objects allocated within the scope must not outlive it; copies
+ * made outside of the scope are allocated on the heap.
+ */
+class MessageArenaScope {
+public:
+    //! Activate the arena.
+    /*!
+     * \param arena The arena, may be 0 to do nothing.
+     */
+    explicit MessageArenaScope(MessageArena* arena) throw();
+
+    ~MessageArenaScope() throw();
+
+private:
+    MessageArenaScope(const MessageArenaScope& other);
+    MessageArenaScope& operator=(const MessageArenaScope& other);
+
+    MessageArena* m_arena;
+    MessageArena* m_previous;
+};
+
+
+//! Allocator using the arena that is active on construction.
+/*!
+ * Containers created within a MessageArenaScope allocate from the arena,
+ * containers created outside of it or copied outside of it use the heap.
+ */
+template<class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    // move the arena along with the container contents
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    typedef std::false_type propagate_on_container_copy_assignment;
+
+    ArenaAllocator() throw() : m_arena(MessageArena::current()) {}
+
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) throw() : m_arena(other.arena()) {}
+
+    T* allocate(size_t n) {
+        if (m_arena) {
+            void* p = m_arena->allocate(n * sizeof(T), alignof(T));
+            if (p)
+                return static_cast<T*>(p);
+            m_arena->overflow();
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) throw() {
+        // arena memory is released on reset
+        if (!m_arena || !m_arena->owns(p))
+            ::operator delete(p);
+    }
+
+    //! Copies use the arena active for the copying code.
+    ArenaAllocator select_on_container_copy_construction() const throw() {
+        return ArenaAllocator();
+    }
+
+    MessageArena* arena() const throw() {
+        return m_arena;
+    }
+
+private:
+    MessageArena* m_arena;
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) throw() {
+    return a.arena() == b.arena();
+}
+
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) throw() {
+    return a.arena() != b.arena();
+}
+
+} // namespace xmppsc
+
+#endif // MESSAGEARENA_H__
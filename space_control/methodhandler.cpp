@@ -17,10 +17,10 @@
 
 
 #include "methodhandler.h"
+#include "util.h"
 
 #include <iostream>
-#include <sstream>
-#include <cassert>
+#include <utility>
 
 namespace xmppsc {
 
@@ -28,56 +28,51 @@ namespace xmppsc {
 MethodHandler::~MethodHandler() {}
 
 void MethodHandler::handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc, SpaceCommandSink* sink) {
-    const std::string cmd = sc.cmd();
-    try {
+    const std::string& cmd = sc.cmd();
 #ifdef DEBUG
-        std::cout << "Got command " << cmd << " from " << peer.full() << std::endl;
+    std::cout << "Got command " << cmd << " from " << peer.full() << std::endl;
 #endif
 
-        CommandMethod* method = m_methods.at(cmd);
-
-        if (method) {
-            try {
-                method->handleSpaceCommand(peer, sc, sink);
-            } catch (MissingCommandParameterException &mcp) {
-                SpaceCommand::space_command_params par;
-                par["what"] = mcp.what();
-		par["parameter"] = mcp.name();
-                SpaceCommand ex("exception", par);
-                sink->sendSpaceCommand(ex);
-            } catch (IllegalCommandParameterException &mcp) {
-                SpaceCommand::space_command_params par;
-                par["what"] = mcp.what();
-		par["parameter"] = mcp.name();
-                SpaceCommand ex("exception", par);
-                sink->sendSpaceCommand(ex);
-            }
-        } else {
-            std::cerr << "Assertion error: Method not found, but did not throw an exception!" << std::endl;
-	    // fail in debug mode
-	    assert(0);
-	}
-    } catch (std::out_of_range &oor) {
-        SpaceCommand::space_command_params par;
-        par["what"] = oor.what();
-        std::stringstream s;
-        s << "Unknown command: " << cmd;
-        par["text"] = s.str();
-        SpaceCommand ex("exception", par);
-        sink->sendSpaceCommand(ex);
-    }
+    // freezing here would race with other workers
+    if (!m_methods.frozen())
+        throw std::logic_error("MethodHandler used before freeze()");
+
+    CommandMethod* method = m_methods.find(cmd);
+
+    if (method) {
+        // methods that decode their parameters with a schema report errors
+        // without throwing; these handlers are for the others
+        try {
+            method->handleSpaceCommand(peer, sc, sink);
+        } catch (MissingCommandParameterException &mcp) {
+            SpaceCommand::space_command_params par;
+            par["what"] = mcp.what();
+            par["parameter"] = mcp.name();
+            sink->sendSpaceCommand(SpaceCommand("exception", std::move(par)));
+        } catch (IllegalCommandParameterException &mcp) {
+            SpaceCommand::space_command_params par;
+            par["what"] = mcp.what();
+            par["parameter"] = mcp.name();
+            sink->sendSpaceCommand(SpaceCommand("exception", std::move(par)));
+        }
+    } else
+        send_unknown_command(cmd, sink);
 }
 
-void MethodHandler::add_method(CommandMethod* method) {
+void MethodHandler::add_method(CommandMethod* method) throw(std::logic_error) {
     CommandMethod::t_command_set::iterator iter;
 
     for (iter =  method->command_set().begin();
             iter != method->command_set().end(); iter++) {
     	// TODO delete old methods, if already set
-        m_methods[*iter] = method;
+        m_methods.insert(*iter, method);
     }
 }
 
+void MethodHandler::freeze() {
+    m_methods.freeze();
+}
+
 
 
 } // namespace xmppsc
@@ -17,9 +17,9 @@
 #define METHODHANDLER_H__
 
 #include "spacecontrolclient.h"
+#include "commandrouter.h"
 
 #include <string>
-#include <map>
 
 namespace xmppsc {
   
@@ -32,19 +32,29 @@ public:
     /**
      * Call the right method handler for the space command if available. If 
      * the method handler throws a MissingCommandParameterException this 
-     * exception is sent back via the XMPP channel.
+     * exception is sent back via the XMPP channel. Unknown commands are
+     * answered with an exception command as well, without throwing.
+     *
+     * \throws std::logic_error if the handler has not been frozen.
      */
     virtual void handleSpaceCommand(gloox::JID peer, const SpaceCommand& sc, SpaceCommandSink* sink);
 
     //! Add a method to the handler
     /*!
      * \param method a pointer to the added method; ownership is transferred to the handler.
+     * \throws std::logic_error if the handler has been frozen.
      */
     //TODO std::auto_ptr ?
-    void add_method(CommandMethod* method);
+    void add_method(CommandMethod* method) throw(std::logic_error);
+
+    //! Build the command lookup table; no methods can be added afterwards.
+    /*!
+     * Must be called before the first command is handled.
+     */
+    void freeze();
 
 private:
-    std::map<std::string, CommandMethod*> m_methods;
+    CommandTable<CommandMethod> m_methods;
 };
 
 
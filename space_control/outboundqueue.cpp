@@ -0,0 +1,201 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "outboundqueue.h"
+
+#include <thread>
+#include <utility>
+
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+
+// the ring size is a power of 2, at least 2
+size_t ring_size(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+    return size;
+}
+
+} // anonymous namespace
+
+namespace xmppsc {
+
+OutboundQueue::OutboundQueue(size_t capacity)
+    : m_cells(0), m_mask(ring_size(capacity) - 1), m_fd(-1), m_enqueue(0), m_dequeue(0), m_pending(0),
+      m_max_depth(0), m_pushed(0), m_dropped(0), m_full(0),
+      m_sent(0), m_latency_total_us(0), m_latency_max_us(0) {
+    const size_t size = m_mask + 1;
+    m_cells = new Cell[size];
+    for (size_t i = 0; i < size; i++)
+        m_cells[i].seq.store(i, std::memory_order_relaxed);
+
+    m_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
+OutboundQueue::~OutboundQueue() throw() {
+    delete[] m_cells;
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool OutboundQueue::enqueue(OutboundMessage& msg) throw() {
+    size_t pos = m_enqueue.load(std::memory_order_relaxed);
+    Cell* cell;
+
+    for (;;) {
+        cell = &m_cells[pos & m_mask];
+        const size_t seq = cell->seq.load(std::memory_order_acquire);
+        const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+        if (diff == 0) {
+            // the cell is free, try to claim it
+            if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0)
+            // the consumer has not yet released the cell: full
+            return false;
+        else
+            pos = m_enqueue.load(std::memory_order_relaxed);
+    }
+
+    cell->msg = std::move(msg);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool OutboundQueue::push(OutboundMessage& msg, unsigned int wait_ms) {
+    msg.queued = std::chrono::steady_clock::now();
+
+    if (!enqueue(msg)) {
+        m_full.fetch_add(1, std::memory_order_relaxed);
+
+        // backpressure: give the consumer time to catch up
+        const std::chrono::steady_clock::time_point deadline =
+            msg.queued + std::chrono::milliseconds(wait_ms);
+        bool done = false;
+        while (!done && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            done = enqueue(msg);
+        }
+
+        if (!done) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    }
+
+    queued();
+    return true;
+}
+
+bool OutboundQueue::try_push(OutboundMessage& msg) {
+    msg.queued = std::chrono::steady_clock::now();
+
+    if (!enqueue(msg)) {
+        m_full.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    queued();
+    return true;
+}
+
+void OutboundQueue::queued() throw() {
+    m_pushed.fetch_add(1, std::memory_order_relaxed);
+
+    // wake the consumer if the queue has been empty
+    const long pending = m_pending.fetch_add(1, std::memory_order_acq_rel);
+    if (pending == 0) {
+        const uint64_t one = 1;
+        if (write(m_fd, &one, sizeof(one)) < 0) {
+            // the counter is saturated, the consumer is signalled anyway
+        }
+    }
+
+    // update the maximal depth
+    const size_t depth = pending + 1 > 0 ? pending + 1 : 0;
+    size_t max = m_max_depth.load(std::memory_order_relaxed);
+    while (depth > max && !m_max_depth.compare_exchange_weak(max, depth, std::memory_order_relaxed))
+        ;
+}
+
+bool OutboundQueue::pop(OutboundMessage& msg) throw() {
+    Cell* cell = &m_cells[m_dequeue & m_mask];
+    const size_t seq = cell->seq.load(std::memory_order_acquire);
+
+    if (seq != m_dequeue + 1)
+        return false;
+
+    msg = std::move(cell->msg);
+    // release the cell for the next round
+    cell->seq.store(m_dequeue + m_mask + 1, std::memory_order_release);
+    m_dequeue++;
+
+    m_pending.fetch_sub(1, std::memory_order_acq_rel);
+    return true;
+}
+
+void OutboundQueue::record_sent(const OutboundMessage& msg) throw() {
+    const unsigned long us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::steady_clock::now() - msg.queued).count();
+
+    // only the consumer writes these
+    m_sent.store(m_sent.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_latency_total_us.store(m_latency_total_us.load(std::memory_order_relaxed) + us,
+                             std::memory_order_relaxed);
+    if (us > m_latency_max_us.load(std::memory_order_relaxed))
+        m_latency_max_us.store(us, std::memory_order_relaxed);
+}
+
+int OutboundQueue::fd() const throw() {
+    return m_fd;
+}
+
+void OutboundQueue::clear_signal() throw() {
+    uint64_t value;
+    if (read(m_fd, &value, sizeof(value)) < 0) {
+        // not signalled
+    }
+}
+
+size_t OutboundQueue::depth() const throw() {
+    const long pending = m_pending.load(std::memory_order_relaxed);
+    return pending > 0 ? pending : 0;
+}
+
+size_t OutboundQueue::capacity() const throw() {
+    return m_mask + 1;
+}
+
+OutboundQueue::Stats OutboundQueue::stats() const throw() {
+    Stats s;
+    s.depth = depth();
+    s.max_depth = m_max_depth.load(std::memory_order_relaxed);
+    s.pushed = m_pushed.load(std::memory_order_relaxed);
+    s.sent = m_sent.load(std::memory_order_relaxed);
+    s.dropped = m_dropped.load(std::memory_order_relaxed);
+    s.full = m_full.load(std::memory_order_relaxed);
+    s.latency_avg_us = s.sent ? m_latency_total_us.load(std::memory_order_relaxed) / s.sent : 0;
+    s.latency_max_us = m_latency_max_us.load(std::memory_order_relaxed);
+    return s;
+}
+
+} // namespace xmppsc
+
+// End of File
@@ -0,0 +1,166 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OUTBOUNDQUEUE_H__
+#define OUTBOUNDQUEUE_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+#include <gloox/jid.h>
+#include <gloox/message.h>
+
+namespace xmppsc {
+
+//! A message body waiting to be sent.
+struct OutboundMessage {
+    OutboundMessage() : type(gloox::Message::Chat) {}
+
+    gloox::Message::MessageType type;
+    gloox::JID to;
+    std::string body;
+    //! Time of queueing, for the latency statistics
+    std::chrono::steady_clock::time_point queued;
+};
+
+
+//! Bounded multi-producer single-consumer queue for outgoing messages.
+/*!
+ * Any thread may push messages, only the connection thread pops them.
+ * Pushing and popping are lock-free (a ring of sequenced cells as
+ * described by D. Vyukov), so handlers never wait for the socket.
+ *
+ * The consumer is signalled via an eventfd when the queue becomes
+ * non-empty, see fd().
+ */
+class OutboundQueue {
+public:
+    //! Queue statistics.
+    struct Stats {
+        //! Messages currently queued
+        size_t depth;
+        //! Highest depth seen
+        size_t max_depth;
+        //! Messages queued
+        unsigned long pushed;
+        //! Messages sent
+        unsigned long sent;
+        //! Messages dropped because the queue stayed full
+        unsigned long dropped;
+        //! Pushes that found the queue full
+        unsigned long full;
+        //! Average and maximal time from queueing until sent, in microseconds
+        unsigned long latency_avg_us;
+        unsigned long latency_max_us;
+    };
+
+    //! Create a queue.
+    /*!
+     * \param capacity The maximal number of queued messages, rounded up to a power of 2.
+     */
+    explicit OutboundQueue(size_t capacity);
+
+    ~OutboundQueue() throw();
+
+    //! Queue a message.
+    /*!
+     * If the queue is full, the caller waits up to wait_ms for the
+     * consumer to catch up (backpressure).
+     *
+     * \param msg     The message, moved into the queue on success.
+     * \param wait_ms Maximal waiting time if the queue is full.
+     * \returns false if the queue is still full; the message is dropped.
+     */
+    bool push(OutboundMessage& msg, unsigned int wait_ms = 0);
+
+    //! Queue a message if there is room, without waiting.
+    /*!
+     * Unlike push(), a full queue does not count as a dropped message;
+     * the caller keeps the message and may retry, e.g. after draining
+     * the queue itself.
+     *
+     * \param msg The message, moved into the queue on success.
+     * \returns false if the queue is full.
+     */
+    bool try_push(OutboundMessage& msg);
+
+    //! Take the next message; consumer only.
+    /*!
+     * \returns false if the queue is empty.
+     */
+    bool pop(OutboundMessage& msg) throw();
+
+    //! Record the time a message took until it was sent; consumer only.
+    void record_sent(const OutboundMessage& msg) throw();
+
+    //! File descriptor that becomes readable when messages are queued.
+    int fd() const throw();
+
+    //! Reset the readiness of fd(); consumer only, call before draining.
+    void clear_signal() throw();
+
+    //! Get the number of queued messages.
+    size_t depth() const throw();
+
+    //! Get the maximal number of queued messages.
+    size_t capacity() const throw();
+
+    //! Get the statistics.
+    Stats stats() const throw();
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        OutboundMessage msg;
+    };
+
+    //! Put a message into a free cell.
+    bool enqueue(OutboundMessage& msg) throw();
+
+    //! Count a queued message and wake the consumer.
+    void queued() throw();
+
+    Cell* m_cells;
+    const size_t m_mask;
+    int m_fd;
+
+    // producers and consumer on separate cache lines; padding instead of
+    // alignas, over-aligned new needs C++17
+    char m_pad0[64];
+    std::atomic<size_t> m_enqueue;
+    char m_pad1[64];
+    size_t m_dequeue;
+    char m_pad2[64];
+
+    // queued, but not yet popped; may briefly become negative
+    std::atomic<long> m_pending;
+
+    std::atomic<size_t> m_max_depth;
+    std::atomic<unsigned long> m_pushed;
+    std::atomic<unsigned long> m_dropped;
+    std::atomic<unsigned long> m_full;
+    std::atomic<unsigned long> m_sent;
+    std::atomic<unsigned long long> m_latency_total_us;
+    std::atomic<unsigned long> m_latency_max_us;
+
+    OutboundQueue(const OutboundQueue& other);
+    OutboundQueue& operator=(const OutboundQueue& other);
+};
+
+}
+
+#endif // OUTBOUNDQUEUE_H__
@@ -0,0 +1,304 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ratelimiter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace xmppsc {
+
+TokenBucket::TokenBucket(double rate, double burst, clock::time_point now) throw() {
+    set(rate, burst, now);
+}
+
+void TokenBucket::set(double rate, double burst, clock::time_point now) throw() {
+    m_rate = std::max(rate, 0.0);
+    m_burst = std::max(burst, 1.0);
+    m_tokens = m_burst;
+    m_last = now;
+}
+
+void TokenBucket::adjust(double rate, double burst, clock::time_point now) throw() {
+    const bool limited = m_rate > 0;
+    const double available = tokens(now);
+
+    m_rate = std::max(rate, 0.0);
+    m_burst = std::max(burst, 1.0);
+    m_tokens = limited ? std::min(available, m_burst) : m_burst;
+    m_last = std::max(now, m_last);
+}
+
+bool TokenBucket::take(clock::time_point now) throw() {
+    if (m_rate <= 0)
+        return true;
+
+    m_tokens = tokens(now);
+    m_last = std::max(now, m_last);
+
+    if (m_tokens < 1)
+        return false;
+
+    m_tokens -= 1;
+    return true;
+}
+
+double TokenBucket::tokens(clock::time_point now) const throw() {
+    if (m_rate <= 0 || now <= m_last)
+        return m_tokens;
+
+    const double elapsed = std::chrono::duration<double>(now - m_last).count();
+    return std::min(m_burst, m_tokens + elapsed * m_rate);
+}
+
+double TokenBucket::rate() const throw() {
+    return m_rate;
+}
+
+double TokenBucket::burst() const throw() {
+    return m_burst;
+}
+
+
+ErrorLimiter::ErrorLimiter(double rate, double burst) throw()
+    : m_bucket(rate, burst), m_suppressed(0) {}
+
+void ErrorLimiter::set(double rate, double burst) throw() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bucket.set(rate, burst);
+}
+
+bool ErrorLimiter::admit() throw() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_bucket.take())
+        return true;
+
+    m_suppressed++;
+    return false;
+}
+
+unsigned long ErrorLimiter::suppressed() const throw() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_suppressed;
+}
+
+
+
+RateLimiter::RateLimiter(double rate, double burst)
+    : m_limit(rate, burst), m_strikes(0), m_window(0), m_block(0), m_admits_since_sweep(0) {
+    m_stats.admitted = 0;
+    m_stats.busy = 0;
+    m_stats.dropped = 0;
+    m_stats.blocks = 0;
+    m_stats.peers = 0;
+    m_stats.blocked_peers = 0;
+}
+
+void RateLimiter::set_namespace_limit(const std::string& ns, double rate, double burst) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ns_limits[ns] = Limit(rate, burst);
+}
+
+void RateLimiter::set_blocking(unsigned int strikes, unsigned int window_ms, unsigned int block_ms) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_strikes = strikes;
+    m_window = std::chrono::milliseconds(window_ms);
+    m_block = std::chrono::milliseconds(block_ms);
+}
+
+void RateLimiter::reconfigure(const RateLimiter& other, clock::time_point now) {
+    if (&other == this)
+        return;
+
+    // copy first, so only one mutex is held at a time
+    Limit limit;
+    std::map<std::string, Limit> ns_limits;
+    unsigned int strikes;
+    clock::duration window;
+    clock::duration block;
+    {
+        std::lock_guard<std::mutex> lock(other.m_mutex);
+        limit = other.m_limit;
+        ns_limits = other.m_ns_limits;
+        strikes = other.m_strikes;
+        window = other.m_window;
+        block = other.m_block;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_limit = limit;
+    m_ns_limits.swap(ns_limits);
+    m_strikes = strikes;
+    m_window = window;
+    m_block = block;
+
+    for (peer_map::iterator it = m_peers.begin(); it != m_peers.end(); ++it) {
+        Peer& p = it->second;
+        p.bucket.adjust(m_limit.rate, m_limit.burst, now);
+
+        for (std::map<std::string, TokenBucket>::iterator b = p.namespaces.begin(); b != p.namespaces.end(); ) {
+            std::map<std::string, Limit>::const_iterator l = m_ns_limits.find(b->first);
+            if (l == m_ns_limits.end())
+                b = p.namespaces.erase(b);
+            else {
+                b->second.adjust(l->second.rate, l->second.burst, now);
+                ++b;
+            }
+        }
+    }
+}
+
+RateLimiter::Verdict RateLimiter::admit(const gloox::JID& peer, const std::string& command,
+                                        unsigned int* retry_ms, clock::time_point now) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return admit_locked(peer, &command, 1, retry_ms, now);
+}
+
+RateLimiter::Verdict RateLimiter::admit(const gloox::JID& peer, const std::vector<std::string>& commands,
+                                        unsigned int* retry_ms, clock::time_point now) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (commands.empty())
+        return ADMITTED;
+    return admit_locked(peer, &commands[0], commands.size(), retry_ms, now);
+}
+
+RateLimiter::Verdict RateLimiter::admit_locked(const gloox::JID& peer, const std::string* commands, size_t n,
+                                               unsigned int* retry_ms, clock::time_point now) {
+    if (++m_admits_since_sweep >= 1024)
+        sweep(now);
+
+    peer_map::iterator it = m_peers.find(peer.bare());
+    if (it == m_peers.end()) {
+        it = m_peers.insert(peer_map::value_type(peer.bare(), Peer())).first;
+        it->second.bucket.set(m_limit.rate, m_limit.burst, now);
+        it->second.strikes = 0;
+        it->second.window_start = now;
+    }
+    Peer& p = it->second;
+    p.last = now;
+
+    if (now < p.blocked_until) {
+        m_stats.dropped += n;
+        if (retry_ms)
+            *retry_ms = std::chrono::duration_cast<std::chrono::milliseconds>(p.blocked_until - now).count();
+        return BLOCKED;
+    }
+
+    // the bucket of the namespace of each command, if limited; no
+    // allocation for single commands
+    TokenBucket* single = 0;
+    std::vector<TokenBucket*> several;
+    if (n > 1)
+        several.resize(n);
+    TokenBucket** ns = n > 1 ? &several[0] : &single;
+    for (size_t i = 0; i < n; i++)
+        ns[i] = namespace_bucket(p, commands[i], now);
+
+    // take tokens only if all buckets have enough for all commands
+    bool ok = p.bucket.rate() <= 0 || p.bucket.tokens(now) >= n;
+    unsigned int wait = ok ? 0 : wait_ms(p.bucket, n, now);
+    for (size_t i = 0; i < n; i++) {
+        if (!ns[i] || ns[i]->rate() <= 0 || std::find(ns, ns + i, ns[i]) != ns + i)
+            continue;
+
+        const double needed = std::count(ns + i, ns + n, ns[i]);
+        if (ns[i]->tokens(now) < needed) {
+            ok = false;
+            wait = std::max(wait, wait_ms(*ns[i], needed, now));
+        }
+    }
+
+    if (ok) {
+        for (size_t i = 0; i < n; i++) {
+            p.bucket.take(now);
+            if (ns[i])
+                ns[i]->take(now);
+        }
+        m_stats.admitted += n;
+        return ADMITTED;
+    }
+
+    m_stats.busy += n;
+    if (retry_ms)
+        *retry_ms = wait;
+
+    // count the strikes within the window
+    if (m_strikes) {
+        if (now - p.window_start > m_window) {
+            p.window_start = now;
+            p.strikes = 0;
+        }
+
+        if (++p.strikes >= m_strikes) {
+            p.blocked_until = now + m_block;
+            p.strikes = 0;
+            m_stats.blocks++;
+        }
+    }
+
+    return BUSY;
+}
+
+TokenBucket* RateLimiter::namespace_bucket(Peer& p, const std::string& command, clock::time_point now) {
+    if (m_ns_limits.empty())
+        return 0;
+
+    const std::string ns(command, 0, command.find('.'));
+    std::map<std::string, Limit>::const_iterator limit = m_ns_limits.find(ns);
+    if (limit == m_ns_limits.end())
+        return 0;
+
+    std::map<std::string, TokenBucket>::iterator b = p.namespaces.find(ns);
+    if (b == p.namespaces.end())
+        b = p.namespaces.insert(std::make_pair(ns, TokenBucket(limit->second.rate, limit->second.burst, now))).first;
+    return &b->second;
+}
+
+RateLimiter::Stats RateLimiter::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Stats st = m_stats;
+    st.peers = m_peers.size();
+
+    const clock::time_point now = clock::now();
+    for (peer_map::const_iterator it = m_peers.begin(); it != m_peers.end(); ++it)
+        if (now < it->second.blocked_until)
+            st.blocked_peers++;
+
+    return st;
+}
+
+void RateLimiter::sweep(clock::time_point now) {
+    m_admits_since_sweep = 0;
+
+    const clock::duration idle = std::chrono::milliseconds(IDLE_MS);
+    for (peer_map::iterator it = m_peers.begin(); it != m_peers.end(); )
+        if (now - it->second.last > idle && now >= it->second.blocked_until)
+            it = m_peers.erase(it);
+        else
+            ++it;
+}
+
+unsigned int RateLimiter::wait_ms(const TokenBucket& bucket, double needed, clock::time_point now) {
+    const double missing = needed - bucket.tokens(now);
+    if (missing <= 0 || bucket.rate() <= 0)
+        return 0;
+
+    return static_cast<unsigned int>(std::ceil(missing / bucket.rate() * 1000));
+}
+
+} // namespace xmppsc
+
+// End of File
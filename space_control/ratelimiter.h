@@ -0,0 +1,282 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RATELIMITER_H__
+#define RATELIMITER_H__
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <gloox/jid.h>
+
+namespace xmppsc {
+
+//! Token bucket for rate limiting.
+/*!
+ * The bucket holds up to burst tokens and is refilled with rate tokens
+ * per second. Each admitted event takes a token, so on average rate
+ * events per second pass, with bursts of up to burst events.
+ *
+ * The bucket is not thread-safe.
+ */
+class TokenBucket {
+public:
+    typedef std::chrono::steady_clock clock;
+
+    //! Create the bucket, initially full.
+    /*!
+     * \param rate  Tokens per second, 0 for no limit.
+     * \param burst Capacity of the bucket; at least one token.
+     * \param now   The current time.
+     */
+    TokenBucket(double rate = 0, double burst = 1, clock::time_point now = clock::now()) throw();
+
+    //! Change rate and capacity; the bucket is filled.
+    /*!
+     * \param now The current time.
+     */
+    void set(double rate, double burst, clock::time_point now = clock::now()) throw();
+
+    //! Change rate and capacity, keeping the available tokens.
+    /*!
+     * The tokens are limited to the new capacity; a bucket that had no
+     * limit is filled.
+     *
+     * \param now The current time.
+     */
+    void adjust(double rate, double burst, clock::time_point now = clock::now()) throw();
+
+    //! Take a token if available.
+    /*!
+     * \param now The current time.
+     * \returns false if the event exceeds the rate.
+     */
+    bool take(clock::time_point now = clock::now()) throw();
+
+    //! Get the tokens available at a time.
+    double tokens(clock::time_point now = clock::now()) const throw();
+
+    //! Get the rate in tokens per second, 0 for no limit.
+    double rate() const throw();
+
+    //! Get the capacity.
+    double burst() const throw();
+
+private:
+    double m_rate;
+    double m_burst;
+    double m_tokens;
+    clock::time_point m_last;
+};
+
+
+//! Rate limit for error responses.
+/*!
+ * Denied, malformed and oversized messages are answered at most at this
+ * rate, whichever transport they arrived on, so errors cannot be used to
+ * make the daemon send a multiple of the received traffic.
+ *
+ * The limiter is thread-safe.
+ */
+class ErrorLimiter {
+public:
+    //! Create the limiter.
+    /*!
+     * \param rate  Responses per second, 0 for no limit.
+     * \param burst Responses that may be sent at once.
+     */
+    ErrorLimiter(double rate = 0, double burst = 1) throw();
+
+    //! Change rate and burst.
+    void set(double rate, double burst) throw();
+
+    //! Check if an error response may be sent; counts suppressed ones.
+    bool admit() throw();
+
+    //! Get the number of error responses suppressed so far.
+    unsigned long suppressed() const throw();
+
+private:
+    TokenBucket m_bucket;
+    unsigned long m_suppressed;
+    mutable std::mutex m_mutex;
+
+    ErrorLimiter(const ErrorLimiter& other);
+    ErrorLimiter& operator=(const ErrorLimiter& other);
+};
+
+
+
+//! Rate limits for the commands of each peer.
+/*!
+ * Each peer, identified by its bare JID, has a token bucket for all its
+ * commands and one for each command namespace with a configured limit,
+ * e.g. "i2c" for "i2c.write8". A command is admitted if both buckets
+ * have a token.
+ *
+ * Peers that are refused too often within a time window are blocked
+ * for a while; their commands are dropped without an answer.
+ *
+ * The limiter is thread-safe.
+ */
+class RateLimiter {
+public:
+    typedef TokenBucket::clock clock;
+
+    //! Decision on a command.
+    enum Verdict {
+        //! The command may be handled
+        ADMITTED,
+        //! The rate has been exceeded, the peer should be told to retry later
+        BUSY,
+        //! The peer is blocked, the command should be dropped silently
+        BLOCKED
+    };
+
+    //! Counters.
+    struct Stats {
+        //! Admitted commands
+        unsigned long admitted;
+        //! Commands refused as busy
+        unsigned long busy;
+        //! Commands dropped from blocked peers
+        unsigned long dropped;
+        //! Number of times a peer has been blocked
+        unsigned long blocks;
+        //! Peers with state
+        size_t peers;
+        //! Currently blocked peers
+        size_t blocked_peers;
+    };
+
+    //! Create the limiter.
+    /*!
+     * \param rate  Commands per second per peer, 0 for no limit.
+     * \param burst Commands a peer may send at once.
+     */
+    RateLimiter(double rate, double burst);
+
+    //! Limit the commands of a namespace per peer.
+    /*!
+     * Applies to peers seen after the call.
+     *
+     * \param ns    The namespace without the trailing dot.
+     * \param rate  Commands per second per peer.
+     * \param burst Commands a peer may send at once.
+     */
+    void set_namespace_limit(const std::string& ns, double rate, double burst);
+
+    //! Block peers that are refused too often.
+    /*!
+     * \param strikes   Refused commands within the window that lead to a block, 0 to never block.
+     * \param window_ms The time window for counting in milliseconds.
+     * \param block_ms  The duration of a block in milliseconds.
+     */
+    void set_blocking(unsigned int strikes, unsigned int window_ms, unsigned int block_ms);
+
+    //! Take over the limits of another limiter, keeping the peer state.
+    /*!
+     * Rates, namespace limits and blocking are copied from the other
+     * limiter, e.g. one created from a reloaded configuration. Buckets,
+     * strikes and blocks of known peers are kept, so a reload neither
+     * refills the buckets nor lifts blocks. Namespace buckets without a
+     * limit in the other limiter are dropped.
+     *
+     * \param other The limiter with the new limits; its peer state is ignored.
+     * \param now   The current time.
+     */
+    void reconfigure(const RateLimiter& other, clock::time_point now = clock::now());
+
+    //! Decide on a command.
+    /*!
+     * \param peer     The sender.
+     * \param command  The command name.
+     * \param retry_ms Receives the time in milliseconds until the peer may retry, if not admitted.
+     * \param now      The current time.
+     */
+    Verdict admit(const gloox::JID& peer, const std::string& command, unsigned int* retry_ms = 0,
+                  clock::time_point now = clock::now());
+
+    //! Decide on the commands of an envelope as a whole.
+    /*!
+     * The commands are admitted if the buckets have tokens for all of
+     * them; otherwise no tokens are taken and the envelope counts as one
+     * refused command.
+     *
+     * \param peer     The sender.
+     * \param commands The command names.
+     * \param retry_ms Receives the time in milliseconds until the peer may retry, if not admitted.
+     * \param now      The current time.
+     */
+    Verdict admit(const gloox::JID& peer, const std::vector<std::string>& commands,
+                  unsigned int* retry_ms = 0, clock::time_point now = clock::now());
+
+    //! Get the counters.
+    Stats stats() const;
+
+    //! Idle time in milliseconds after which the state of a peer is dropped.
+    static const unsigned int IDLE_MS = 10 * 60 * 1000;
+
+private:
+    struct Limit {
+        Limit(double _rate = 0, double _burst = 1) : rate(_rate), burst(_burst) {}
+
+        double rate;
+        double burst;
+    };
+
+    struct Peer {
+        TokenBucket bucket;
+        std::map<std::string, TokenBucket> namespaces;
+        unsigned int strikes;
+        clock::time_point window_start;
+        clock::time_point blocked_until;
+        clock::time_point last;
+    };
+
+    typedef std::unordered_map<std::string, Peer> peer_map;
+
+    //! guards all members
+    mutable std::mutex m_mutex;
+    Limit m_limit;
+    std::map<std::string, Limit> m_ns_limits;
+    unsigned int m_strikes;
+    clock::duration m_window;
+    clock::duration m_block;
+    peer_map m_peers;
+    unsigned long m_admits_since_sweep;
+    Stats m_stats;
+
+    //! Decide on commands; the mutex must be held.
+    Verdict admit_locked(const gloox::JID& peer, const std::string* commands, size_t n,
+                         unsigned int* retry_ms, clock::time_point now);
+
+    //! Get the bucket of the namespace of a command, 0 if not limited.
+    TokenBucket* namespace_bucket(Peer& p, const std::string& command, clock::time_point now);
+
+    //! Drop the state of idle peers.
+    void sweep(clock::time_point now);
+
+    //! Milliseconds until a bucket has the tokens.
+    static unsigned int wait_ms(const TokenBucket& bucket, double needed, clock::time_point now);
+};
+
+}
+
+#endif // RATELIMITER_H__
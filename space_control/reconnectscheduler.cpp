@@ -0,0 +1,125 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "reconnectscheduler.h"
+
+#include <chrono>
+#include <cstdlib>
+
+#include <unistd.h>
+
+namespace xmppsc {
+
+bool ServerAddress::parse(const std::string& address) {
+    std::string::size_type colon;
+
+    if (!address.empty() && address[0] == '[') {
+        // IPv6 address in brackets
+        const std::string::size_type close = address.find(']');
+        if (close == std::string::npos)
+            return false;
+        host = address.substr(1, close - 1);
+
+        // nothing but the port may follow
+        if (close + 1 == address.size())
+            colon = std::string::npos;
+        else if (address[close + 1] == ':')
+            colon = close + 1;
+        else
+            return false;
+    } else {
+        colon = address.find(':');
+        host = address.substr(0, colon);
+    }
+
+    port = -1;
+    if (colon == std::string::npos)
+        return !host.empty();
+
+    const std::string p = address.substr(colon + 1);
+    char* end = 0;
+    const long value = strtol(p.c_str(), &end, 10);
+    if (p.empty() || *end || value < 1 || value > 65535)
+        return false;
+
+    port = value;
+    return !host.empty();
+}
+
+
+ReconnectScheduler::ReconnectScheduler(unsigned int initial_ms, unsigned int max_ms,
+                                       double factor, double jitter)
+    : m_initial_ms(initial_ms), m_max_ms(max_ms < initial_ms ? initial_ms : max_ms),
+      m_factor(factor < 1 ? 1 : factor), m_jitter(jitter < 0 ? 0 : (jitter > 1 ? 1 : jitter)),
+      m_current(0), m_failures(0), m_delay_ms(0),
+      m_random(std::chrono::steady_clock::now().time_since_epoch().count() ^ getpid()) {}
+
+void ReconnectScheduler::set_servers(const server_list& servers) {
+    m_servers = servers;
+    m_current = 0;
+}
+
+const ReconnectScheduler::server_list& ReconnectScheduler::servers() const throw() {
+    return m_servers;
+}
+
+unsigned int ReconnectScheduler::failed() {
+    // the first retry is immediate, with the same server
+    if (m_failures++ == 0)
+        return 0;
+
+    // try the next server
+    if (!m_servers.empty())
+        m_current = (m_current + 1) % m_servers.size();
+
+    if (m_delay_ms == 0)
+        m_delay_ms = m_initial_ms;
+    else if ((m_delay_ms *= m_factor) > m_max_ms)
+        m_delay_ms = m_max_ms;
+
+    // vary by +/- jitter
+    std::uniform_real_distribution<double> dist(1 - m_jitter, 1 + m_jitter);
+    return static_cast<unsigned int>(m_delay_ms * dist(m_random));
+}
+
+void ReconnectScheduler::succeeded() throw() {
+    m_failures = 0;
+    m_delay_ms = 0;
+}
+
+unsigned int ReconnectScheduler::failures() const throw() {
+    return m_failures;
+}
+
+const ServerAddress* ReconnectScheduler::server() const throw() {
+    return m_servers.empty() ? 0 : &m_servers[m_current];
+}
+
+void ReconnectScheduler::apply(gloox::Client* client) const {
+    const ServerAddress* srv = server();
+    if (!srv)
+        return;
+
+    client->setServer(srv->host);
+    client->setPort(srv->port);
+
+    // the connection has been created with the previous server
+    if (client->connectionImpl())
+        client->connectionImpl()->setServer(srv->host, srv->port);
+}
+
+} // namespace xmppsc
+
+// End of File
@@ -0,0 +1,115 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECONNECTSCHEDULER_H__
+#define RECONNECTSCHEDULER_H__
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gloox/client.h>
+
+namespace xmppsc {
+
+//! Address of an XMPP server.
+struct ServerAddress {
+    ServerAddress() : port(-1) {}
+    ServerAddress(const std::string& _host, int _port) : host(_host), port(_port) {}
+
+    //! Parse "host", "host:port" or "[v6-address]:port".
+    /*!
+     * \returns false if the host is empty, the port is not valid or
+     *          anything else follows the closing bracket.
+     */
+    bool parse(const std::string& address);
+
+    std::string host;
+    //! The port, -1 for the default or a DNS SRV lookup
+    int port;
+};
+
+
+//! Delays and server selection for reconnecting to XMPP servers.
+/*!
+ * After the first failure the client reconnects immediately to the same
+ * server, so a short network glitch costs neither waiting time nor a
+ * failover. Further failures wait with an exponential backoff up to a
+ * maximal delay; each delay is varied by a random jitter, so several
+ * clients do not reconnect in lockstep. From the second failure on, each
+ * failure moves on to the next configured server.
+ *
+ * Call succeeded() when a session has been established to start over.
+ */
+class ReconnectScheduler {
+public:
+    typedef std::vector<ServerAddress> server_list;
+
+    //! Create a scheduler.
+    /*!
+     * \param initial_ms The delay after the second failure.
+     * \param max_ms     The maximal delay.
+     * \param factor     The growth of the delay per failure.
+     * \param jitter     The relative random variation of each delay, 0 to 1.
+     */
+    ReconnectScheduler(unsigned int initial_ms = 1000, unsigned int max_ms = 60000,
+                       double factor = 2.0, double jitter = 0.2);
+
+    //! Set the servers to rotate through.
+    /*!
+     * If the list is empty, the server of the client is not changed.
+     */
+    void set_servers(const server_list& servers);
+
+    //! Get the server list.
+    const server_list& servers() const throw();
+
+    //! Record a failed connection attempt or a lost connection.
+    /*!
+     * \returns the delay until the next attempt in milliseconds.
+     */
+    unsigned int failed();
+
+    //! Record an established session; the next failure is retried immediately.
+    void succeeded() throw();
+
+    //! Get the number of failures since the last success.
+    unsigned int failures() const throw();
+
+    //! Get the server for the next attempt.
+    /*!
+     * \returns the server or 0 if no servers are set.
+     */
+    const ServerAddress* server() const throw();
+
+    //! Configure the client and its connection for the next attempt.
+    void apply(gloox::Client* client) const;
+
+private:
+    const unsigned int m_initial_ms;
+    const unsigned int m_max_ms;
+    const double m_factor;
+    const double m_jitter;
+
+    server_list m_servers;
+    size_t m_current;
+    unsigned int m_failures;
+    double m_delay_ms;
+    std::minstd_rand m_random;
+};
+
+}
+
+#endif // RECONNECTSCHEDULER_H__
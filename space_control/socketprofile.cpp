@@ -0,0 +1,106 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "socketprofile.h"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+namespace {
+
+// sets an option, remembers the name of the first that fails
+class OptionSetter {
+public:
+    OptionSetter(int fd) : m_fd(fd), m_failed(0) {}
+
+    void set(int level, int name, int value, const char* option) throw() {
+        if (setsockopt(m_fd, level, name, &value, sizeof(value)) != 0 && !m_failed)
+            m_failed = option;
+    }
+
+    void fail(const char* option) throw() {
+        if (!m_failed)
+            m_failed = option;
+    }
+
+    const char* failed() const throw() {
+        return m_failed;
+    }
+
+private:
+    const int m_fd;
+    const char* m_failed;
+};
+
+} // anonymous namespace
+
+namespace xmppsc {
+
+SocketProfile::SocketProfile()
+    : nodelay(true), quickack(true),
+      keepalive_idle(0), keepalive_interval(0), keepalive_count(0),
+      sndbuf(0), rcvbuf(0), busy_poll(0) {}
+
+bool SocketProfile::apply(int fd, const char** failed) const throw() {
+    if (fd < 0)
+        return false;
+
+    OptionSetter opt(fd);
+
+    if (nodelay)
+        opt.set(IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+
+    if (quickack)
+        opt.set(IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+
+    if (keepalive_idle > 0) {
+        opt.set(SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+        opt.set(IPPROTO_TCP, TCP_KEEPIDLE, keepalive_idle, "TCP_KEEPIDLE");
+        if (keepalive_interval > 0)
+            opt.set(IPPROTO_TCP, TCP_KEEPINTVL, keepalive_interval, "TCP_KEEPINTVL");
+        if (keepalive_count > 0)
+            opt.set(IPPROTO_TCP, TCP_KEEPCNT, keepalive_count, "TCP_KEEPCNT");
+    }
+
+    if (sndbuf > 0)
+        opt.set(SOL_SOCKET, SO_SNDBUF, sndbuf, "SO_SNDBUF");
+
+    if (rcvbuf > 0)
+        opt.set(SOL_SOCKET, SO_RCVBUF, rcvbuf, "SO_RCVBUF");
+
+#ifdef SO_BUSY_POLL
+    if (busy_poll > 0)
+        opt.set(SOL_SOCKET, SO_BUSY_POLL, busy_poll, "SO_BUSY_POLL");
+#else
+    if (busy_poll > 0)
+        opt.fail("SO_BUSY_POLL");
+#endif
+
+    if (failed)
+        *failed = opt.failed();
+    return !opt.failed();
+}
+
+void SocketProfile::rearm(int fd) const throw() {
+    if (quickack && fd >= 0) {
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+    }
+}
+
+} // namespace xmppsc
+
+// End of File
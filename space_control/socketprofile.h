@@ -0,0 +1,61 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOCKETPROFILE_H__
+#define SOCKETPROFILE_H__
+
+namespace xmppsc {
+
+//! Socket options for the XMPP connection.
+/*!
+ * The defaults favour latency for small command and response stanzas:
+ * Nagle's algorithm is disabled and ACKs are sent immediately. Values of
+ * 0 keep the system default.
+ */
+struct SocketProfile {
+    SocketProfile();
+
+    //! Apply the options to a connected TCP socket.
+    /*!
+     * \param fd     The socket.
+     * \param failed Receives the name of the first option that could not be set, if not 0.
+     * \returns false if an option could not be set; the others are set anyway.
+     */
+    bool apply(int fd, const char** failed = 0) const throw();
+
+    //! Re-arm TCP_QUICKACK, which the kernel resets after some ACKs.
+    void rearm(int fd) const throw();
+
+    //! Disable Nagle's algorithm (TCP_NODELAY).
+    bool nodelay;
+    //! Send ACKs immediately (TCP_QUICKACK).
+    bool quickack;
+    //! Seconds of idle time until TCP keepalive probes are sent, 0 for no TCP keepalive.
+    int keepalive_idle;
+    //! Seconds between keepalive probes.
+    int keepalive_interval;
+    //! Number of unanswered probes until the connection is dropped.
+    int keepalive_count;
+    //! Send buffer size in bytes (SO_SNDBUF).
+    int sndbuf;
+    //! Receive buffer size in bytes (SO_RCVBUF).
+    int rcvbuf;
+    //! Busy polling time in microseconds (SO_BUSY_POLL), trades CPU for latency.
+    int busy_poll;
+};
+
+}
+
+#endif // SOCKETPROFILE_H__
@@ -16,6 +16,85 @@
 #include "spacecommand.h"
 
 #include <sstream>
+#include <cstring>
+#include <cctype>
+#include <climits>
+#include <new>
+#include <utility>
+
+namespace {
+
+//! Parse the parameter line count in [b, e)
+/*!
+ * Same results as strtol(.., 0, 10) on a copy of the range, i.e. leading
+ * white space and a sign are accepted, parsing stops at the first non-digit
+ * and 0 is returned if there are no digits at all.
+ */
+inline int parse_line_count(const char* b, const char* e) {
+    while (b != e && isspace(static_cast<unsigned char>(*b)))
+        b++;
+
+    bool neg = false;
+    if (b != e && (*b == '+' || *b == '-'))
+        neg = (*b++ == '-');
+
+    unsigned long v = 0;
+    for (; b != e && *b >= '0' && *b <= '9'; b++) {
+        const unsigned long d = *b - '0';
+        if (v > (static_cast<unsigned long>(LONG_MAX) - d) / 10) {
+            // saturate like strtol
+            v = neg ? static_cast<unsigned long>(LONG_MAX) + 1 : LONG_MAX;
+            break;
+        }
+        v = v * 10 + d;
+    }
+
+    const long l = neg ? -static_cast<long>(v - 1) - 1 : static_cast<long>(v);
+    return static_cast<int>(l);
+}
+
+//! Count the lines of a parameter value
+/*!
+ * An empty value has no lines, otherwise there is one line more than
+ * there are newline characters.
+ */
+inline size_t count_lines(const std::string& value) {
+    if (value.empty())
+        return 0;
+
+    size_t lines = 1;
+    const char* pos = value.data();
+    const char* const end = pos + value.size();
+    while ((pos = static_cast<const char*>(memchr(pos, '\n', end - pos)))) {
+        lines++;
+        pos++;
+    }
+
+    return lines;
+}
+
+//! Number of decimal digits of a value
+inline size_t decimal_digits(size_t v) {
+    size_t digits = 1;
+    while (v >= 10) {
+        v /= 10;
+        digits++;
+    }
+    return digits;
+}
+
+//! Append a value in decimal notation without going through a stream.
+inline void append_decimal(std::string& s, size_t v) {
+    char buf[24];
+    char* p = buf + sizeof(buf);
+    do {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    s.append(p, buf + sizeof(buf));
+}
+
+} // anonymous namespace
 
 namespace xmppsc {
   
@@ -89,6 +168,126 @@ const char* IllegalCommandParameterException::reason() const throw()
 }
 
 
+SpaceCommandParams::SpaceCommandParams() {}
+
+SpaceCommandParams::size_type SpaceCommandParams::lower_bound(const char* key, size_t len) const {
+    // binary search with std::string::compare semantics
+    size_type lo = 0;
+    size_type hi = m_params.size();
+    while (lo < hi) {
+        const size_type mid = (lo + hi) / 2;
+        const std::string& name = m_params[mid].first;
+        const size_t n = name.size() < len ? name.size() : len;
+        int c = memcmp(name.data(), key, n);
+        if (!c)
+            c = name.size() < len ? -1 : (name.size() > len ? 1 : 0);
+
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+std::string& SpaceCommandParams::get(const char* key, size_t len) {
+    const size_type pos = lower_bound(key, len);
+    if (pos < m_params.size() && m_params[pos].first.compare(0, std::string::npos, key, len) == 0)
+        return m_params[pos].second;
+
+    if (m_params.empty())
+        m_params.reserve(INLINE_CAPACITY);
+
+    value_type p;
+    p.first.assign(key, len);
+    return m_params.insert(m_params.begin() + pos, std::move(p))->second;
+}
+
+std::string& SpaceCommandParams::operator[](const std::string& key) {
+    return get(key.data(), key.size());
+}
+
+std::string& SpaceCommandParams::operator[](const char* key) {
+    return get(key, strlen(key));
+}
+
+SpaceCommandParams::const_iterator SpaceCommandParams::find(const std::string& key) const {
+    const size_type pos = lower_bound(key.data(), key.size());
+    if (pos < m_params.size() && m_params[pos].first == key)
+        return m_params.begin() + pos;
+    return m_params.end();
+}
+
+SpaceCommandParams::const_iterator SpaceCommandParams::find(const char* key) const {
+    const size_t len = strlen(key);
+    const size_type pos = lower_bound(key, len);
+    if (pos < m_params.size() && m_params[pos].first.compare(0, std::string::npos, key, len) == 0)
+        return m_params.begin() + pos;
+    return m_params.end();
+}
+
+SpaceCommandParams::size_type SpaceCommandParams::count(const std::string& key) const {
+    return find(key) != end() ? 1 : 0;
+}
+
+SpaceCommandParams::size_type SpaceCommandParams::erase(const std::string& key) {
+    const size_type pos = lower_bound(key.data(), key.size());
+    if (pos < m_params.size() && m_params[pos].first == key) {
+        m_params.erase(m_params.begin() + pos);
+        return 1;
+    }
+    return 0;
+}
+
+SpaceCommandParams::const_iterator SpaceCommandParams::begin() const {
+    return m_params.begin();
+}
+
+SpaceCommandParams::const_iterator SpaceCommandParams::end() const {
+    return m_params.end();
+}
+
+SpaceCommandParams::const_iterator SpaceCommandParams::cbegin() const {
+    return m_params.begin();
+}
+
+SpaceCommandParams::const_iterator SpaceCommandParams::cend() const {
+    return m_params.end();
+}
+
+SpaceCommandParams::size_type SpaceCommandParams::size() const {
+    return m_params.size();
+}
+
+bool SpaceCommandParams::empty() const {
+    return m_params.empty();
+}
+
+void SpaceCommandParams::clear() {
+    m_params.clear();
+}
+
+void SpaceCommandParams::reserve(size_type n) {
+    m_params.reserve(n);
+}
+
+bool SpaceCommandParams::operator==(const SpaceCommandParams& other) const {
+    if (m_params.size() != other.m_params.size())
+        return false;
+
+    for (size_type i = 0; i < m_params.size(); i++)
+        if (m_params[i].first != other.m_params[i].first ||
+                m_params[i].second != other.m_params[i].second)
+            return false;
+
+    return true;
+}
+
+bool SpaceCommandParams::operator!=(const SpaceCommandParams& other) const {
+    return !(*this == other);
+}
+
+
 SpaceCommand::SpaceCommand(const std::string& _cmd,
                            const space_command_params& _params) throw()
     : m_cmd(_cmd), m_params(_params) {}
@@ -96,6 +295,14 @@ SpaceCommand::SpaceCommand(const std::string& _cmd,
 SpaceCommand::SpaceCommand(const SpaceCommand& other)
     : m_cmd(other.m_cmd), m_params(other.m_params) {}
 
+#ifdef COMPILER_SUPPORTS_CXX11
+SpaceCommand::SpaceCommand(std::string&& _cmd, space_command_params&& _params) throw()
+    : m_cmd(std::move(_cmd)), m_params(std::move(_params)) {}
+
+SpaceCommand::SpaceCommand(SpaceCommand&& other) throw()
+    : m_cmd(std::move(other.m_cmd)), m_params(std::move(other.m_params)) {}
+#endif // COMPILER_SUPPORTS_CXX11
+
 const std::string& SpaceCommand::cmd() const throw() {
     return this->m_cmd;
 }
@@ -110,10 +317,24 @@ throw(MissingCommandParameterException) {
     return it->second;
 }
 
+const std::string& SpaceCommand::param(const char* key) const
+throw(MissingCommandParameterException) {
+    space_command_params::const_iterator it = m_params.find(key);
+
+    if (it == m_params.end())
+        throw MissingCommandParameterException(key);
+
+    return it->second;
+}
+
 bool SpaceCommand::param_available(const std::string& key) const throw() {
     return m_params.find(key) != m_params.end();
 }
 
+bool SpaceCommand::param_available(const char* key) const throw() {
+    return m_params.find(key) != m_params.end();
+}
+
 
 const SpaceCommand::space_command_params& SpaceCommand::params() const throw() {
     return m_params;
@@ -122,6 +343,14 @@ const SpaceCommand::space_command_params& SpaceCommand::params() const throw() {
 
 SpaceCommandSerializer::~SpaceCommandSerializer() {}
 
+bool SpaceCommandSerializer::recognizes(const std::string& body) const throw() {
+    return false;
+}
+
+bool SpaceCommandSerializer::peek(const std::string& body, std::string& cmd, std::string& threadId) const throw() {
+    return false;
+}
+
 
 
 TextSpaceCommandSerializer::TextSpaceCommandSerializer() {}
@@ -129,46 +358,63 @@ TextSpaceCommandSerializer::TextSpaceCommandSerializer() {}
 TextSpaceCommandSerializer::~TextSpaceCommandSerializer() {}
 
 std::string TextSpaceCommandSerializer::to_body(const SpaceCommand& cmd, const std::string& threadId) const {
-
-    // build parameter list
-    std::stringstream pars("");
-
-    SpaceCommand::space_command_params params = cmd.params();
+    const SpaceCommand::space_command_params& params = cmd.params();
     SpaceCommand::space_command_params::const_iterator iter;
 
-    for (iter =  params.begin(); iter != params.end(); iter++) {
-        // count lines in parameter value
-        int paramlines = 0;
-
-        if (iter->second.empty())
-            paramlines = 0;
-        else {
-            paramlines = 1;
-            const char* val = iter->second.c_str();
-            int i;
-            for (i = iter->second.size(); i; i--)
-                if (val[i] == '\n')
-                    paramlines++;
-        }
+    // first pass: compute the exact body size
+    size_t size = cmd.cmd().size() + 1 + threadId.size();
+    for (iter = params.begin(); iter != params.end(); ++iter) {
+        // "\n<lines> <key>\n<value>"
+        size += 1 + decimal_digits(count_lines(iter->second)) + 1
+                + iter->first.size() + 1 + iter->second.size();
+    }
 
-        if (!pars.str().empty())
-            pars << std::endl;
-        pars << paramlines << " " << iter->first << std::endl;
-        pars << iter->second;
+    // second pass: write into the reserved buffer
+    // (counting the lines again is cheaper than storing the counts)
+    std::string body;
+    body.reserve(size);
+
+    body.append(cmd.cmd());
+    body.push_back('\n');
+    body.append(threadId);
+
+    for (iter = params.begin(); iter != params.end(); ++iter) {
+        body.push_back('\n');
+        append_decimal(body, count_lines(iter->second));
+        body.push_back(' ');
+        body.append(iter->first);
+        body.push_back('\n');
+        body.append(iter->second);
     }
 
+    return body;
+}
 
-    // build message body
-    std::stringstream body;
-    body << cmd.cmd() << std::endl;
-    body << threadId;
-    if (!pars.str().empty())
-        body << std::endl << pars.str();
+bool TextSpaceCommandSerializer::peek(const std::string& body, std::string& cmd, std::string& threadId) const throw() {
+    const char* pos = body.data();
+    const char* const end = pos + body.size();
+    const char* lb;
+    const char* le;
+
+    if (!next_line(pos, end, lb, le))
+        return false;
+
+    try {
+        cmd.assign(lb, le);
+
+        // a command without thread ID line has an empty thread ID
+        if (next_line(pos, end, lb, le))
+            threadId.assign(lb, le);
+        else
+            threadId.clear();
+    } catch (const std::bad_alloc& ba) {
+        return false;
+    }
 
-    return body.str();
+    return true;
 }
 
-TextSpaceCommandSerializer::Incoming TextSpaceCommandSerializer::to_command(const std::string body)
+TextSpaceCommandSerializer::Incoming TextSpaceCommandSerializer::to_command(const std::string& body)
 throw(SpaceCommandFormatException) {
     // the command
     std::string command;
@@ -177,64 +423,108 @@ throw(SpaceCommandFormatException) {
     // the parameter map
     SpaceCommand::space_command_params params;
 
-    //parse command and params from msg body
+    // parse command and params from msg body in a single forward scan
+    // (line slices point into the body, values are copied exactly once)
     int line_number = 0;
-    std::stringstream ss(body);
-    std::string line;
-    while (std::getline(ss, line, '\n')) {
+    const char* pos = body.data();
+    const char* const end = pos + body.size();
+    const char* lb;
+    const char* le;
+    while (next_line(pos, end, lb, le)) {
         line_number++;
 
         // first line is command
         if (line_number == 1)
-            command = line;
+            command.assign(lb, le);
         // second line is the thread Id
         else if (line_number == 2)
-            threadId = line;
+            threadId.assign(lb, le);
         else {
-            /* Note: std::stoi is not available yet :(
-             *
-             *            // split the parameter line
-             *            const size_t idx = 0;
-             *            // first is the number of lines containing the value
-             *            const int parlines = std::stoi(line, &idx);
-             *            // after the space is the parameter name
-             *            const std::string key = line.substr(idx+1);
-             */
-
             // find the space character
-            const size_t idx = line.find(' ');
-            if (idx == std::string::npos)
+            const char* sp = static_cast<const char*>(memchr(lb, ' ', le - lb));
+            if (!sp)
                 throw SpaceCommandFormatException("Missing space character in parameter key line.", body, line_number);
 
             // get the number of parameter lines
-            const std::string s_parlines = line.substr(0, idx);
-            int parlines = strtol(s_parlines.c_str(), 0, 10);
+            int parlines = parse_line_count(lb, sp);
             if (parlines == 0)
                 throw SpaceCommandFormatException("Invalid integer for parameter line count.", body, line_number);
 
             // get the parameter key
-            const std::string key = line.substr(idx+1);
+            const std::string key(sp + 1, le);
 
-            // get the parameter lines
-            std::string value;
+            // the parameter lines are contiguous in the body, just find their end
+            const char* vb = pos;
+            const char* ve = pos;
             while (parlines--) {
-                std::string parline;
-                if (!std::getline(ss, parline, '\n'))
+                const char* pb;
+                if (!next_line(pos, end, pb, ve))
                     throw SpaceCommandFormatException("There are less lines that stated in the parameter line count!", body, line_number);
                 line_number++;
-
-                if (!value.empty())
-                    value.append("\n");
-                value.append(parline);
             }
 
             // add to parameter map
-            params[key] = value;
+            params[key].assign(vb, ve);
+            if (params.size() > MAX_PARAMS)
+                throw SpaceCommandFormatException("Too many parameters.", body, line_number);
         }
     }
 
     // create the command
-    return Incoming(threadId, SpaceCommand(command, params));
+    return Incoming(std::move(threadId), SpaceCommand(std::move(command), std::move(params)));
+}
+
+
+const char SpaceCommandEnvelope::COMMAND[] = "envelope";
+
+bool SpaceCommandEnvelope::is_envelope(const SpaceCommand& cmd) throw() {
+    return cmd.cmd() == COMMAND;
+}
+
+SpaceCommand SpaceCommandEnvelope::pack(const batch& cmds, const SpaceCommandSerializer& ser) {
+    SpaceCommand::space_command_params params;
+
+    std::string key;
+    for (size_t i = 0; i < cmds.size(); i++) {
+        key.clear();
+        append_decimal(key, i);
+        params[key] = ser.to_body(cmds[i].second, cmds[i].first);
+    }
+
+    return SpaceCommand(COMMAND, std::move(params));
+}
+
+SpaceCommandEnvelope::batch SpaceCommandEnvelope::unpack(const SpaceCommand& envelope,
+        SpaceCommandSerializer& ser, const std::string& body)
+throw(SpaceCommandFormatException) {
+    const SpaceCommand::space_command_params& params = envelope.params();
+
+    // order the inner bodies by their index
+    std::vector<const std::string*> bodies(params.size(), 0);
+    SpaceCommand::space_command_params::const_iterator iter;
+    for (iter = params.begin(); iter != params.end(); ++iter) {
+        const std::string& key = iter->first;
+
+        size_t idx = 0;
+        bool valid = !key.empty() && key.size() < 10 && (key == "0" || key[0] != '0');
+        for (std::string::const_iterator k = key.begin(); valid && k != key.end(); ++k) {
+            valid = *k >= '0' && *k <= '9';
+            idx = idx * 10 + (*k - '0');
+        }
+
+        if (!valid || idx >= bodies.size())
+            throw SpaceCommandFormatException("Invalid envelope index: " + key, body, 0);
+
+        bodies[idx] = &iter->second;
+    }
+
+    // parse the inner bodies
+    batch cmds;
+    cmds.reserve(bodies.size());
+    for (std::vector<const std::string*>::const_iterator b = bodies.begin(); b != bodies.end(); ++b)
+        cmds.push_back(ser.to_command(**b));
+
+    return cmds;
 }
 
 } // namespace xmppsc
@@ -18,9 +18,12 @@
 #ifndef SPACECOMMAND_H__
 #define SPACECOMMAND_H__
 
+#include <cstring>
 #include <stdexcept>
 #include <string>
-#include <map>
+#include <vector>
+
+#include "messagearena.h"
 
 namespace xmppsc {
   
@@ -132,6 +135,85 @@ private:
     std::string m_what;
 };
 
+//! Flat parameter storage for Space Commands.
+/*!
+ * The parameters are kept sorted by name in one contiguous block, which is
+ * reserved for INLINE_CAPACITY parameters on the first insertion. Building,
+ * copying and querying a typical command thus costs one allocation for the
+ * whole parameter set instead of one tree node per parameter; the well-known
+ * names ("device", "register", "data", "response", ...) and short hex values
+ * fit into the string's internal buffer.
+ *
+ * Within a MessageArenaScope the parameter block is taken from the arena.
+ *
+ * The interface is the subset of std::map used for parameter maps, so the
+ * storage can be used in place of the former map. Lookups accept plain C
+ * strings to avoid temporary key strings. Iteration is read-only, use
+ * operator[] to add or change parameters.
+ */
+class SpaceCommandParams {
+public:
+    //! A parameter, first is the name and second the value.
+    struct value_type {
+        std::string first;
+        std::string second;
+    };
+
+    //! The parameter block, allocated from the active MessageArena if any.
+    typedef std::vector<value_type, ArenaAllocator<value_type> > storage;
+
+    typedef storage::const_iterator const_iterator;
+    typedef const_iterator iterator;
+    typedef storage::size_type size_type;
+
+    //! Number of parameters reserved on the first insertion.
+    static const size_type INLINE_CAPACITY = 6;
+
+    SpaceCommandParams();
+
+    //! Get the value for a name, insert an empty value if not yet available.
+    std::string& operator[](const std::string& key);
+    std::string& operator[](const char* key);
+
+    //! Find a parameter.
+    /*!
+     * \returns an iterator to the parameter or end()
+     */
+    const_iterator find(const std::string& key) const;
+    const_iterator find(const char* key) const;
+
+    //! Number of parameters with the name, i.e. 0 or 1.
+    size_type count(const std::string& key) const;
+
+    //! Remove a parameter.
+    /*!
+     * \returns the number of removed parameters, i.e. 0 or 1.
+     */
+    size_type erase(const std::string& key);
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+
+    size_type size() const;
+    bool empty() const;
+    void clear();
+    void reserve(size_type n);
+
+    bool operator==(const SpaceCommandParams& other) const;
+    bool operator!=(const SpaceCommandParams& other) const;
+
+private:
+    storage m_params;
+
+    //! Position of the first parameter not less than the key.
+    size_type lower_bound(const char* key, size_t len) const;
+
+    //! Get or insert the value for a key.
+    std::string& get(const char* key, size_t len);
+};
+
 //! Space Command representation.
 /*!
  * This class represents a Space Command, consisting of the issuing/receiving
@@ -142,7 +224,7 @@ private:
 class SpaceCommand {
 public:
     //! Convenience typedef for the parameter map.
-    typedef std::map<const std::string, std::string> space_command_params;
+    typedef SpaceCommandParams space_command_params;
 
     //! Create a new Space Command representation.
     /*!
@@ -154,6 +236,14 @@ public:
     //! Copy constructor.
     SpaceCommand(const SpaceCommand& other);
 
+#ifdef COMPILER_SUPPORTS_CXX11
+    //! Create a new Space Command, taking over name and parameters.
+    SpaceCommand(std::string&& _cmd, space_command_params&& _params) throw();
+
+    //! Move constructor.
+    SpaceCommand(SpaceCommand&& other) throw();
+#endif // COMPILER_SUPPORTS_CXX11
+
     //! Get the command name.
     /*!
      * \returns The command name
@@ -168,6 +258,8 @@ public:
      */
     const std::string& param(const std::string& key) const
     throw(MissingCommandParameterException);
+    const std::string& param(const char* key) const
+    throw(MissingCommandParameterException);
 
     //! Check if a parameter is available
     /*!
@@ -175,6 +267,7 @@ public:
      * \returns true, if the parameter is available, otherwise false
      */
     bool param_available(const std::string& key) const throw();
+    bool param_available(const char* key) const throw();
 
     //! Direct access to the parameter map.
     /*!
@@ -183,8 +276,9 @@ public:
     const space_command_params& params() const throw();
 
 private:
-    const std::string m_cmd;
-    const space_command_params m_params;
+    // not const to allow moving, the class is still immutable
+    std::string m_cmd;
+    space_command_params m_params;
 };
 
 //! Interface to a Space Command serializer
@@ -192,6 +286,14 @@ class SpaceCommandSerializer {
 public:
     typedef std::pair<std::string, SpaceCommand> Incoming;
 
+    //! Maximal number of parameters in a received command.
+    /*!
+     * Parameters are kept sorted, so each insertion is linear in the
+     * number of parameters. The limit keeps a large body from costing
+     * quadratic time; it also limits the commands in an envelope.
+     */
+    static const size_t MAX_PARAMS = 256;
+
     virtual ~SpaceCommandSerializer() = 0;
 
     //! Serialize a Space Command for sending
@@ -207,8 +309,35 @@ public:
      * \returns pointer to the created command
      * \throws SpaceCommandFormatException if the body cannot be de-serialized
      */
-    virtual Incoming to_command(const std::string body)
+    virtual Incoming to_command(const std::string& body)
     throw(SpaceCommandFormatException) = 0;
+
+    //! Check if a message body is in the format of this serializer.
+    /*!
+     * Used to pick the serializer for incoming messages if more than one
+     * format is in use. The default implementation does not recognize any
+     * body, i.e. the serializer can only be used as fallback.
+     *
+     * \param body The message body.
+     * \returns true if the body is recognized as this serializer's format.
+     */
+    virtual bool recognizes(const std::string& body) const throw();
+
+    //! Get the command name and thread ID without parsing the whole body.
+    /*!
+     * Used to decide on a message before it is deserialized. The body is
+     * not validated, so a successful peek does not mean that to_command()
+     * succeeds. The default implementation cannot peek.
+     *
+     * Implementations must not throw, a failed allocation is reported as
+     * a body that cannot be peeked into.
+     *
+     * \param body     The message body.
+     * \param cmd      Receives the command name.
+     * \param threadId Receives the thread ID.
+     * \returns false if the body cannot be peeked into.
+     */
+    virtual bool peek(const std::string& body, std::string& cmd, std::string& threadId) const throw();
 };
 
 
@@ -221,7 +350,77 @@ public:
 
     virtual std::string to_body(const SpaceCommand& cmd, const std::string& threadId) const;
 
-    virtual Incoming to_command(const std::string body)
+    //! Parse a text message body.
+    /*!
+     * The body is scanned once, parameter values are sliced from the body
+     * and copied only once into the parameter map.
+     */
+    virtual Incoming to_command(const std::string& body)
+    throw(SpaceCommandFormatException);
+
+    //! Read the first two lines.
+    virtual bool peek(const std::string& body, std::string& cmd, std::string& threadId) const throw();
+};
+
+
+//! Get the next line of a text message body.
+/*!
+ * Behaves like std::getline on the range [pos, end), but does not copy:
+ * the line is returned as the slice [lb, le) and pos is moved behind the
+ * terminating newline.
+ *
+ * \returns false if there are no more lines.
+ */
+inline bool next_line(const char*& pos, const char* end, const char*& lb, const char*& le) {
+    if (pos == end)
+        return false;
+
+    lb = pos;
+    const char* nl = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+    le = nl ? nl : end;
+    pos = nl ? nl + 1 : end;
+
+    return true;
+}
+
+
+//! Envelope for batches of Space Commands
+/*!
+ * An envelope is a Space Command that carries several serialized Space
+ * Commands in one message body. The commands are stored as parameters
+ * "0" to "N-1", each value is the body of the command as created by the
+ * serializer of the envelope, including its own thread ID. A received
+ * envelope carries at most SpaceCommandSerializer::MAX_PARAMS commands.
+ */
+class SpaceCommandEnvelope {
+public:
+    //! The command name of envelopes.
+    static const char COMMAND[];
+
+    //! A batch of commands with their thread IDs.
+    typedef std::vector<SpaceCommandSerializer::Incoming> batch;
+
+    //! Check if a command is an envelope.
+    static bool is_envelope(const SpaceCommand& cmd) throw();
+
+    //! Pack a batch of commands into an envelope.
+    /*!
+     * \param cmds The commands with their thread IDs.
+     * \param ser  The serializer for the inner command bodies.
+     * \returns the envelope command
+     */
+    static SpaceCommand pack(const batch& cmds, const SpaceCommandSerializer& ser);
+
+    //! Unpack the commands from an envelope.
+    /*!
+     * \param envelope The envelope command.
+     * \param ser      The serializer for the inner command bodies.
+     * \param body     The envelope message body for error reports.
+     * \returns the commands in their original order
+     * \throws SpaceCommandFormatException if the envelope or an inner body is malformed.
+     */
+    static batch unpack(const SpaceCommand& envelope, SpaceCommandSerializer& ser,
+                        const std::string& body)
     throw(SpaceCommandFormatException);
 };
 
@@ -17,41 +17,78 @@
 //TODO fix the newline specification
 
 #include "spacecontrolclient.h"
+#include "admission.h"
+#include "util.h"
 
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <cstdlib>
+#include <utility>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 #include <gloox/messagesession.h>
 
 
+namespace {
+
+// the worker pool key of the device of a command, if it has one
+bool device_key(const xmppsc::SpaceCommand& cmd, size_t& key) {
+    if (!cmd.param_available("device"))
+        return false;
+
+    // "0x20", "20" and "0020" are the same device
+    const std::string& device = cmd.param("device");
+    unsigned int address;
+    if (xmppsc::parse_hex(device, address))
+        key = address;
+    else
+        // the handler rejects the value anyway
+        key = std::hash<std::string>()(device);
+
+    return true;
+}
+
+// the worker pool key of commands without a device
+size_t thread_key(const gloox::JID& peer, const std::string& threadId) {
+    std::string key(peer.full());
+    key += '\n';
+    key += threadId;
+    return std::hash<std::string>()(key);
+}
+
+} // anonymous namespace
+
+
 namespace xmppsc {
 
 // local helper class
+// The sink refers to thread ID and peer, which must outlive the sink; this
+// avoids copies on the message path. See OwnedSink for a self-contained sink.
 class Sink : public SpaceCommandSink {
 public:
     //TODO null ptr exception
-    Sink(const std::string& threadId, const gloox::JID peer, gloox::Client* client, const SpaceCommandSerializer* ser)
-        : m_threadId(threadId), m_peer(peer), m_client(client), m_ser(ser) {}
+    Sink(const std::string& threadId, const gloox::JID& peer, SpaceControlClient* scc,
+         const SpaceCommandSerializer* ser)
+        : m_threadId(threadId), m_peer(peer), m_scc(scc), m_ser(ser) {}
     virtual ~Sink() {}
 
+    using SpaceCommandSink::sendSpaceCommand;
     virtual void sendSpaceCommand(const SpaceCommand& sc);
 
     virtual const std::string& threadId() const throw();
 
 private:
-    const std::string m_threadId;
-    const gloox::JID m_peer;
-    gloox::Client* m_client;
+    const std::string& m_threadId;
+    const gloox::JID& m_peer;
+    SpaceControlClient* m_scc;
     const SpaceCommandSerializer* m_ser;
 };
 
 void Sink::sendSpaceCommand(const SpaceCommand& sc) {
-    std::string body(m_ser->to_body(sc, m_threadId));
-    gloox::Message m(gloox::Message::Chat, m_peer, body);
-
-    m_client->send(m);
+    m_scc->send(gloox::Message::Chat, m_peer, m_ser->to_body(sc, m_threadId));
 }
 
 const std::string& Sink::threadId() const throw() {
@@ -59,6 +96,128 @@ const std::string& Sink::threadId() const throw() {
 }
 
 
+// storage for OwnedSink, must be initialized before the Sink base
+struct SinkData {
+    SinkData(const std::string& _threadId, const gloox::JID& _peer)
+        : threadId(_threadId), peer(_peer) {}
+
+    const std::string threadId;
+    const gloox::JID peer;
+};
+
+// Sink with its own copy of thread ID and peer, as returned by create_sink
+class OwnedSink : private SinkData, public Sink {
+public:
+    OwnedSink(const std::string& threadId, const gloox::JID& peer, SpaceControlClient* scc,
+              const SpaceCommandSerializer* ser)
+        : SinkData(threadId, peer), Sink(SinkData::threadId, SinkData::peer, scc, ser) {}
+    virtual ~OwnedSink() {}
+};
+
+
+// Collects the responses of one dispatch cycle and sends them as one stanza.
+class Batch {
+public:
+    Batch(const std::string& threadId, const gloox::JID& peer, SpaceControlClient* scc,
+          const SpaceCommandSerializer* ser)
+        : m_threadId(threadId), m_peer(peer), m_scc(scc), m_ser(ser) {}
+
+    void add(const std::string& threadId, const SpaceCommand& sc) {
+        m_cmds.push_back(SpaceCommandSerializer::Incoming(threadId, sc));
+    }
+
+    void add(const std::string& threadId, SpaceCommand&& sc) {
+        m_cmds.push_back(SpaceCommandSerializer::Incoming(threadId, std::move(sc)));
+    }
+
+    // send the collected responses, a single response is sent unwrapped
+    void flush() {
+        if (m_cmds.size() == 1)
+            Sink(m_cmds.front().first, m_peer, m_scc, m_ser).sendSpaceCommand(m_cmds.front().second);
+        else if (!m_cmds.empty())
+            Sink(m_threadId, m_peer, m_scc, m_ser).sendSpaceCommand(SpaceCommandEnvelope::pack(m_cmds, *m_ser));
+
+        m_cmds.clear();
+    }
+
+private:
+    const std::string& m_threadId;
+    const gloox::JID& m_peer;
+    SpaceControlClient* m_scc;
+    const SpaceCommandSerializer* m_ser;
+    SpaceCommandEnvelope::batch m_cmds;
+};
+
+// Sink for one command of an envelope, the responses go to the batch.
+class BatchSink : public SpaceCommandSink {
+public:
+    BatchSink(const std::string& threadId, Batch* batch)
+        : m_threadId(threadId), m_batch(batch) {}
+    virtual ~BatchSink() {}
+
+    virtual void sendSpaceCommand(const SpaceCommand& sc) {
+        m_batch->add(m_threadId, sc);
+    }
+
+    virtual void sendSpaceCommand(SpaceCommand&& sc) {
+        m_batch->add(m_threadId, std::move(sc));
+    }
+
+    virtual const std::string& threadId() const throw() {
+        return m_threadId;
+    }
+
+private:
+    const std::string& m_threadId;
+    Batch* m_batch;
+};
+
+
+// A single command, handled on the worker pool.
+class SpaceControlClient::CommandJob : public WorkerPool::Job {
+public:
+    CommandJob(SpaceControlClient* scc, const gloox::JID& peer, SpaceCommandSerializer::Incoming&& in,
+               const SpaceCommandSerializer* in_ser, const SpaceCommandSerializer* out_ser)
+        : m_scc(scc), m_peer(peer), m_in(std::move(in)), m_in_ser(in_ser), m_out_ser(out_ser) {}
+
+    virtual ~CommandJob() {}
+
+    virtual void run() {
+        Sink sink(m_in.first, m_peer, m_scc, m_out_ser);
+        m_scc->dispatch(m_peer, m_in.second, m_in_ser, &sink);
+    }
+
+private:
+    SpaceControlClient* m_scc;
+    const gloox::JID m_peer;
+    const SpaceCommandSerializer::Incoming m_in;
+    const SpaceCommandSerializer* m_in_ser;
+    const SpaceCommandSerializer* m_out_ser;
+};
+
+// The unpacked commands of an envelope, handled on the worker pool.
+class SpaceControlClient::EnvelopeJob : public WorkerPool::Job {
+public:
+    EnvelopeJob(SpaceControlClient* scc, const gloox::JID& peer, const std::string& threadId,
+                SpaceCommandEnvelope::batch&& cmds, const SpaceCommandSerializer* in_ser)
+        : m_scc(scc), m_peer(peer), m_threadId(threadId), m_cmds(std::move(cmds)), m_in_ser(in_ser) {}
+
+    virtual ~EnvelopeJob() {}
+
+    virtual void run() {
+        m_scc->dispatch_batch(m_peer, m_threadId, m_cmds, m_in_ser);
+    }
+
+private:
+    SpaceControlClient* m_scc;
+    const gloox::JID m_peer;
+    const std::string m_threadId;
+    const SpaceCommandEnvelope::batch m_cmds;
+    const SpaceCommandSerializer* m_in_ser;
+};
+
+
+
 
 
 CommandMethod::CommandMethod(CommandMethod::t_command_set _commands)
@@ -76,13 +235,23 @@ CommandMethod::t_command_set& CommandMethod::command_set() {
 }
 
 
+const char SpaceControlClient::NEGOTIATION_COMMAND[] = "serializer";
+
+const char SpaceControlClient::MIXED_DEVICES[] = "Envelope addresses several devices!";
+
 SpaceControlClient::SpaceControlClient(gloox::Client* _client,
                                        SpaceControlHandler* _hnd,
                                        SpaceCommandSerializer* _ser,
                                        AccessFilter* _access
                                       )
     : m_client(_client), m_conn_error(gloox::ConnNotConnected), 
-      m_hnd(_hnd), m_ser(_ser), m_access(_access) {
+      m_hnd(_hnd), m_ser(_ser), m_arena(0), m_pool(0), m_outbound(0),
+      m_errors(DEFAULT_ERROR_RATE, 2 * DEFAULT_ERROR_RATE) {
+    // the filter is not owned
+    Policy* policy = new Policy();
+    policy->access.reset(_access, [](const AccessFilter*) {});
+    m_policy.reset(policy);
+
     if (_client) {
         m_client->registerMessageHandler(this);
 	m_client->registerConnectionListener(this);
@@ -95,36 +264,83 @@ SpaceControlClient::~SpaceControlClient()
     m_client->removeMessageHandler(this);
     m_client->removeConnectionListener(this);
   }
+
+  if (m_outbound)
+    delete m_outbound;
 }
 
 void SpaceControlClient::handleMessage(const gloox::Message& msg, gloox::MessageSession* session) {
+    // everything allocated for this message is released with the scope;
+    // commands passed to the worker pool must live on the heap
+    MessageArenaScope arena_scope(m_pool ? 0 : m_arena);
+
+    const std::string body(msg.body());
+    const gloox::JID& from = msg.from();
+    SpaceCommandSerializer* in_ser = serializer(body);
+
+    // the same settings for the whole message, even if they are replaced meanwhile
+    const std::shared_ptr<const Policy> policy(std::atomic_load(&m_policy));
+
+    // admission, decided before the body is deserialized
+    Admission admission(NEGOTIATION_COMMAND);
+    if (!admission.check(*policy, from, body, *in_ser)) {
+        refuse(admission, from, admission.threadId(), body);
+        return;
+    }
+
     try {
         // create the command
         // may throw a SpaceCommandFormatException
-        const SpaceCommandSerializer::Incoming in = serializer()->to_command(msg.body());
-        const std::string threadId(in.first);
-        const SpaceCommand cmd = in.second;
-
-        // create shared sink
-        Sink sink(threadId, msg.from(), m_client, m_ser);
-
-        // check for access
-        if (m_access ? m_access->accepted(msg.from()) : true) {
-
-            // call handler
-            if (m_hnd)
-                m_hnd->handleSpaceCommand(msg.from(), cmd, &sink);
+        SpaceCommandSerializer::Incoming in(in_ser->to_command(body));
+        const std::string& threadId = in.first;
+        const SpaceCommand& cmd = in.second;
+
+        if (SpaceCommandEnvelope::is_envelope(cmd)) {
+            // unpack all commands first, so a malformed envelope is not processed partially
+            SpaceCommandEnvelope::batch cmds = SpaceCommandEnvelope::unpack(cmd, *in_ser, body);
+
+            // one refused command refuses the envelope
+            if (!admission.check_commands(*policy, from, cmds)) {
+                refuse(admission, from, threadId, body);
+                return;
+            }
+
+            size_t key;
+            if (m_pool && !dispatch_key(from, threadId, cmds, key)) {
+                // would not be ordered with the commands for all its devices
+                if (admit_error()) {
+                    SpaceCommand::space_command_params par;
+                    par["what"] = MIXED_DEVICES;
+                    Sink(threadId, from, this, serializer(from)).sendSpaceCommand(
+                        SpaceCommand("exception", std::move(par)));
+                }
+            } else if (m_pool) {
+                if (!m_pool->submit(key, new EnvelopeJob(this, from, threadId, std::move(cmds), in_ser)))
+                    send_busy(from, threadId, "Too many pending commands!", 0);
+            } else
+                dispatch_batch(from, threadId, cmds, in_ser);
+        } else if (!admission.checked() && !admission.check_command(*policy, from, cmd.cmd())) {
+            // could not be checked before parsing
+            refuse(admission, from, threadId, body);
+        } else if (m_pool) {
+            const size_t key = dispatch_key(from, threadId, cmd);
+            // the thread ID is moved into the job
+            const std::string busy_thread(threadId);
+            if (!m_pool->submit(key, new CommandJob(this, from, std::move(in), in_ser, serializer(from))))
+                send_busy(from, busy_thread, "Too many pending commands!", 0);
         } else {
-            // send access denied message
-            SpaceCommand::space_command_params par;
-            par["reason"] = "Denied by access filter!";
-            SpaceCommand ex("denied", par);
-            sink.sendSpaceCommand(ex);
+            // create shared sink
+            Sink sink(threadId, from, this, serializer(from));
+            dispatch(from, cmd, in_ser, &sink);
         }
     } catch (const SpaceCommandFormatException& scfe) {
+        if (!admit_error())
+            return;
+
         SpaceCommand::space_command_params par;
         par["what"] = scfe.what();
-        par["body"] = scfe.body();
+        // a part of the body is enough to identify the message
+        par["body"] = abbreviate(scfe.body(), ECHO_LIMIT);
 
         // add line number if available
         if (scfe.line_number()) {
@@ -138,11 +354,142 @@ void SpaceControlClient::handleMessage(const gloox::Message& msg, gloox::Message
 #endif // COMPILER_SUPPORTS_CXX11
         }
 
-        SpaceCommand ex("exception", par);
+        const SpaceCommand ex("exception", std::move(par));
+
+        send(gloox::Message::Normal, from, serializer(from)->to_body(ex, ""));
+    }
+}
+
+void SpaceControlClient::dispatch_batch(const gloox::JID& peer, const std::string& threadId,
+                                        const SpaceCommandEnvelope::batch& cmds,
+                                        const SpaceCommandSerializer* in_ser) {
+    // the responses of all commands go back in one envelope
+    Batch batch(threadId, peer, this, serializer(peer));
+    for (SpaceCommandEnvelope::batch::const_iterator it = cmds.begin(); it != cmds.end(); ++it) {
+        BatchSink sink(it->first, &batch);
+        dispatch(peer, it->second, in_ser, &sink);
+    }
+    batch.flush();
+}
+
+void SpaceControlClient::dispatch(const gloox::JID& peer, const SpaceCommand& cmd,
+                                  const SpaceCommandSerializer* in_ser, SpaceCommandSink* sink) {
+    // the rules of the current policy
+    const std::shared_ptr<const Policy> policy(std::atomic_load(&m_policy));
+
+    if (cmd.cmd() == NEGOTIATION_COMMAND) {
+        // answer in the format of the request
+        Sink ack(sink->threadId(), peer, this, in_ser);
+        negotiate(peer, cmd, &ack);
+    }
+    // check the command rules
+    else if (policy->access && !policy->access->accepted(peer, cmd.cmd())) {
+        if (admit_error()) {
+            SpaceCommand::space_command_params par;
+            par["reason"] = "Command denied by access filter!";
+            sink->sendSpaceCommand(SpaceCommand("denied", std::move(par)));
+        }
+    }
+    // call handler
+    else if (m_hnd)
+        m_hnd->handleSpaceCommand(peer, cmd, sink);
+}
 
-        m_client->send(gloox::Message(gloox::Message::Normal, msg.from(),
-                                      serializer()->to_body(ex, "")));
+void SpaceControlClient::negotiate(const gloox::JID& peer, const SpaceCommand& cmd, SpaceCommandSink* sink) {
+    const std::string format(cmd.param_available("format") ? cmd.param("format") : "");
+
+    // unknown formats fall back to the default serializer
+    serializer_map::const_iterator it = m_serializers.find(format);
+    {
+        std::lock_guard<std::mutex> lock(m_peer_ser_mutex);
+        serializer_map::iterator known = m_peer_ser.find(peer.full());
+        if (it == m_serializers.end()) {
+            if (known != m_peer_ser.end())
+                m_peer_ser.erase(known);
+        } else if (known != m_peer_ser.end())
+            known->second = it->second;
+        // too many peers, this one stays with the text format
+        else if (m_peer_ser.size() >= MAX_NEGOTIATED_PEERS)
+            it = m_serializers.end();
+        else
+            m_peer_ser[peer.full()] = it->second;
     }
+
+    // list the available formats
+    std::string formats("text");
+    for (serializer_map::const_iterator f = m_serializers.begin(); f != m_serializers.end(); ++f)
+        formats.append(" ").append(f->first);
+
+    SpaceCommand::space_command_params par;
+    par["format"] = it != m_serializers.end() ? format : "text";
+    par["available"] = formats;
+    sink->sendSpaceCommand(SpaceCommand(NEGOTIATION_COMMAND, std::move(par)));
+}
+
+
+bool SpaceControlClient::admit_error() {
+    return m_errors.admit();
+}
+
+void SpaceControlClient::refuse(const Admission& admission, const gloox::JID& peer,
+                                const std::string& threadId, const std::string& body) {
+    if (admission.error() && !admit_error())
+        return;
+
+    Sink sink(threadId, peer, this, serializer(peer));
+    admission.answer(body, &sink);
+}
+
+void SpaceControlClient::send_busy(const gloox::JID& peer, const std::string& threadId,
+                                   const char* reason, unsigned int retry_ms) {
+    Sink sink(threadId, peer, this, serializer(peer));
+    SpaceCommand::space_command_params par;
+    par["reason"] = reason;
+    if (retry_ms)
+        par["retry"] = std::to_string(retry_ms);
+    sink.sendSpaceCommand(SpaceCommand("busy", std::move(par)));
+}
+
+SpaceControlClient::Policy::Policy() : max_body(DEFAULT_MAX_BODY) {}
+
+void SpaceControlClient::set_policy(const std::shared_ptr<const Policy>& policy) {
+    std::lock_guard<std::mutex> lock(m_policy_mutex);
+    std::atomic_store(&m_policy, policy);
+}
+
+std::shared_ptr<const SpaceControlClient::Policy> SpaceControlClient::policy() const {
+    return std::atomic_load(&m_policy);
+}
+
+void SpaceControlClient::set_rate_limiter(RateLimiter* limiter) {
+    std::lock_guard<std::mutex> lock(m_policy_mutex);
+    Policy* policy = new Policy(*m_policy);
+    // the limiter is not owned
+    policy->limiter.reset(limiter, [](RateLimiter*) {});
+    std::atomic_store(&m_policy, std::shared_ptr<const Policy>(policy));
+}
+
+const RateLimiter* SpaceControlClient::rate_limiter() const throw() {
+    return std::atomic_load(&m_policy)->limiter.get();
+}
+
+void SpaceControlClient::set_max_body(size_t max) {
+    std::lock_guard<std::mutex> lock(m_policy_mutex);
+    Policy* policy = new Policy(*m_policy);
+    policy->max_body = max;
+    std::atomic_store(&m_policy, std::shared_ptr<const Policy>(policy));
+}
+
+void SpaceControlClient::set_error_rate(double rate, double burst) throw() {
+    m_errors.set(rate, burst);
+}
+
+unsigned long SpaceControlClient::suppressed_errors() const throw() {
+    return m_errors.suppressed();
+}
+
+ErrorLimiter* SpaceControlClient::error_limiter() throw() {
+    return &m_errors;
 }
 
 
@@ -155,6 +502,10 @@ void SpaceControlClient::onDisconnect(gloox::ConnectionError e)
 {
   // store the connection error
   m_conn_error = e;
+
+  // negotiations are per session
+  std::lock_guard<std::mutex> lock(m_peer_ser_mutex);
+  m_peer_ser.clear();
 }
 
 bool SpaceControlClient::onTLSConnect(const gloox::CertInfo& info)
@@ -182,38 +533,235 @@ SpaceCommandSerializer* SpaceControlClient::serializer() {
     return this->m_ser;
 }
 
+SpaceCommandSerializer* SpaceControlClient::serializer(const gloox::JID& peer) {
+    std::lock_guard<std::mutex> lock(m_peer_ser_mutex);
+    serializer_map::const_iterator it = m_peer_ser.find(peer.full());
+    return it != m_peer_ser.end() ? it->second : m_ser;
+}
+
+SpaceCommandSerializer* SpaceControlClient::serializer(const std::string& body) {
+    for (serializer_map::const_iterator it = m_serializers.begin(); it != m_serializers.end(); ++it)
+        if (it->second->recognizes(body))
+            return it->second;
+
+    return m_ser;
+}
+
+void SpaceControlClient::add_serializer(const std::string& name, SpaceCommandSerializer* ser) {
+    if (ser)
+        m_serializers[name] = ser;
+}
+
 SpaceCommandSink* SpaceControlClient::create_sink(const gloox::JID& peer, const std::string& threadId) {
     // return sink
-    return new Sink(threadId, peer, m_client, m_ser);
+    return new OwnedSink(threadId, peer, this, serializer(peer));
 
 }
 
 const AccessFilter* SpaceControlClient::access() const throw()
 {
-    return m_access;
+    return std::atomic_load(&m_policy)->access.get();
+}
+
+void SpaceControlClient::set_message_arena(MessageArena* arena) throw()
+{
+    m_arena = arena;
+}
+
+void SpaceControlClient::set_worker_pool(WorkerPool* pool) throw()
+{
+    m_pool = pool;
+}
+
+const WorkerPool* SpaceControlClient::worker_pool() const throw()
+{
+    return m_pool;
+}
+
+size_t SpaceControlClient::dispatch_key(const gloox::JID& peer, const std::string& threadId,
+                                        const SpaceCommand& cmd)
+{
+    size_t key;
+    if (device_key(cmd, key))
+        return key;
+
+    return thread_key(peer, threadId);
+}
+
+bool SpaceControlClient::dispatch_key(const gloox::JID& peer, const std::string& threadId,
+                                      const SpaceCommandEnvelope::batch& cmds, size_t& key)
+{
+    bool device = false;
+    for (SpaceCommandEnvelope::batch::const_iterator it = cmds.begin(); it != cmds.end(); ++it) {
+        size_t k;
+        if (!device_key(it->second, k))
+            continue;
+
+        if (device && k != key)
+            return false;
+
+        key = k;
+        device = true;
+    }
+
+    if (!device)
+        key = thread_key(peer, threadId);
+
+    return true;
+}
+
+void SpaceControlClient::enable_outbound_queue(size_t capacity)
+{
+    if (!m_outbound)
+        m_outbound = new OutboundQueue(capacity);
+    m_conn_thread = std::this_thread::get_id();
+}
+
+const OutboundQueue* SpaceControlClient::outbound_queue() const throw()
+{
+    return m_outbound;
+}
+
+size_t SpaceControlClient::flush_outbound()
+{
+    if (!m_outbound)
+        return 0;
+
+    m_outbound->clear_signal();
+
+    // hand all queued stanzas to the socket at once
+    EcoConnectionTCPClient* eco = dynamic_cast<EcoConnectionTCPClient*>(m_client->connectionImpl());
+    if (eco)
+        eco->cork();
+
+    size_t count = 0;
+    OutboundMessage out;
+    while (m_outbound->pop(out)) {
+        m_client->send(gloox::Message(out.type, out.to, out.body));
+        m_outbound->record_sent(out);
+        count++;
+    }
+
+    if (eco)
+        eco->uncork();
+
+    return count;
+}
+
+void SpaceControlClient::send(gloox::Message::MessageType type, const gloox::JID& to, std::string&& body)
+{
+    if (m_outbound) {
+        OutboundMessage out;
+        out.type = type;
+        out.to = to;
+        out.body = std::move(body);
+
+        if (std::this_thread::get_id() == m_conn_thread) {
+            // the connection thread must not wait for itself
+            while (!m_outbound->try_push(out))
+                flush_outbound();
+        } else if (!m_outbound->push(out, OUTBOUND_WAIT_MS))
+            std::cerr << "Outbound queue is full, dropping message to " << to.full() << "!" << std::endl;
+        return;
+    }
+
+    const gloox::Message m(type, to, body);
+    std::lock_guard<std::mutex> lock(m_send_mutex);
+    m_client->send(m);
 }
 
 
 
 void set_eco_tcp_client(gloox::Client* client) {
+    set_eco_tcp_client(client, SocketProfile());
+}
+
+void set_eco_tcp_client(gloox::Client* client, const SocketProfile& profile) {
     EcoConnectionTCPClient* ecocon =
-        new EcoConnectionTCPClient(client, client->logInstance(), client->server(), client->port());
+        new EcoConnectionTCPClient(client, client->logInstance(), client->server(), client->port(), profile);
 
     client->setConnectionImpl(ecocon);
 }
 
 EcoConnectionTCPClient::EcoConnectionTCPClient(gloox::ConnectionDataHandler* cdh, const gloox::LogSink& logInstance,
-        const std::string& server, int port)
-    : ConnectionTCPClient(cdh, logInstance, server, port)
+        const std::string& server, int port, const SocketProfile& profile)
+    : ConnectionTCPClient(cdh, logInstance, server, port), m_profile(profile), m_corked(false)
 {}
 
+gloox::ConnectionError EcoConnectionTCPClient::connect()
+{
+    const gloox::ConnectionError err = ConnectionTCPClient::connect();
+
+    const char* failed = 0;
+    if (err == gloox::ConnNoError && !m_profile.apply(m_socket, &failed))
+        m_logInstance.warn(gloox::LogAreaClassConnectionTCPClient,
+                           std::string("Socket option ") + (failed ? failed : "?") + " could not be set.");
+
+    return err;
+}
+
+gloox::ConnectionError EcoConnectionTCPClient::recv(int timeout)
+{
+    const gloox::ConnectionError err = ConnectionTCPClient::recv(timeout);
+
+    // the kernel falls back to delayed ACKs after a while
+    m_profile.rearm(m_socket);
+
+    return err;
+}
+
+gloox::ConnectionBase* EcoConnectionTCPClient::newInstance() const
+{
+    return new EcoConnectionTCPClient(m_handler, m_logInstance, m_server, m_port, m_profile);
+}
+
+const SocketProfile& EcoConnectionTCPClient::socket_profile() const throw()
+{
+    return m_profile;
+}
+
+void EcoConnectionTCPClient::cork() throw()
+{
+    m_corked = true;
+}
+
+bool EcoConnectionTCPClient::uncork()
+{
+    m_corked = false;
+    if (m_cork_buf.empty())
+        return true;
+
+    const bool ok = ConnectionTCPClient::send(m_cork_buf);
+    m_cork_buf.clear();
+    return ok;
+}
+
+bool EcoConnectionTCPClient::send(const std::string& data)
+{
+    if (!m_corked)
+        return ConnectionTCPClient::send(data);
+
+    m_cork_buf += data;
+
+    // do not let the buffer grow without limit
+    if (m_cork_buf.size() >= CORK_LIMIT) {
+        const bool ok = ConnectionTCPClient::send(m_cork_buf);
+        m_cork_buf.clear();
+        return ok;
+    }
+
+    return true;
+}
+
 gloox::ConnectionError EcoConnectionTCPClient::receive()
 {
     if( m_socket < 0 )
         return gloox::ConnNotConnected;
 
+    // block until data arrives instead of waking up every second; the
+    // connection is closed from this thread, see ClientReactor
     gloox::ConnectionError err = gloox::ConnNoError;
-    while( !m_cancel && ( err = recv( 1000000 ) ) == gloox::ConnNoError )
+    while( !m_cancel && ( err = recv( -1 ) ) == gloox::ConnNoError )
         ;
     return err == gloox::ConnNoError ? gloox::ConnNotConnected : err;
 }
@@ -21,6 +21,10 @@
 #include <string>
 #include <stdexcept>
 #include <set>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include <gloox/jid.h>
 #include <gloox/client.h>
@@ -32,9 +36,16 @@
 
 #include "accessfilter.h"
 #include "spacecommand.h"
+#include "messagearena.h"
+#include "workerpool.h"
+#include "outboundqueue.h"
+#include "socketprofile.h"
+#include "ratelimiter.h"
 
 namespace xmppsc {
 
+class Admission;
+
 //! Interface to send out Space Commands
 /*!
 /* A sink that has been provided to a command handler, must not be disposed.
@@ -49,6 +60,16 @@ public:
      */
     virtual void sendSpaceCommand(const SpaceCommand& sc) = 0;
 
+    //! Send a Space Command that is not needed afterwards.
+    /*!
+     * Sinks that keep the command may take over its data. The default
+     * implementation sends a const reference.
+     * \param sc The space command to be sent.
+     */
+    virtual void sendSpaceCommand(SpaceCommand&& sc) {
+        sendSpaceCommand(static_cast<const SpaceCommand&>(sc));
+    }
+
     //! Return the communication thread ID.
     /*!
      *  Ideally we would use the XMPP thread ID which, however, as proven to be unreliable.
@@ -135,7 +156,9 @@ public:
     //! message handler
     /*!
      * Converts an XMPP message into a Space Command and calls the
-     * Space Command handler.
+     * Space Command handler. Envelopes are unpacked and each command is
+     * passed to the handler; the responses produced while handling an
+     * envelope are sent back in one envelope.
      * \sa gloox::MessageHandler::handleMessage
      */
     virtual void handleMessage(const gloox::Message& msg, gloox::MessageSession* session = 0);
@@ -144,7 +167,8 @@ public:
     
     //! Disconnect handler
     /*!
-     * Store the disconnection reason
+     * Store the disconnection reason and forget the negotiated serializers,
+     * the peers negotiate again in the next session.
      */
     virtual void onDisconnect(gloox::ConnectionError e);
     
@@ -171,8 +195,218 @@ public:
      */
     SpaceCommandSink* create_sink(const gloox::JID& peer, const std::string& threadId);
 
+    //! Get the access filter of the current policy.
+    /*!
+     * \returns the filter or 0; valid until the policy is replaced.
+     */
     const AccessFilter* access() const throw();
 
+    //! Settings that can be replaced while the client is running.
+    /*!
+     * A policy is not modified once it is in use. set_policy() replaces
+     * it as a whole, messages in flight finish with the policy they have
+     * started with, which is released afterwards.
+     *
+     * The rate limiter is the exception: it may be shared by successive
+     * policies and reconfigured in place, see RateLimiter::reconfigure(),
+     * so the state of the peers survives a reload.
+     */
+    struct Policy {
+        Policy();
+
+        //! The access filter, empty for open access
+        std::shared_ptr<const AccessFilter> access;
+        //! The command rate limiter, empty for no limit
+        std::shared_ptr<RateLimiter> limiter;
+        //! The maximal size of message bodies, 0 for no limit
+        size_t max_body;
+    };
+
+    //! Replace the policy; may be called from any thread.
+    /*!
+     * \param policy The new policy, must not be empty.
+     */
+    void set_policy(const std::shared_ptr<const Policy>& policy);
+
+    //! Get the current policy.
+    std::shared_ptr<const Policy> policy() const;
+
+    //! Command name for the serializer negotiation.
+    static const char NEGOTIATION_COMMAND[];
+
+    //! Register an additional serializer.
+    /*!
+     * Peers may select a registered serializer by sending the
+     * NEGOTIATION_COMMAND with the serializer name in the "format"
+     * parameter. Incoming messages are parsed by the first registered
+     * serializer that recognizes the body, otherwise by the default
+     * serializer passed to the constructor.
+     *
+     * \param name The name used for the negotiation.
+     * \param ser  The serializer; ownership is not transferred.
+     */
+    void add_serializer(const std::string& name, SpaceCommandSerializer* ser);
+
+    //! Use a per-message arena.
+    /*!
+     * If set, the parameter sets of received commands and of the responses
+     * created by the handler are allocated from the arena, which is reset
+     * after each message. Handlers must not keep commands beyond their call.
+     *
+     * \param arena The arena or 0 to use the heap; ownership is not transferred.
+     */
+    void set_message_arena(MessageArena* arena) throw();
+
+    //! Handle commands on a worker pool.
+    /*!
+     * If set, received commands are parsed and checked on the connection
+     * thread and then handled on the pool, so slow bus operations do not
+     * stall the XMPP connection. Commands for the same "device" are handled
+     * in order, as are commands without a device from the same peer and
+     * thread ID. An envelope is ordered with the commands for its device;
+     * envelopes addressing several devices cannot be ordered with all of
+     * them and are answered with an exception.
+     *
+     * Commands with a device are ordered by the device only: commands of
+     * one peer and thread for different devices may be handled in a
+     * different order than they were sent. Commands that find the queue
+     * of their worker full are answered with "busy".
+     *
+     * Handlers must be thread-safe. The message arena is not used in
+     * this mode.
+     *
+     * \param pool The pool or 0 to handle commands inline; ownership is not transferred.
+     */
+    void set_worker_pool(WorkerPool* pool) throw();
+
+    //! Get the worker pool, e.g. for its statistics.
+    /*!
+     * \returns the pool or 0 if commands are handled inline.
+     */
+    const WorkerPool* worker_pool() const throw();
+
+    //! Get the worker pool key of a command, see set_worker_pool().
+    /*!
+     * Shared with other transports using the pool, so their commands for
+     * a device are ordered with those received via XMPP.
+     *
+     * \param peer     The communication peer.
+     * \param threadId The thread ID of the message.
+     * \param cmd      The command.
+     * \returns the key.
+     */
+    static size_t dispatch_key(const gloox::JID& peer, const std::string& threadId, const SpaceCommand& cmd);
+
+    //! Get the worker pool key of the unpacked commands of an envelope.
+    /*!
+     * The key of the device if any command has one, else the key of the
+     * peer and thread ID.
+     *
+     * \param peer     The communication peer.
+     * \param threadId The thread ID of the envelope.
+     * \param cmds     The commands.
+     * \param key      Receives the key.
+     * \returns false if the commands address several devices.
+     */
+    static bool dispatch_key(const gloox::JID& peer, const std::string& threadId,
+                             const SpaceCommandEnvelope::batch& cmds, size_t& key);
+
+    //! Reason for refusing envelopes that address several devices on the worker pool.
+    static const char MIXED_DEVICES[];
+
+    //! Send responses through an outbound queue.
+    /*!
+     * Responses are queued by the handlers and sent by the connection
+     * thread in flush_outbound(), which hands all queued stanzas to the
+     * socket in one write. If the queue is full, handlers on other threads
+     * wait up to OUTBOUND_WAIT_MS before the response is dropped.
+     *
+     * Must be called on the connection thread.
+     *
+     * \param capacity The maximal number of queued responses.
+     */
+    void enable_outbound_queue(size_t capacity);
+
+    //! Get the outbound queue, e.g. for its statistics.
+    /*!
+     * \returns the queue or 0 if not enabled.
+     */
+    const OutboundQueue* outbound_queue() const throw();
+
+    //! Send the queued responses; connection thread only.
+    /*!
+     * \returns the number of sent messages.
+     */
+    size_t flush_outbound();
+
+    //! Maximal waiting time in ms for a full outbound queue.
+    static const unsigned int OUTBOUND_WAIT_MS = 1000;
+
+    //! Limit the size of incoming message bodies.
+    /*!
+     * Larger messages are rejected before they are parsed. Replaces the
+     * policy with a modified copy.
+     *
+     * \param max The maximal body size in bytes, 0 for no limit.
+     */
+    void set_max_body(size_t max);
+
+    //! Limit the rate of error responses.
+    /*!
+     * Denied, malformed and oversized messages are answered at most at
+     * this rate, so they cannot be used to make the client send a
+     * multiple of the received traffic. Errors above the rate are not
+     * answered.
+     *
+     * \param rate  Responses per second, 0 for no limit.
+     * \param burst Responses that may be sent at once.
+     */
+    void set_error_rate(double rate, double burst) throw();
+
+    //! Get the number of error responses suppressed by the rate limit.
+    unsigned long suppressed_errors() const throw();
+
+    //! Get the error rate limit, e.g. to share it with the local socket.
+    /*!
+     * \returns the limiter, owned by the client.
+     */
+    ErrorLimiter* error_limiter() throw();
+
+    //! Limit the command rate of each peer.
+    /*!
+     * Commands above the rate are answered with a "busy" command instead
+     * of being handled, commands of blocked peers are dropped. Single
+     * commands are checked before they are parsed, the commands of an
+     * envelope after unpacking.
+     *
+     * Replaces the policy with a modified copy.
+     *
+     * \param limiter The limiter or 0 for no limit; ownership is not transferred.
+     */
+    void set_rate_limiter(RateLimiter* limiter);
+
+    //! Get the rate limiter of the current policy, e.g. for its statistics.
+    /*!
+     * \returns the limiter or 0; valid until the policy is replaced.
+     */
+    const RateLimiter* rate_limiter() const throw();
+
+    //! Default limit for message bodies.
+    static const size_t DEFAULT_MAX_BODY = 64 * 1024;
+
+    //! Default rate of error responses per second.
+    static const unsigned int DEFAULT_ERROR_RATE = 10;
+
+    //! Maximal number of bytes of a malformed body echoed in the error response.
+    static const size_t ECHO_LIMIT = 64;
+
+    //! Maximal number of peers with a negotiated serializer.
+    /*!
+     * Further peers keep the text format until the negotiations are
+     * dropped on disconnect.
+     */
+    static const size_t MAX_NEGOTIATED_PEERS = 256;
+
 protected:
     //! Get the space command serializer
     /*!
@@ -180,23 +414,135 @@ protected:
      */
     SpaceCommandSerializer* serializer();
 
+    //! Get the serializer negotiated with a peer.
+    /*!
+     * \param peer The communication peer.
+     * \returns the negotiated serializer or the default serializer.
+     */
+    SpaceCommandSerializer* serializer(const gloox::JID& peer);
+
+    //! Get the serializer for an incoming message body.
+    /*!
+     * \param body The message body.
+     * \returns the first registered serializer recognizing the body or the default serializer.
+     */
+    SpaceCommandSerializer* serializer(const std::string& body);
+
 private:
+    //! serializers by name
+    typedef std::map<std::string, SpaceCommandSerializer*> serializer_map;
+
     gloox::Client* m_client;
     gloox::ConnectionError m_conn_error;
     SpaceControlHandler* m_hnd;
     SpaceCommandSerializer* m_ser;
-    AccessFilter* m_access;
+    MessageArena* m_arena;
+    WorkerPool* m_pool;
+    serializer_map m_serializers;
+    //! negotiated serializers by full peer JID
+    serializer_map m_peer_ser;
+    //! guards m_peer_ser, negotiation may happen on a worker
+    std::mutex m_peer_ser_mutex;
+    //! serializes sending from the connection thread and the workers
+    std::mutex m_send_mutex;
+    OutboundQueue* m_outbound;
+    //! the consumer of the outbound queue
+    std::thread::id m_conn_thread;
+    //! the current policy, read and replaced atomically
+    std::shared_ptr<const Policy> m_policy;
+    //! serializes replacing the policy
+    std::mutex m_policy_mutex;
+    //! commands may be denied on a worker, the limiter is thread-safe
+    ErrorLimiter m_errors;
+
+    friend class Sink;
+
+    //! Check if an error response may be sent; counts suppressed ones.
+    bool admit_error();
+
+    //! Answer a message refused by the admission; errors are subject to the error rate.
+    void refuse(const Admission& admission, const gloox::JID& peer,
+                const std::string& threadId, const std::string& body);
+
+    //! Answer "busy"; retry_ms is omitted if 0.
+    void send_busy(const gloox::JID& peer, const std::string& threadId,
+                   const char* reason, unsigned int retry_ms);
+
+    //! Send a message body directly or via the outbound queue.
+    void send(gloox::Message::MessageType type, const gloox::JID& to, std::string&& body);
+
+    //! Jobs for handling commands on the worker pool
+    class CommandJob;
+    class EnvelopeJob;
+
+    //! Handle the commands of an envelope, the responses are sent in one envelope.
+    void dispatch_batch(const gloox::JID& peer, const std::string& threadId,
+                        const SpaceCommandEnvelope::batch& cmds,
+                        const SpaceCommandSerializer* in_ser);
+
+    //! Dispatch a single command to the negotiation or the handler.
+    /*!
+     * \param peer   The communication peer.
+     * \param cmd    The received command.
+     * \param in_ser The serializer the command has been received with.
+     * \param sink   The sink for responses.
+     */
+    void dispatch(const gloox::JID& peer, const SpaceCommand& cmd,
+                  const SpaceCommandSerializer* in_ser, SpaceCommandSink* sink);
+
+    //! Handle the serializer negotiation command.
+    void negotiate(const gloox::JID& peer, const SpaceCommand& cmd, SpaceCommandSink* sink);
 };
 
 
 void set_eco_tcp_client(gloox::Client* client);
 
+//! Use the "eco" connection with the given socket options.
+void set_eco_tcp_client(gloox::Client* client, const SocketProfile& profile);
+
 class EcoConnectionTCPClient : public gloox::ConnectionTCPClient {
 public:
     EcoConnectionTCPClient(gloox::ConnectionDataHandler* cdh, const gloox::LogSink& logInstance,
-                           const std::string& server, int port);
+                           const std::string& server, int port,
+                           const SocketProfile& profile = SocketProfile());
     
     virtual gloox::ConnectionError receive();
+
+    //! Connect and apply the socket profile.
+    /*!
+     * The options are set on the connected socket, as gloox creates the
+     * socket while connecting; buffer sizes therefore do not affect the
+     * window scaling negotiated in the handshake.
+     */
+    virtual gloox::ConnectionError connect();
+
+    //! Receive and re-arm the quick ACK option.
+    virtual gloox::ConnectionError recv(int timeout = -1);
+
+    virtual gloox::ConnectionBase* newInstance() const;
+
+    //! Get the socket options.
+    const SocketProfile& socket_profile() const throw();
+
+    //! Send data, or buffer it while corked.
+    virtual bool send(const std::string& data);
+
+    //! Buffer the sent data until uncork().
+    void cork() throw();
+
+    //! Send the buffered data in one write.
+    /*!
+     * \returns false if sending failed.
+     */
+    bool uncork();
+
+    //! Buffer size that is sent even if corked.
+    static const size_t CORK_LIMIT = 16 * 1024;
+
+private:
+    const SocketProfile m_profile;
+    bool m_corked;
+    std::string m_cork_buf;
 };
 
 }
@@ -0,0 +1,92 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+#include "messagearena.h"
+#include "spacecommand.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <utility>
+
+using namespace xmppsc;
+
+namespace {
+
+// counts all allocations of the test program
+std::atomic<unsigned long> allocation_count(0);
+
+// a short command as it arrives from the bus clients
+const std::string WRITE8 =
+    "i2c.write8\n1\n1 device\n0x20\n1 register\n0x95\n1 data\n0x01\n";
+
+} // anonymous namespace
+
+void* operator new(size_t n) {
+    allocation_count++;
+    void* p = std::malloc(n ? n : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) throw() {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) throw() {
+    std::free(p);
+}
+
+unsigned long allocations() {
+    return allocation_count.load();
+}
+
+void test_allocations() {
+    TextSpaceCommandSerializer ser;
+
+    // the whole parameter set in one block
+    unsigned long before = allocations();
+    SpaceCommandSerializer::Incoming in = ser.to_command(WRITE8);
+    CHECK(allocations() - before == 1);
+    CHECK(in.second.params().size() == 3);
+
+    // nothing at all from the heap within an arena
+    MessageArena arena(4096);
+    {
+        MessageArenaScope scope(&arena);
+        before = allocations();
+        SpaceCommandSerializer::Incoming scoped = ser.to_command(WRITE8);
+        CHECK(allocations() - before == 0);
+        CHECK(scoped.second.param("register") == "0x95");
+    }
+    CHECK(arena.overflows() == 0);
+
+    // moving hands over the parameter block, copying does not
+    before = allocations();
+    SpaceCommandSerializer::Incoming moved(std::move(in));
+    CHECK(allocations() - before == 0);
+    CHECK(moved.second.param("data") == "0x01");
+
+    before = allocations();
+    const SpaceCommand copy(moved.second);
+    CHECK(allocations() - before >= 1);
+    CHECK(copy.params() == moved.second.params());
+}
+
+// End of File
@@ -0,0 +1,195 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+#include "commandrouter.h"
+#include "methodhandler.h"
+#include "util.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace xmppsc;
+
+namespace {
+
+// keeps the responses of a handler
+class RecordingSink : public SpaceCommandSink {
+public:
+    virtual void sendSpaceCommand(const SpaceCommand& sc) {
+        responses.push_back(sc);
+    }
+
+    virtual const std::string& threadId() const throw() {
+        return m_threadId;
+    }
+
+    std::vector<SpaceCommand> responses;
+
+private:
+    std::string m_threadId;
+};
+
+struct WriteParams {
+    unsigned int device;
+    unsigned int data;
+};
+
+const HexField<WriteParams> WRITE_SCHEMA[] = {
+    { { "device", 7, true, 0 }, &WriteParams::device },
+    { { "data", 8, true, 0 }, &WriteParams::data },
+};
+
+// decodes with a schema and reports errors without throwing
+class WriteMethod : public CommandMethod {
+public:
+    WriteMethod() : CommandMethod("test.write") {}
+
+    virtual void handleSpaceCommand(gloox::JID, const SpaceCommand& sc, SpaceCommandSink* sink) {
+        WriteParams p;
+        ParameterError error;
+        if (!decode_hex_fields(sc, WRITE_SCHEMA, p, error)) {
+            send_parameter_error(error, sink);
+            return;
+        }
+
+        SpaceCommand::space_command_params par;
+        par["data"] = int2hex(p.data);
+        sink->sendSpaceCommand(SpaceCommand("test.written", std::move(par)));
+    }
+};
+
+// decodes with retrieveHexParameter, which throws on errors
+class LegacyWriteMethod : public CommandMethod {
+public:
+    LegacyWriteMethod() : CommandMethod("test.legacy") {}
+
+    virtual void handleSpaceCommand(gloox::JID, const SpaceCommand& sc, SpaceCommandSink* sink) {
+        retrieveHexParameter("device", sc);
+        const int data = retrieveHexParameter("data", sc);
+        if (data > 0xff)
+            throw IllegalCommandParameterException("data", "Value exceeds 8 bits!");
+
+        SpaceCommand::space_command_params par;
+        par["data"] = int2hex(data);
+        sink->sendSpaceCommand(SpaceCommand("test.written", std::move(par)));
+    }
+};
+
+SpaceCommand command(const char* cmd, const char* device, const char* data) {
+    SpaceCommand::space_command_params par;
+    if (device)
+        par["device"] = device;
+    if (data)
+        par["data"] = data;
+    return SpaceCommand(cmd, par);
+}
+
+} // anonymous namespace
+
+void test_command_table() {
+    int a = 1, b = 2, c = 3;
+
+    CommandTable<int> table;
+    CHECK(!table.frozen());
+    table.insert("i2c.read8", &a);
+    table.insert("i2c.write8", &b);
+    table.insert("i2c.read8", &c);
+    CHECK(table.size() == 2);
+
+    // nothing is found before freezing
+    CHECK(table.find("i2c.write8") == 0);
+
+    table.freeze();
+    CHECK(table.frozen());
+    CHECK_THROWS(table.insert("i2c.read16", &a), std::logic_error);
+
+    // the last insertion wins
+    CHECK(table.find("i2c.read8") == &c);
+    CHECK(table.find("i2c.write8") == &b);
+
+    // names need not be terminated, prefixes and extensions do not match
+    const char* buf = "i2c.write8.extra";
+    CHECK(table.find(buf, 10) == &b);
+    CHECK(table.find(buf, 9) == 0);
+    CHECK(table.find(buf, 16) == 0);
+    CHECK(table.find("") == 0);
+    CHECK(table.find("gpio.read") == 0);
+
+    // enough entries for collisions in the probe sequences
+    std::vector<std::string> names;
+    std::vector<int> values(500);
+    CommandTable<int> large;
+    for (size_t i = 0; i < values.size(); i++) {
+        std::ostringstream name;
+        name << "ns" << (i % 7) << ".cmd" << i;
+        names.push_back(name.str());
+        values[i] = int(i);
+        large.insert(names[i], &values[i]);
+    }
+    large.freeze();
+
+    bool all = true;
+    for (size_t i = 0; i < names.size(); i++)
+        all = all && large.find(names[i]) == &values[i];
+    CHECK(all);
+    CHECK(large.find("ns0.cmd500") == 0);
+}
+
+void test_method_handler() {
+    MethodHandler handler;
+    handler.add_method(new WriteMethod());
+    handler.add_method(new LegacyWriteMethod());
+
+    RecordingSink sink;
+    const gloox::JID peer("tux@n39.eu/test");
+    CHECK_THROWS(handler.handleSpaceCommand(peer, command("test.write", "0x20", "0x01"), &sink),
+                 std::logic_error);
+
+    handler.freeze();
+    CHECK_THROWS(handler.add_method(new WriteMethod()), std::logic_error);
+
+    // valid commands reach the method
+    handler.handleSpaceCommand(peer, command("test.write", "0x20", "0x01"), &sink);
+    CHECK(sink.responses.size() == 1 && sink.responses[0].cmd() == "test.written");
+
+    // unknown commands
+    sink.responses.clear();
+    handler.handleSpaceCommand(peer, command("test.unknown", "0x20", "0x01"), &sink);
+    CHECK(sink.responses.size() == 1);
+    CHECK(sink.responses[0].cmd() == "exception");
+    CHECK(sink.responses[0].param("what") == "map::at");
+    CHECK(sink.responses[0].param("text") == "Unknown command: test.unknown");
+
+    // missing and illegal parameters are answered the same, whether the
+    // method reports the error or throws it
+    const SpaceCommand malformed[][2] = {
+        { command("test.write", 0, "0x01"), command("test.legacy", 0, "0x01") },
+        { command("test.write", "0x20", "0xzz"), command("test.legacy", "0x20", "0xzz") },
+    };
+    for (size_t i = 0; i < 2; i++) {
+        sink.responses.clear();
+        handler.handleSpaceCommand(peer, malformed[i][0], &sink);
+        handler.handleSpaceCommand(peer, malformed[i][1], &sink);
+        CHECK(sink.responses.size() == 2);
+        CHECK(sink.responses[0].cmd() == "exception");
+        CHECK(sink.responses[0].params() == sink.responses[1].params());
+    }
+    CHECK(sink.responses[0].param("parameter") == "data");
+}
+
+// End of File
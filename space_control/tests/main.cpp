@@ -0,0 +1,79 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+struct Test {
+    const char* name;
+    void (*run)();
+};
+
+const Test tests[] = {
+    { "next_line", test_next_line },
+    { "parse_hex", test_parse_hex },
+    { "text_parser", test_text_parser },
+    { "params", test_params },
+    { "arena", test_arena },
+    { "allocations", test_allocations },
+    { "command_table", test_command_table },
+    { "method_handler", test_method_handler },
+    { "outbound_queue", test_outbound_queue },
+    { "server_address", test_server_address },
+    { "reconnect_scheduler", test_reconnect_scheduler },
+    { "token_bucket", test_token_bucket },
+    { "rate_limiter", test_rate_limiter },
+    { "rate_limiter_envelope", test_rate_limiter_envelope },
+    { "rate_limiter_blocking", test_rate_limiter_blocking },
+    { "rate_limiter_sweep", test_rate_limiter_sweep },
+};
+
+unsigned int failures = 0;
+
+} // anonymous namespace
+
+void test_failed(const char* what, const char* file, int line) {
+    std::cerr << file << ":" << line << ": check failed: " << what << std::endl;
+    failures++;
+}
+
+// xmppsc-tests [test ...], all tests without arguments
+int main(int argc, char **argv) {
+    unsigned int failed = 0;
+
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        bool selected = argc < 2;
+        for (int a = 1; a < argc; a++)
+            selected |= std::strcmp(argv[a], tests[i].name) == 0;
+        if (!selected)
+            continue;
+
+        const unsigned int before = failures;
+        tests[i].run();
+
+        const bool ok = failures == before;
+        std::cout << tests[i].name << ": " << (ok ? "ok" : "FAILED") << std::endl;
+        if (!ok)
+            failed++;
+    }
+
+    return failed ? 1 : 0;
+}
+
+// End of File
@@ -0,0 +1,56 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+#include "outboundqueue.h"
+
+using namespace xmppsc;
+
+void test_outbound_queue() {
+    OutboundQueue queue(2);
+    CHECK(queue.capacity() == 2);
+
+    OutboundMessage msg;
+    msg.body = "first";
+    CHECK(queue.push(msg));
+    msg.body = "second";
+    CHECK(queue.try_push(msg));
+    CHECK(queue.depth() == 2);
+
+    // a full queue keeps the message with the caller
+    msg.body = "third";
+    CHECK(!queue.try_push(msg));
+    CHECK(msg.body == "third");
+    OutboundQueue::Stats st = queue.stats();
+    CHECK(st.full == 1 && st.dropped == 0 && st.pushed == 2);
+
+    // drained by the caller and retried
+    OutboundMessage out;
+    CHECK(queue.pop(out) && out.body == "first");
+    CHECK(queue.try_push(msg));
+
+    // push drops after waiting
+    msg.body = "fourth";
+    CHECK(!queue.push(msg, 0));
+    st = queue.stats();
+    CHECK(st.full == 2 && st.dropped == 1 && st.pushed == 3);
+
+    CHECK(queue.pop(out) && out.body == "second");
+    CHECK(queue.pop(out) && out.body == "third");
+    CHECK(!queue.pop(out));
+}
+
+// End of File
@@ -0,0 +1,133 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+#include "messagearena.h"
+#include "spacecommand.h"
+
+#include <cstring>
+
+using namespace xmppsc;
+
+void test_params() {
+    SpaceCommand::space_command_params par;
+    CHECK(par.empty());
+
+    // kept sorted by name, whatever the order of insertion
+    par["register"] = "0x95";
+    par["device"] = "0x22";
+    par["data"] = "0x01";
+    CHECK(par.size() == 3);
+    CHECK(std::strcmp(par.begin()->first.c_str(), "data") == 0);
+    CHECK((par.end() - 1)->first == "register");
+
+    // lookups by std::string and by C string
+    CHECK(par.find("device") != par.end() && par.find("device")->second == "0x22");
+    CHECK(par.find(std::string("register"))->second == "0x95");
+    CHECK(par.find("missing") == par.end());
+    CHECK(par.count("data") == 1 && par.count("missing") == 0);
+
+    // operator[] replaces an existing value
+    par["device"] = "0x23";
+    CHECK(par.size() == 3 && par.find("device")->second == "0x23");
+
+    // names that are prefixes of each other
+    par["dev"] = "short";
+    CHECK(par.find("dev")->second == "short" && par.find("device")->second == "0x23");
+
+    CHECK(par.erase("dev") == 1);
+    CHECK(par.erase("dev") == 0);
+    CHECK(par.size() == 3);
+
+    // equal regardless of the order of insertion
+    SpaceCommand::space_command_params other;
+    other["device"] = "0x23";
+    other["data"] = "0x01";
+    CHECK(par != other);
+    other["register"] = "0x95";
+    CHECK(par == other);
+
+    par.clear();
+    CHECK(par.empty() && par.find("device") == par.end());
+
+    // the command takes over the parameters
+    SpaceCommand::space_command_params moved;
+    moved["device"] = "0x20";
+    const SpaceCommand sc(std::string("i2c.read"), std::move(moved));
+    CHECK(sc.param_available("device") && sc.param("device") == "0x20");
+    CHECK(!sc.param_available("register"));
+    CHECK_THROWS(sc.param("register"), MissingCommandParameterException);
+}
+
+void test_arena() {
+    MessageArena arena(4096);
+    CHECK(arena.capacity() == 4096);
+    CHECK(MessageArena::current() == 0);
+
+    // aligned allocations until the arena is exhausted
+    void* a = arena.allocate(3, 1);
+    void* b = arena.allocate(8, 8);
+    CHECK(a && b && arena.owns(a) && arena.owns(b));
+    CHECK(reinterpret_cast<size_t>(b) % 8 == 0);
+    CHECK(arena.allocate(8192, 1) == 0);
+    CHECK(arena.high_water() == 16);
+
+    int local;
+    CHECK(!arena.owns(&local));
+
+    arena.reset();
+    CHECK(arena.allocate(3, 1) == a);
+
+    {
+        MessageArenaScope scope(&arena);
+        CHECK(MessageArena::current() == &arena);
+
+        // parameter blocks created within the scope use the arena
+        SpaceCommand::space_command_params par;
+        par["device"] = "0x20";
+        CHECK(arena.owns(&*par.begin()));
+
+        // nested scopes restore the outer arena
+        MessageArena inner(64);
+        {
+            MessageArenaScope inner_scope(&inner);
+            CHECK(MessageArena::current() == &inner);
+        }
+        CHECK(MessageArena::current() == &arena);
+
+        // a scope without arena changes nothing
+        {
+            MessageArenaScope no_scope(0);
+            CHECK(MessageArena::current() == &arena);
+        }
+
+        // blocks that do not fit are taken from the heap and counted
+        const size_t overflows = arena.overflows();
+        SpaceCommand::space_command_params large;
+        large.reserve(256);
+        large["x"] = "y";
+        CHECK(!arena.owns(&*large.begin()));
+        CHECK(arena.overflows() == overflows + 1);
+    }
+
+    // reset and deactivated with the scope
+    CHECK(MessageArena::current() == 0);
+    SpaceCommand::space_command_params heap;
+    heap["device"] = "0x20";
+    CHECK(!arena.owns(&*heap.begin()));
+}
+
+// End of File
@@ -0,0 +1,229 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+#include "spacecommand.h"
+#include "util.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+using namespace xmppsc;
+
+namespace {
+
+// The text parser as it was before the single forward scan, based on
+// std::getline; the reference for the current parser.
+bool reference_parse(const std::string& body, std::string& command, std::string& threadId,
+                     SpaceCommand::space_command_params& params) {
+    int line_number = 0;
+    std::stringstream ss(body);
+    std::string line;
+    while (std::getline(ss, line, '\n')) {
+        line_number++;
+
+        if (line_number == 1)
+            command = line;
+        else if (line_number == 2)
+            threadId = line;
+        else {
+            const size_t idx = line.find(' ');
+            if (idx == std::string::npos)
+                return false;
+
+            int parlines = std::strtol(line.substr(0, idx).c_str(), 0, 10);
+            if (parlines == 0)
+                return false;
+
+            const std::string key = line.substr(idx + 1);
+
+            std::string value;
+            while (parlines--) {
+                std::string parline;
+                if (!std::getline(ss, parline, '\n'))
+                    return false;
+
+                if (!value.empty())
+                    value.append("\n");
+                value.append(parline);
+            }
+
+            params[key] = value;
+        }
+    }
+
+    return true;
+}
+
+// Bodies the parsers must agree on, valid and malformed.
+const char* const bodies[] = {
+    "",
+    "\n",
+    "cmd",
+    "cmd\n",
+    "cmd\nthread",
+    "cmd\nthread\n",
+    "i2c.read\nt1\n1 device\n0x20\n",
+    "i2c.read\nt1\n1 device\n0x20",
+    "ic2.read16\nxmpp:tux@n39.eu/psi:1\n1 device\n0x22\n1 register\n0x95\n",
+    "helloworld\nxmpp:tux@n39.eu/psi:2\n1 subject\nhallo welt!\n3 body\nHallo Welt,\nich kann auch\nZeilenumbrüche!\n",
+    "cmd\nt\n2 value\nfirst\n\n",
+    "cmd\nt\n1 empty\n\n",
+    "cmd\nt\n1 key with spaces\nvalue\n",
+    "cmd\nt\n1 dup\na\n1 dup\nb\n",
+    "cmd\nt\n 1 padded\nx\n",
+    "cmd\nt\n+1 signed\nx\n",
+    "cmd\nt\n1x suffix\nx\n",
+    "cmd\r\nt\r\n1 crlf\r\nx\r\n",
+    // malformed
+    "cmd\nt\nnospace\n",
+    "cmd\nt\n0 zero\n",
+    "cmd\nt\nx key\nvalue\n",
+    "cmd\nt\n2 short\nonly one\n",
+    "cmd\nt\n1 missing\n",
+    "cmd\nt\n-1 negative\nx\n",
+    "cmd\nt\n99999999999999999999 huge\nx\n",
+};
+
+// The hex conversion as it was before parse_hex, based on a
+// std::stringstream; the reference for parse_hex.
+bool reference_hex2int(const std::string& hex, unsigned int& value) {
+    std::stringstream conv;
+    conv << std::hex << hex;
+
+    int i;
+    if (!(conv >> i))
+        return false;
+
+    value = i;
+    return true;
+}
+
+} // anonymous namespace
+
+
+void test_next_line() {
+    const std::string body("first\n\nthird\r\nlast");
+    const char* pos = body.data();
+    const char* const end = pos + body.size();
+    const char* lb;
+    const char* le;
+
+    CHECK(next_line(pos, end, lb, le) && std::string(lb, le) == "first");
+    CHECK(next_line(pos, end, lb, le) && lb == le);
+    // the carriage return is part of the line, as with std::getline
+    CHECK(next_line(pos, end, lb, le) && std::string(lb, le) == "third\r");
+    CHECK(next_line(pos, end, lb, le) && std::string(lb, le) == "last");
+    CHECK(!next_line(pos, end, lb, le));
+    CHECK(pos == end);
+
+    // a trailing newline does not start another line
+    const std::string nl("line\n");
+    pos = nl.data();
+    CHECK(next_line(pos, nl.data() + nl.size(), lb, le) && std::string(lb, le) == "line");
+    CHECK(!next_line(pos, nl.data() + nl.size(), lb, le));
+
+    const std::string empty;
+    pos = empty.data();
+    CHECK(!next_line(pos, empty.data(), lb, le));
+}
+
+void test_parse_hex() {
+    unsigned int value = 0;
+
+    CHECK(parse_hex("0x20", value) && value == 0x20);
+    CHECK(parse_hex("20", value) && value == 0x20);
+    CHECK(parse_hex("0020", value) && value == 0x20);
+    CHECK(parse_hex("0XfF", value) && value == 0xff);
+    CHECK(parse_hex("  7f", value) && value == 0x7f);
+    CHECK(!parse_hex("", value));
+    CHECK(!parse_hex("zz", value));
+    CHECK(!parse_hex("0x", value));
+    CHECK(hex2int("0x20") == 0x20);
+    CHECK_THROWS(hex2int("zz"), std::invalid_argument);
+
+    // the same results as the conversion before parse_hex
+    const char* const values[] = {
+        "0", "1", "a", "0x0", "0x7fffffff", "0x80000000", "0xffffffff", "0x100000000",
+        "0x100000005", "0x1000000000000000f", "-0x80000000", "-0x80000001",
+        "-1", "-0x10", "+0x10", " \t0x10", "12g", "g12", "0x-1", "--1", "ffffffffffffffff",
+    };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        const std::string hex(values[i]);
+
+        unsigned int reference = 0;
+        const bool expected = reference_hex2int(hex, reference);
+        const bool parsed = parse_hex(hex, value);
+        if (parsed != expected || (parsed && value != reference))
+            test_failed(values[i], __FILE__, __LINE__);
+    }
+}
+
+void test_text_parser() {
+    TextSpaceCommandSerializer ser;
+
+    for (size_t i = 0; i < sizeof(bodies) / sizeof(bodies[0]); i++) {
+        const std::string body(bodies[i]);
+
+        std::string command;
+        std::string threadId;
+        SpaceCommand::space_command_params params;
+        const bool expected = reference_parse(body, command, threadId, params);
+
+        bool parsed = true;
+        try {
+            const SpaceCommandSerializer::Incoming in(ser.to_command(body));
+            CHECK(in.first == threadId);
+            CHECK(in.second.cmd() == command);
+            CHECK(in.second.params() == params);
+        } catch (const SpaceCommandFormatException& scfe) {
+            parsed = false;
+            CHECK(scfe.body() == body);
+        }
+
+        if (parsed != expected)
+            test_failed(bodies[i], __FILE__, __LINE__);
+    }
+
+    // serialized commands are parsed back
+    SpaceCommand::space_command_params par;
+    par["device"] = "0x20";
+    par["multi"] = "line 1\nline 2\n\nline 4";
+    const SpaceCommand sc("i2c.write", par);
+
+    const SpaceCommandSerializer::Incoming in(ser.to_command(ser.to_body(sc, "thread")));
+    CHECK(in.first == "thread");
+    CHECK(in.second.cmd() == "i2c.write");
+    CHECK(in.second.params() == par);
+
+    // the first two lines
+    std::string cmd;
+    std::string threadId;
+    CHECK(ser.peek("i2c.read\nt1\n1 device\n0x20\n", cmd, threadId) && cmd == "i2c.read" && threadId == "t1");
+    CHECK(ser.peek("i2c.read", cmd, threadId) && cmd == "i2c.read" && threadId.empty());
+    CHECK(!ser.peek("", cmd, threadId));
+
+    // the line of the error is reported
+    try {
+        ser.to_command("cmd\nt\n1 ok\nx\nnospace\n");
+        CHECK(false);
+    } catch (const SpaceCommandFormatException& scfe) {
+        CHECK(scfe.line_number() == 5);
+    }
+}
+
+// End of File
@@ -0,0 +1,189 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+#include "ratelimiter.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace xmppsc;
+
+namespace {
+
+typedef RateLimiter::clock clock;
+typedef std::chrono::milliseconds ms;
+
+} // anonymous namespace
+
+void test_token_bucket() {
+    const clock::time_point t0 = clock::now();
+
+    TokenBucket bucket(10, 3, t0);
+    CHECK(bucket.take(t0) && bucket.take(t0) && bucket.take(t0));
+    CHECK(!bucket.take(t0));
+
+    // one token each 100 ms, up to the capacity
+    CHECK(!bucket.take(t0 + ms(99)));
+    CHECK(bucket.take(t0 + ms(100)));
+    CHECK(!bucket.take(t0 + ms(100)));
+    CHECK(bucket.tokens(t0 + ms(10000)) == 3);
+
+    // times before the last take do not refill
+    CHECK(!bucket.take(t0));
+
+    // adjusting keeps the tokens, up to the new capacity
+    bucket.adjust(10, 2, t0 + ms(10000));
+    CHECK(bucket.tokens(t0 + ms(10000)) == 2);
+    bucket.take(t0 + ms(10000));
+    bucket.adjust(1, 5, t0 + ms(10000));
+    CHECK(bucket.tokens(t0 + ms(10000)) == 1);
+
+    // no limit
+    TokenBucket unlimited(0, 1, t0);
+    bool all = true;
+    for (int i = 0; i < 100; i++)
+        all = all && unlimited.take(t0);
+    CHECK(all);
+}
+
+void test_rate_limiter() {
+    const clock::time_point t0 = clock::now();
+    const gloox::JID tux("tux@n39.eu/psi");
+    const gloox::JID tux2("tux@n39.eu/cli");
+    const gloox::JID other("other@n39.eu/cli");
+    unsigned int retry = 0;
+
+    // busy above the rate, for all resources of a bare JID
+    RateLimiter limiter(10, 2);
+    CHECK(limiter.admit(tux, "i2c.read8", &retry, t0) == RateLimiter::ADMITTED);
+    CHECK(limiter.admit(tux2, "i2c.read8", &retry, t0) == RateLimiter::ADMITTED);
+    CHECK(limiter.admit(tux, "i2c.read8", &retry, t0) == RateLimiter::BUSY);
+    CHECK(retry == 100);
+    CHECK(limiter.admit(other, "i2c.read8", &retry, t0) == RateLimiter::ADMITTED);
+    CHECK(limiter.admit(tux, "i2c.read8", &retry, t0 + ms(100)) == RateLimiter::ADMITTED);
+
+    RateLimiter::Stats st = limiter.stats();
+    CHECK(st.admitted == 4 && st.busy == 1 && st.peers == 2);
+
+    // a namespace limit on top of the peer limit
+    RateLimiter ns(100, 100);
+    ns.set_namespace_limit("i2c", 1, 1);
+    CHECK(ns.admit(tux, "i2c.write8", &retry, t0) == RateLimiter::ADMITTED);
+    CHECK(ns.admit(tux, "i2c.read8", &retry, t0) == RateLimiter::BUSY);
+    CHECK(retry == 1000);
+    CHECK(ns.admit(tux, "gpio.read", &retry, t0) == RateLimiter::ADMITTED);
+    CHECK(ns.admit(tux, "i2c", &retry, t0 + ms(1000)) == RateLimiter::ADMITTED);
+}
+
+void test_rate_limiter_envelope() {
+    const clock::time_point t0 = clock::now();
+    const gloox::JID tux("tux@n39.eu/psi");
+    unsigned int retry = 0;
+
+    std::vector<std::string> four(4, "gpio.read");
+    std::vector<std::string> three(3, "gpio.read");
+
+    // refused as a whole, without taking tokens
+    RateLimiter limiter(10, 3);
+    CHECK(limiter.admit(tux, four, &retry, t0) == RateLimiter::BUSY);
+    CHECK(retry == 100);
+    CHECK(limiter.admit(tux, three, &retry, t0) == RateLimiter::ADMITTED);
+    CHECK(limiter.admit(tux, "gpio.read", &retry, t0) == RateLimiter::BUSY);
+
+    RateLimiter::Stats st = limiter.stats();
+    CHECK(st.admitted == 3 && st.busy == 5);
+
+    // the namespace bucket needs a token for each of its commands
+    RateLimiter ns(100, 100);
+    ns.set_namespace_limit("i2c", 1, 2);
+    std::vector<std::string> cmds;
+    cmds.push_back("i2c.write8");
+    cmds.push_back("gpio.read");
+    cmds.push_back("i2c.read8");
+    CHECK(ns.admit(tux, cmds, &retry, t0) == RateLimiter::ADMITTED);
+    CHECK(ns.admit(tux, cmds, &retry, t0 + ms(1000)) == RateLimiter::BUSY);
+    CHECK(retry == 1000);
+    CHECK(ns.admit(tux, "i2c.read8", &retry, t0 + ms(1000)) == RateLimiter::ADMITTED);
+    CHECK(ns.admit(tux, std::vector<std::string>(), &retry, t0) == RateLimiter::ADMITTED);
+}
+
+void test_rate_limiter_blocking() {
+    const clock::time_point t0 = clock::now();
+    const gloox::JID tux("tux@n39.eu/psi");
+    const gloox::JID other("other@n39.eu/cli");
+    unsigned int retry = 0;
+
+    // three strikes within a second block for five seconds
+    RateLimiter limiter(1, 1);
+    limiter.set_blocking(3, 1000, 5000);
+    CHECK(limiter.admit(tux, "i2c.read8", &retry, t0) == RateLimiter::ADMITTED);
+    CHECK(limiter.admit(tux, "i2c.read8", &retry, t0) == RateLimiter::BUSY);
+    CHECK(limiter.admit(tux, "i2c.read8", &retry, t0 + ms(10)) == RateLimiter::BUSY);
+    CHECK(limiter.admit(tux, "i2c.read8", &retry, t0 + ms(20)) == RateLimiter::BUSY);
+    CHECK(limiter.admit(tux, "i2c.read8", &retry, t0 + ms(30)) == RateLimiter::BLOCKED);
+    CHECK(retry == 4990);
+    CHECK(limiter.admit(other, "i2c.read8", &retry, t0 + ms(30)) == RateLimiter::ADMITTED);
+
+    // the block outlasts a reconfiguration
+    RateLimiter reloaded(1, 1);
+    reloaded.set_blocking(3, 1000, 5000);
+    limiter.reconfigure(reloaded, t0 + ms(40));
+    CHECK(limiter.admit(tux, "i2c.read8", &retry, t0 + ms(4000)) == RateLimiter::BLOCKED);
+    CHECK(limiter.admit(tux, "i2c.read8", &retry, t0 + ms(5020)) == RateLimiter::ADMITTED);
+
+    const RateLimiter::Stats st = limiter.stats();
+    CHECK(st.blocks == 1 && st.dropped == 2 && st.busy == 3);
+
+    // strikes outside the window do not add up
+    RateLimiter slow(1, 1);
+    slow.set_blocking(2, 1000, 5000);
+    CHECK(slow.admit(tux, "i2c.read8", &retry, t0) == RateLimiter::ADMITTED);
+    CHECK(slow.admit(tux, "i2c.read8", &retry, t0 + ms(500)) == RateLimiter::BUSY);
+    CHECK(slow.admit(tux, "i2c.read8", &retry, t0 + ms(1600)) == RateLimiter::ADMITTED);
+    CHECK(slow.admit(tux, "i2c.read8", &retry, t0 + ms(1700)) == RateLimiter::BUSY);
+    CHECK(slow.admit(tux, "i2c.read8", &retry, t0 + ms(2000)) == RateLimiter::BUSY);
+    CHECK(slow.admit(tux, "i2c.read8", &retry, t0 + ms(2100)) == RateLimiter::BLOCKED);
+}
+
+void test_rate_limiter_sweep() {
+    const clock::time_point t0 = clock::now();
+    const gloox::JID idle("idle@n39.eu/psi");
+    const gloox::JID blocked("blocked@n39.eu/psi");
+    const gloox::JID busy("busy@n39.eu/cli");
+
+    // blocked for longer than the idle time
+    RateLimiter limiter(1, 1);
+    limiter.set_blocking(1, 1000, RateLimiter::IDLE_MS * 2);
+    limiter.admit(idle, "i2c.read8", 0, t0);
+    limiter.admit(blocked, "i2c.read8", 0, t0);
+    CHECK(limiter.admit(blocked, "i2c.read8", 0, t0) == RateLimiter::BUSY);
+    CHECK(limiter.stats().peers == 2);
+
+    // the state of idle peers is dropped every 1024 decisions
+    const clock::time_point later = t0 + ms(RateLimiter::IDLE_MS + 1);
+    for (int i = 0; i < 1024; i++)
+        limiter.admit(busy, "i2c.read8", 0, later);
+
+    // a new bucket for the idle peer, the blocked one is kept
+    CHECK(limiter.stats().peers == 2);
+    CHECK(limiter.admit(blocked, "i2c.read8", 0, later) == RateLimiter::BLOCKED);
+    CHECK(limiter.admit(idle, "i2c.read8", 0, later) == RateLimiter::ADMITTED);
+    CHECK(limiter.stats().peers == 3);
+}
+
+// End of File
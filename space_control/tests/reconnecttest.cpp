@@ -0,0 +1,78 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+#include "reconnectscheduler.h"
+
+using namespace xmppsc;
+
+void test_server_address() {
+    ServerAddress a;
+    CHECK(a.parse("xmpp.n39.eu") && a.host == "xmpp.n39.eu" && a.port == -1);
+    CHECK(a.parse("xmpp.n39.eu:5223") && a.host == "xmpp.n39.eu" && a.port == 5223);
+    CHECK(a.parse("[::1]") && a.host == "::1" && a.port == -1);
+    CHECK(a.parse("[2001:db8::1]:5222") && a.host == "2001:db8::1" && a.port == 5222);
+
+    CHECK(!a.parse(""));
+    CHECK(!a.parse(":5222"));
+    CHECK(!a.parse("xmpp.n39.eu:"));
+    CHECK(!a.parse("xmpp.n39.eu:0"));
+    CHECK(!a.parse("xmpp.n39.eu:65536"));
+    CHECK(!a.parse("xmpp.n39.eu:52x"));
+    CHECK(!a.parse("[::1"));
+    CHECK(!a.parse("[]:5222"));
+    CHECK(!a.parse("[::1]:"));
+
+    // nothing but the port after the bracket
+    CHECK(!a.parse("[::1]junk:5222"));
+    CHECK(!a.parse("[::1]x"));
+    CHECK(!a.parse("[::1] :5222"));
+}
+
+void test_reconnect_scheduler() {
+    ReconnectScheduler rs(1000, 4000, 2.0, 0.2);
+    CHECK(rs.server() == 0);
+
+    ReconnectScheduler::server_list servers;
+    servers.push_back(ServerAddress("a.n39.eu", -1));
+    servers.push_back(ServerAddress("b.n39.eu", 5222));
+    rs.set_servers(servers);
+    CHECK(rs.server()->host == "a.n39.eu");
+
+    // the first retry is immediate, with the same server
+    CHECK(rs.failed() == 0);
+    CHECK(rs.server()->host == "a.n39.eu");
+
+    // then with backoff and jitter on the next servers in turn
+    unsigned int delay = rs.failed();
+    CHECK(delay >= 800 && delay <= 1200);
+    CHECK(rs.server()->host == "b.n39.eu");
+    delay = rs.failed();
+    CHECK(delay >= 1600 && delay <= 2400);
+    CHECK(rs.server()->host == "a.n39.eu");
+    rs.failed();
+    delay = rs.failed();
+    CHECK(delay >= 3200 && delay <= 4800);
+    CHECK(rs.failures() == 5);
+
+    // a session starts over, with the server that worked
+    rs.succeeded();
+    CHECK(rs.failures() == 0);
+    CHECK(rs.failed() == 0);
+    CHECK(rs.server()->host == "a.n39.eu");
+}
+
+// End of File
@@ -0,0 +1,60 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TEST_H__
+#define TEST_H__
+
+//! Report a failed check; the test goes on.
+/*!
+ * \param what The failed expression.
+ * \param file The source file.
+ * \param line The source line.
+ */
+void test_failed(const char* what, const char* file, int line);
+
+//! Check a condition.
+#define CHECK(expr) \
+    do { if (!(expr)) test_failed(#expr, __FILE__, __LINE__); } while (0)
+
+//! Check that a statement throws an exception of a type.
+#define CHECK_THROWS(stmt, type) \
+    do { \
+        bool thrown = false; \
+        try { stmt; } catch (const type&) { thrown = true; } \
+        if (!thrown) test_failed(#stmt " throws " #type, __FILE__, __LINE__); \
+    } while (0)
+
+// the tests, see main.cpp
+void test_next_line();
+void test_parse_hex();
+void test_text_parser();
+void test_params();
+void test_arena();
+void test_allocations();
+void test_command_table();
+void test_method_handler();
+void test_outbound_queue();
+void test_server_address();
+void test_reconnect_scheduler();
+void test_token_bucket();
+void test_rate_limiter();
+void test_rate_limiter_envelope();
+void test_rate_limiter_blocking();
+void test_rate_limiter_sweep();
+
+//! Number of allocations by operator new so far.
+unsigned long allocations();
+
+#endif // TEST_H__
@@ -0,0 +1,543 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unixsocketserver.h"
+#include "admission.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <arpa/inet.h>
+#include <pwd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace xmppsc {
+
+// Sink that frames the responses to a local connection.
+class LocalSink : public SpaceCommandSink {
+public:
+    LocalSink(const std::string& threadId, UnixSocketServer* server,
+              UnixSocketServer::Connection* con, const SpaceCommandSerializer* ser)
+        : m_threadId(threadId), m_server(server), m_con(con), m_ser(ser) {}
+    virtual ~LocalSink() {}
+
+    virtual void sendSpaceCommand(const SpaceCommand& sc) {
+        m_server->write(m_con, m_ser->to_body(sc, m_threadId));
+    }
+
+    virtual const std::string& threadId() const throw() {
+        return m_threadId;
+    }
+
+private:
+    const std::string& m_threadId;
+    UnixSocketServer* m_server;
+    UnixSocketServer::Connection* m_con;
+    const SpaceCommandSerializer* m_ser;
+};
+
+namespace {
+
+// Sink for one command of an envelope, the responses are collected.
+class CollectingSink : public SpaceCommandSink {
+public:
+    CollectingSink(const std::string& threadId, SpaceCommandEnvelope::batch* batch)
+        : m_threadId(threadId), m_batch(batch) {}
+    virtual ~CollectingSink() {}
+
+    virtual void sendSpaceCommand(const SpaceCommand& sc) {
+        m_batch->push_back(SpaceCommandSerializer::Incoming(m_threadId, sc));
+    }
+
+    virtual void sendSpaceCommand(SpaceCommand&& sc) {
+        m_batch->push_back(SpaceCommandSerializer::Incoming(m_threadId, std::move(sc)));
+    }
+
+    virtual const std::string& threadId() const throw() {
+        return m_threadId;
+    }
+
+private:
+    const std::string& m_threadId;
+    SpaceCommandEnvelope::batch* m_batch;
+};
+
+} // anonymous namespace
+
+
+// The commands of a message, handled on the worker pool.
+class UnixSocketServer::CommandJob : public WorkerPool::Job {
+public:
+    CommandJob(UnixSocketServer* server, const Connection* con, const std::string& threadId,
+               SpaceCommandEnvelope::batch&& cmds, bool envelope, const SpaceCommandSerializer* ser)
+        : m_server(server), m_fd(con->fd), m_serial(con->serial), m_peer(con->peer),
+          m_threadId(threadId), m_cmds(std::move(cmds)), m_envelope(envelope), m_ser(ser) {}
+
+    virtual ~CommandJob() {}
+
+    virtual void run() {
+        std::vector<std::string> bodies;
+        m_server->execute(m_peer, m_threadId, m_cmds, m_envelope, m_ser, bodies);
+        // the connection is only touched on the loop thread
+        m_server->post(m_fd, m_serial, bodies);
+    }
+
+private:
+    UnixSocketServer* m_server;
+    const int m_fd;
+    const unsigned long m_serial;
+    const gloox::JID m_peer;
+    const std::string m_threadId;
+    const SpaceCommandEnvelope::batch m_cmds;
+    const bool m_envelope;
+    const SpaceCommandSerializer* m_ser;
+};
+
+
+const char UnixSocketServer::LOCAL_DOMAIN[] = "localhost";
+
+UnixSocketServer::UnixSocketServer(EventLoop* loop, SpaceControlHandler* hnd, SpaceCommandSerializer* ser)
+    : m_loop(loop), m_hnd(hnd), m_ser(ser), m_policy(new SpaceControlClient::Policy()),
+      m_errors(0), m_pool(0), m_listen(-1), m_serial(0), m_notify(-1) {}
+
+UnixSocketServer::~UnixSocketServer() {
+    close();
+
+    if (m_notify >= 0) {
+        m_loop->remove_fd(m_notify);
+        ::close(m_notify);
+    }
+}
+
+void UnixSocketServer::add_serializer(SpaceCommandSerializer* ser) {
+    if (ser)
+        m_serializers.push_back(ser);
+}
+
+void UnixSocketServer::set_policy(const std::shared_ptr<const SpaceControlClient::Policy>& policy) {
+    m_policy = policy;
+}
+
+void UnixSocketServer::set_error_limiter(ErrorLimiter* errors) throw() {
+    m_errors = errors;
+}
+
+bool UnixSocketServer::set_worker_pool(WorkerPool* pool) {
+    if (pool && m_notify < 0) {
+        const int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0 || !m_loop->add_fd(fd, EPOLLIN, this)) {
+            std::cerr << "Cannot create the response event: " << std::strerror(errno) << std::endl;
+            if (fd >= 0)
+                ::close(fd);
+            return false;
+        }
+        m_notify = fd;
+    }
+
+    m_pool = pool;
+    return true;
+}
+
+bool UnixSocketServer::listen(const std::string& path, mode_t mode) {
+    close();
+
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Invalid socket path: " << path << std::endl;
+        return false;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "Cannot create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // a stale socket from a previous run would block the bind
+    ::unlink(path.c_str());
+
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+            || ::chmod(path.c_str(), mode) < 0
+            || ::listen(fd, SOMAXCONN) < 0) {
+        std::cerr << "Cannot listen on " << path << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    if (!m_loop->add_fd(fd, EPOLLIN, this)) {
+        ::close(fd);
+        ::unlink(path.c_str());
+        return false;
+    }
+
+    m_listen = fd;
+    m_path = path;
+    return true;
+}
+
+void UnixSocketServer::close() throw() {
+    while (!m_connections.empty())
+        drop(m_connections.begin()->second);
+
+    if (m_listen >= 0) {
+        m_loop->remove_fd(m_listen);
+        ::close(m_listen);
+        ::unlink(m_path.c_str());
+        m_listen = -1;
+    }
+}
+
+size_t UnixSocketServer::connections() const throw() {
+    return m_connections.size();
+}
+
+gloox::JID UnixSocketServer::peer_jid(int fd) {
+    ucred cred;
+    socklen_t len = sizeof(cred);
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+        return gloox::JID();
+
+    std::ostringstream jid;
+
+    passwd pw;
+    passwd* result = 0;
+    char buf[1024];
+    if (::getpwuid_r(cred.uid, &pw, buf, sizeof(buf), &result) == 0 && result)
+        jid << result->pw_name;
+    else
+        // no user name, use the UID
+        jid << "uid" << cred.uid;
+
+    jid << "@" << LOCAL_DOMAIN << "/" << cred.pid;
+    return gloox::JID(jid.str());
+}
+
+void UnixSocketServer::handleFdEvent(int fd, unsigned int events) {
+    if (fd == m_listen) {
+        accept();
+        return;
+    }
+
+    if (fd == m_notify) {
+        deliver();
+        return;
+    }
+
+    connection_map::iterator it = m_connections.find(fd);
+    if (it == m_connections.end())
+        return;
+    Connection* con = it->second;
+
+    if (events & EPOLLOUT) {
+        flush(con);
+
+        // the peer has taken enough, handle the buffered frames and read on
+        if (con->paused && con->out.size() <= MAX_BACKLOG / 2) {
+            con->paused = false;
+            process(con);
+        }
+    }
+
+    if (!con->failed && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+        receive(con);
+
+    if (con->failed)
+        drop(con);
+    else
+        watch(con);
+}
+
+void UnixSocketServer::accept() throw() {
+    for (;;) {
+        const int fd = ::accept4(m_listen, 0, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            // EAGAIN: all pending connections have been accepted
+            return;
+        }
+
+        const gloox::JID peer(peer_jid(fd));
+        if (!peer || !m_loop->add_fd(fd, EPOLLIN, this)) {
+            ::close(fd);
+            continue;
+        }
+
+        m_connections[fd] = new Connection(fd, ++m_serial, peer);
+    }
+}
+
+void UnixSocketServer::receive(Connection* con) {
+    char buf[4096];
+    while (!con->failed && !con->paused) {
+        // never more than one frame with its header, see process()
+        const size_t room = std::min(sizeof(buf), 4 + MAX_FRAME - con->in.size());
+        const ssize_t n = ::recv(con->fd, buf, room, 0);
+        if (n > 0) {
+            con->in.append(buf, n);
+            process(con);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            // closed by the peer or failed
+            con->failed = true;
+        break;
+    }
+}
+
+void UnixSocketServer::process(Connection* con) {
+    // handle all complete frames
+    size_t pos = 0;
+    while (!con->failed && !con->paused && con->in.size() - pos >= 4) {
+        uint32_t len;
+        std::memcpy(&len, con->in.data() + pos, 4);
+        len = ntohl(len);
+
+        // checked with the header, before the body is buffered
+        if (len > MAX_FRAME) {
+            std::cerr << "Frame of " << len << " bytes from " << con->peer.full() << " dropped." << std::endl;
+            con->failed = true;
+            break;
+        }
+        if (con->in.size() - pos - 4 < len)
+            break;
+
+        handle(con, con->in.substr(pos + 4, len));
+        pos += 4 + len;
+    }
+    con->in.erase(0, pos);
+}
+
+void UnixSocketServer::handle(Connection* con, const std::string& body) {
+    SpaceCommandSerializer* in_ser = serializer(body);
+
+    // the same admission as for XMPP peers, decided before the body is parsed
+    Admission admission;
+    if (!admission.check(*m_policy, con->peer, body, *in_ser)) {
+        refuse(con, admission, admission.threadId(), body, in_ser);
+        return;
+    }
+
+    try {
+        // may throw a SpaceCommandFormatException
+        SpaceCommandSerializer::Incoming in(in_ser->to_command(body));
+        // the command is moved into the batch
+        const std::string threadId(in.first);
+        const bool envelope = SpaceCommandEnvelope::is_envelope(in.second);
+
+        if (!m_hnd)
+            return;
+
+        // unpack all commands first, so a malformed envelope is not processed partially
+        SpaceCommandEnvelope::batch cmds(envelope ? SpaceCommandEnvelope::unpack(in.second, *in_ser, body)
+                                                  : SpaceCommandEnvelope::batch());
+
+        if (envelope) {
+            // one refused command refuses the envelope
+            if (!admission.check_commands(*m_policy, con->peer, cmds)) {
+                refuse(con, admission, threadId, body, in_ser);
+                return;
+            }
+        } else if (!admission.checked() && !admission.check_command(*m_policy, con->peer, in.second.cmd())) {
+            // could not be checked before parsing
+            refuse(con, admission, threadId, body, in_ser);
+            return;
+        } else
+            cmds.push_back(std::move(in));
+
+        // ordered with the commands from XMPP peers
+        size_t key = 0;
+        if (m_pool && !SpaceControlClient::dispatch_key(con->peer, threadId, cmds, key)) {
+            // an envelope that would not be ordered with the commands for all its devices
+            if (m_errors && !m_errors->admit())
+                return;
+
+            SpaceCommand::space_command_params par;
+            par["what"] = SpaceControlClient::MIXED_DEVICES;
+            LocalSink(threadId, this, con, in_ser).sendSpaceCommand(SpaceCommand("exception", std::move(par)));
+        } else if (m_pool) {
+            if (!m_pool->submit(key, new CommandJob(this, con, threadId, std::move(cmds), envelope, in_ser))) {
+                SpaceCommand::space_command_params par;
+                par["reason"] = "Too many pending commands!";
+                LocalSink(threadId, this, con, in_ser).sendSpaceCommand(SpaceCommand("busy", std::move(par)));
+            }
+        } else {
+            std::vector<std::string> bodies;
+            execute(con->peer, threadId, cmds, envelope, in_ser, bodies);
+            for (std::vector<std::string>::const_iterator it = bodies.begin(); it != bodies.end(); ++it)
+                write(con, *it);
+        }
+    } catch (const SpaceCommandFormatException& scfe) {
+        if (m_errors && !m_errors->admit())
+            return;
+
+        SpaceCommand::space_command_params par;
+        par["what"] = scfe.what();
+        par["body"] = abbreviate(scfe.body(), SpaceControlClient::ECHO_LIMIT);
+        if (scfe.line_number())
+            par["line number"] = std::to_string(scfe.line_number());
+
+        write(con, m_ser->to_body(SpaceCommand("exception", std::move(par)), ""));
+    }
+}
+
+void UnixSocketServer::refuse(Connection* con, const Admission& admission, const std::string& threadId,
+                              const std::string& body, const SpaceCommandSerializer* ser) {
+    if (admission.error() && m_errors && !m_errors->admit())
+        return;
+
+    LocalSink sink(threadId, this, con, ser);
+    admission.answer(body, &sink);
+}
+
+void UnixSocketServer::execute(const gloox::JID& peer, const std::string& threadId,
+                               const SpaceCommandEnvelope::batch& cmds, bool envelope,
+                               const SpaceCommandSerializer* ser, std::vector<std::string>& bodies) {
+    SpaceCommandEnvelope::batch responses;
+    for (SpaceCommandEnvelope::batch::const_iterator it = cmds.begin(); it != cmds.end(); ++it) {
+        CollectingSink sink(it->first, &responses);
+        m_hnd->handleSpaceCommand(peer, it->second, &sink);
+    }
+
+    // the responses to an envelope go back in one envelope, a single response unwrapped
+    if (envelope && responses.size() > 1)
+        bodies.push_back(ser->to_body(SpaceCommandEnvelope::pack(responses, *ser), threadId));
+    else
+        for (SpaceCommandEnvelope::batch::const_iterator it = responses.begin(); it != responses.end(); ++it)
+            bodies.push_back(ser->to_body(it->second, it->first));
+}
+
+void UnixSocketServer::post(int fd, unsigned long serial, std::vector<std::string>& bodies) {
+    if (bodies.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_responses_mutex);
+        for (std::vector<std::string>::iterator it = bodies.begin(); it != bodies.end(); ++it) {
+            Response response;
+            response.fd = fd;
+            response.serial = serial;
+            response.body = std::move(*it);
+            m_responses.push_back(std::move(response));
+        }
+    }
+
+    const uint64_t one = 1;
+    if (::write(m_notify, &one, sizeof(one)) < 0) {
+        // the counter is saturated, the loop is notified anyway
+    }
+}
+
+void UnixSocketServer::deliver() {
+    uint64_t value;
+    if (::read(m_notify, &value, sizeof(value)) < 0) {
+        // spurious
+    }
+
+    std::deque<Response> responses;
+    {
+        std::lock_guard<std::mutex> lock(m_responses_mutex);
+        responses.swap(m_responses);
+    }
+
+    for (std::deque<Response>::const_iterator it = responses.begin(); it != responses.end(); ++it) {
+        connection_map::iterator c = m_connections.find(it->fd);
+        // closed meanwhile, the descriptor may belong to a new connection
+        if (c == m_connections.end() || c->second->serial != it->serial)
+            continue;
+
+        Connection* con = c->second;
+        write(con, it->body);
+        if (con->failed)
+            drop(con);
+        else
+            watch(con);
+    }
+}
+
+void UnixSocketServer::write(Connection* con, const std::string& body) throw() {
+    if (con->failed)
+        return;
+
+    const uint32_t len = htonl(static_cast<uint32_t>(body.size()));
+    const bool idle = con->out.empty();
+    con->out.append(reinterpret_cast<const char*>(&len), 4);
+    con->out.append(body);
+
+    // otherwise the loop reports when the socket is writable
+    if (idle)
+        flush(con);
+
+    // stop reading until the peer takes its responses
+    if (con->out.size() > MAX_BACKLOG)
+        con->paused = true;
+}
+
+void UnixSocketServer::flush(Connection* con) throw() {
+    size_t sent = 0;
+    while (sent < con->out.size()) {
+        const ssize_t n = ::send(con->fd, con->out.data() + sent, con->out.size() - sent, MSG_NOSIGNAL);
+        if (n > 0)
+            sent += n;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else {
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                con->failed = true;
+            break;
+        }
+    }
+    con->out.erase(0, sent);
+}
+
+void UnixSocketServer::watch(Connection* con) throw() {
+    // only wait for EPOLLOUT while there is something left
+    const unsigned int events = (con->paused ? 0u : static_cast<unsigned int>(EPOLLIN)) |
+                                (con->out.empty() ? 0u : static_cast<unsigned int>(EPOLLOUT));
+    if (events != con->events && m_loop->modify_fd(con->fd, events))
+        con->events = events;
+}
+
+void UnixSocketServer::drop(Connection* con) throw() {
+    m_loop->remove_fd(con->fd);
+    ::close(con->fd);
+    m_connections.erase(con->fd);
+    delete con;
+}
+
+SpaceCommandSerializer* UnixSocketServer::serializer(const std::string& body) const throw() {
+    for (std::vector<SpaceCommandSerializer*>::const_iterator it = m_serializers.begin(); it != m_serializers.end(); ++it)
+        if ((*it)->recognizes(body))
+            return *it;
+
+    return m_ser;
+}
+
+} // namespace xmppsc
+
+// End of File
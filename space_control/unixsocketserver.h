@@ -0,0 +1,222 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNIXSOCKETSERVER_H__
+#define UNIXSOCKETSERVER_H__
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <gloox/jid.h>
+
+#include "eventloop.h"
+#include "spacecontrolclient.h"
+#include "workerpool.h"
+
+namespace xmppsc {
+
+class Admission;
+
+//! Serve Space Commands to local clients over a Unix domain socket.
+/*!
+ * Scripts on the same machine can send commands without a round trip
+ * through the XMPP server. Each message is framed by its length as
+ * 32 bit unsigned integer in network byte order, followed by a message
+ * body as it would be sent via XMPP. Responses are framed the same way
+ * and use the format of the request.
+ *
+ * The peer is identified by its credentials (SO_PEERCRED) as JID
+ * "<user>@localhost/<pid>", which is checked by the access filter of the
+ * policy, e.g. by an entry "<user>@localhost".
+ *
+ * Messages pass the same Admission as XMPP messages. Sockets are
+ * non-blocking and driven by the event loop; commands are handled on the
+ * loop thread unless a worker pool is set.
+ */
+class UnixSocketServer : public EventLoop::FdHandler {
+public:
+    //! Domain of the JIDs of local peers.
+    static const char LOCAL_DOMAIN[];
+
+    //! Maximal size of a message body; peers sending larger frames are disconnected.
+    static const size_t MAX_FRAME = 64 * 1024;
+
+    //! Size of unsent responses above which the requests of a peer are not read.
+    /*!
+     * Reading resumes when the peer has taken half of the backlog, so a
+     * peer that does not read its responses cannot make the server buffer
+     * them without limit.
+     */
+    static const size_t MAX_BACKLOG = 256 * 1024;
+
+    //! Create the server.
+    /*!
+     * Access is open and commands are not limited until a policy is set.
+     *
+     * \param loop   The event loop; ownership is not transferred.
+     * \param hnd    The handler for received commands; ownership is not transferred.
+     * \param ser    The default serializer; ownership is not transferred.
+     */
+    UnixSocketServer(EventLoop* loop, SpaceControlHandler* hnd, SpaceCommandSerializer* ser);
+
+    virtual ~UnixSocketServer();
+
+    //! Register an additional serializer for recognized bodies.
+    /*!
+     * \param ser The serializer; ownership is not transferred.
+     */
+    void add_serializer(SpaceCommandSerializer* ser);
+
+    //! Replace the policy, i.e. access filter and rate limiter.
+    /*!
+     * Usually the policy of the SpaceControlClient, so local and XMPP
+     * peers share the rules and the rate limits. The server runs on the
+     * event loop thread, so the policy may be replaced from any event
+     * handler, e.g. on a configuration reload.
+     *
+     * \param policy The policy, must not be empty.
+     */
+    void set_policy(const std::shared_ptr<const SpaceControlClient::Policy>& policy);
+
+    //! Limit the rate of error responses.
+    /*!
+     * Usually the limiter of the SpaceControlClient, so errors to local
+     * and XMPP peers count against the same rate.
+     *
+     * \param errors The limiter or 0 to answer all errors; ownership is not transferred.
+     */
+    void set_error_limiter(ErrorLimiter* errors) throw();
+
+    //! Handle commands on a worker pool.
+    /*!
+     * Usually the pool of the SpaceControlClient: commands are queued with
+     * SpaceControlClient::dispatch_key(), so local and XMPP commands for a
+     * device are handled in order. Envelopes addressing several devices
+     * are answered with an exception. Commands that find the queue full are
+     * answered with "busy". The responses are passed back to the loop
+     * thread, responses for connections closed meanwhile are discarded.
+     *
+     * The pool must be stopped before the server is destroyed.
+     *
+     * \param pool The pool or 0 to handle commands on the loop thread; ownership is not transferred.
+     * \returns false if the responses cannot be passed back to the loop.
+     */
+    bool set_worker_pool(WorkerPool* pool);
+
+    //! Create the socket and accept connections.
+    /*!
+     * An existing file at the path is replaced.
+     *
+     * \param path The socket path.
+     * \param mode The permissions of the socket file.
+     * \returns false if the socket cannot be created.
+     */
+    bool listen(const std::string& path, mode_t mode = 0660);
+
+    //! Close the socket and all connections.
+    void close() throw();
+
+    //! Get the number of open connections.
+    size_t connections() const throw();
+
+    //! Get the JID of the process connected to a socket.
+    /*!
+     * \param fd The connected socket.
+     * \returns the JID or an empty JID if the credentials are not available.
+     */
+    static gloox::JID peer_jid(int fd);
+
+    virtual void handleFdEvent(int fd, unsigned int events);
+
+private:
+    struct Connection {
+        Connection(int _fd, unsigned long _serial, const gloox::JID& _peer)
+            : fd(_fd), serial(_serial), peer(_peer), events(EPOLLIN), paused(false), failed(false) {}
+
+        int fd;
+        //! tells a connection from an earlier one with the same descriptor
+        unsigned long serial;
+        gloox::JID peer;
+        //! unparsed input, at most one frame with its header
+        std::string in;
+        //! output not yet taken by the socket
+        std::string out;
+        //! the events the loop watches for
+        unsigned int events;
+        //! not reading while the output exceeds the backlog
+        bool paused;
+        bool failed;
+    };
+
+    typedef std::map<int, Connection*> connection_map;
+
+    //! A response body from a worker, for the connection fd and serial.
+    struct Response {
+        int fd;
+        unsigned long serial;
+        std::string body;
+    };
+
+    EventLoop* m_loop;
+    SpaceControlHandler* m_hnd;
+    SpaceCommandSerializer* m_ser;
+    std::vector<SpaceCommandSerializer*> m_serializers;
+    std::shared_ptr<const SpaceControlClient::Policy> m_policy;
+    ErrorLimiter* m_errors;
+    WorkerPool* m_pool;
+    int m_listen;
+    std::string m_path;
+    connection_map m_connections;
+    unsigned long m_serial;
+    //! signals responses from the workers
+    int m_notify;
+    std::deque<Response> m_responses;
+    //! guards m_responses
+    std::mutex m_responses_mutex;
+
+    friend class LocalSink;
+
+    class CommandJob;
+
+    void accept() throw();
+    void receive(Connection* con);
+    void process(Connection* con);
+    void handle(Connection* con, const std::string& body);
+    void refuse(Connection* con, const Admission& admission, const std::string& threadId,
+                const std::string& body, const SpaceCommandSerializer* ser);
+    void execute(const gloox::JID& peer, const std::string& threadId, const SpaceCommandEnvelope::batch& cmds,
+                 bool envelope, const SpaceCommandSerializer* ser, std::vector<std::string>& bodies);
+    void post(int fd, unsigned long serial, std::vector<std::string>& bodies);
+    void deliver();
+    void write(Connection* con, const std::string& body) throw();
+    void flush(Connection* con) throw();
+    void watch(Connection* con) throw();
+    void drop(Connection* con) throw();
+
+    SpaceCommandSerializer* serializer(const std::string& body) const throw();
+
+    UnixSocketServer(const UnixSocketServer& other);
+    UnixSocketServer& operator=(const UnixSocketServer& other);
+};
+
+}
+
+#endif // UNIXSOCKETSERVER_H__
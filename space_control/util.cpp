@@ -16,11 +16,46 @@
 #include "util.h"
 
 #include <sstream>
-#include <iostream>
-#include <iomanip>
+#include <utility>
 
 namespace {
-  
+
+//! Value of a hex digit, 0xff for other characters
+struct HexDecodeTable {
+    unsigned char v[256];
+
+    HexDecodeTable() {
+        for (int i = 0; i < 256; i++)
+            v[i] = 0xff;
+        for (int i = 0; i < 10; i++)
+            v['0' + i] = i;
+        for (int i = 0; i < 6; i++) {
+            v['a' + i] = 10 + i;
+            v['A' + i] = 10 + i;
+        }
+    }
+};
+
+//! Two hex digits for each byte value
+struct HexEncodeTable {
+    char v[256][2];
+
+    HexEncodeTable() {
+        static const char digits[] = "0123456789abcdef";
+        for (int i = 0; i < 256; i++) {
+            v[i][0] = digits[i >> 4];
+            v[i][1] = digits[i & 0xf];
+        }
+    }
+};
+
+const HexDecodeTable hex_decode;
+const HexEncodeTable hex_encode;
+
+inline bool is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
 //! Calculate the (even) hex width of a number
 /*!
  * i.e. the hex digit count rounded up to an even number
@@ -39,14 +74,52 @@ inline int width(int i) {
 
 namespace xmppsc {
   
-unsigned int hex2int(const std::string& hex) throw(std::invalid_argument)
+bool parse_hex(const char* hex, size_t len, unsigned int& value) throw()
 {
-    std::stringstream conv;
-    conv << std::hex << hex;
+    const char* p = hex;
+    const char* const end = hex + len;
 
-    int i;
+    while (p != end && is_space(*p))
+        p++;
+
+    bool neg = false;
+    if (p != end && (*p == '+' || *p == '-'))
+        neg = (*p++ == '-');
+
+    // the prefix must be followed by digits
+    if (end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+        p += 2;
+
+    // the value must fit into an int; checked before shifting, as the
+    // shift would wrap where long has 32 bits
+    const unsigned long limit = neg ? 0x80000000UL : 0x7fffffffUL;
+    unsigned long v = 0;
+    const char* const digits = p;
+    for (unsigned char d; p != end && (d = hex_decode.v[static_cast<unsigned char>(*p)]) != 0xff; p++) {
+        if (v > (limit >> 4))
+            return false;
+        v = (v << 4) | d;
+        if (v > limit)
+            return false;
+    }
 
-    if (! (conv >> i)) {
+    if (p == digits)
+        return false;
+
+    value = neg ? 0U - static_cast<unsigned int>(v) : static_cast<unsigned int>(v);
+    return true;
+}
+
+bool parse_hex(const std::string& hex, unsigned int& value) throw()
+{
+    return parse_hex(hex.data(), hex.size(), value);
+}
+
+unsigned int hex2int(const std::string& hex) throw(std::invalid_argument)
+{
+    unsigned int i;
+
+    if (!parse_hex(hex, i)) {
         std::ostringstream msg("");
         msg << "Error on hex value conversion (value " << hex << ")!";
         throw std::invalid_argument(msg.str());
@@ -55,40 +128,167 @@ unsigned int hex2int(const std::string& hex) throw(std::invalid_argument)
     return i;
 }
 
-// http://stackoverflow.com/a/5100745
+const std::string abbreviate(const std::string& s, size_t max) {
+    if (s.size() <= max)
+        return s;
+
+    // do not split a multi-byte character
+    size_t len = max;
+    while (len && (static_cast<unsigned char>(s[len]) & 0xc0) == 0x80)
+        len--;
+
+    return s.substr(0, len) + "...";
+}
+
 const std::string int2hex(unsigned int i)
 {
-    std::stringstream stream;
-    stream << "0x"
-           << std::setfill('0') << std::setw(width(i))
-           << std::hex << i;
-    return stream.str();
+    // number of significant digits
+    int digits = 1;
+    for (unsigned int v = i >> 4; v; v >>= 4)
+        digits++;
+
+    const int w = width(i) > digits ? width(i) : digits;
+
+    char buf[2 + 2 * sizeof(unsigned int)];
+    buf[0] = '0';
+    buf[1] = 'x';
+    for (int pos = w + 1; pos >= 2; pos--, i >>= 4)
+        buf[pos] = "0123456789abcdef"[i & 0xf];
+
+    return std::string(buf, w + 2);
+}
+
+const std::string bytes2hex(const unsigned char* data, size_t len)
+{
+    std::string hex(2 * len, '0');
+    char* out = &hex[0];
+    for (size_t n = 0; n < len; n++, out += 2) {
+        out[0] = hex_encode.v[data[n]][0];
+        out[1] = hex_encode.v[data[n]][1];
+    }
+    return hex;
+}
+
+bool hex2bytes(const std::string& hex, std::vector<unsigned char>& data) throw()
+{
+    const char* p = hex.data();
+    size_t len = hex.size();
+    if (len >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        p += 2;
+        len -= 2;
+    }
+
+    if (len % 2)
+        return false;
+
+    data.resize(len / 2);
+    for (size_t n = 0; n < len / 2; n++) {
+        const unsigned char hi = hex_decode.v[static_cast<unsigned char>(p[2*n])];
+        const unsigned char lo = hex_decode.v[static_cast<unsigned char>(p[2*n+1])];
+        if ((hi | lo) & 0xf0)
+            return false;
+        data[n] = (hi << 4) | lo;
+    }
+
+    return true;
 }
 
 int retrieveHexParameter(const std::string& parameter, const xmppsc::SpaceCommand& sc, bool required, int def)
 throw (xmppsc::IllegalCommandParameterException, xmppsc::MissingCommandParameterException) {
-    try {
-        const std::string _val = sc.param(parameter);
-
-        // special handling for empty values
-        // This code seems a bit redundant, but we safe throwing an exception if the value is optional.
-        if (_val.empty()) {
-            if (required) {
-                std::ostringstream msg("");
-                msg << "Missing parameter value for " << parameter << "!";
-                throw xmppsc::MissingCommandParameterException(msg.str());
-            } else
-                return def;
+    const HexParameter schema[] = { { parameter.c_str(), 32, required, static_cast<unsigned int>(def) } };
+    unsigned int value[1];
+    ParameterError error;
+
+    if (!decode_hex_parameters(sc, schema, value, error))
+        throw_parameter_error(error);
+
+    return value[0];
+}
+
+bool decode_hex_parameter(const xmppsc::SpaceCommand& sc, const HexParameter& p,
+                          unsigned int& value, ParameterError& error) throw() {
+    const SpaceCommand::space_command_params& params = sc.params();
+    SpaceCommand::space_command_params::const_iterator it = params.find(p.name);
+
+    // missing and empty values are treated alike
+    if (it == params.end() || it->second.empty()) {
+        if (p.required) {
+            error.status = ParameterError::MISSING;
+            error.name = p.name;
+            return false;
         }
+        value = p.def;
+        error.status = ParameterError::OK;
+        return true;
+    }
 
-        return  hex2int(_val);
-    } catch (std::invalid_argument& ia) {
-        throw xmppsc::IllegalCommandParameterException(parameter, ia.what());
-    } catch (xmppsc::MissingCommandParameterException& e) {
-        if (required)
-            throw e;
-        return def;
+    if (!parse_hex(it->second, value)) {
+        error.status = ParameterError::ILLEGAL;
+        error.name = p.name;
+        error.reason = "Error on hex value conversion (value " + it->second + ")!";
+        return false;
     }
+
+    if (p.width < 32 && (value >> p.width)) {
+        std::ostringstream msg("");
+        msg << "Value " << it->second << " exceeds " << p.width << " bits!";
+        error.status = ParameterError::ILLEGAL;
+        error.name = p.name;
+        error.reason = msg.str();
+        return false;
+    }
+
+    error.status = ParameterError::OK;
+    return true;
+}
+
+bool decode_hex_parameters(const xmppsc::SpaceCommand& sc, const HexParameter* schema, size_t n,
+                           unsigned int* values, ParameterError& error) throw() {
+    for (size_t i = 0; i < n; i++)
+        if (!decode_hex_parameter(sc, schema[i], values[i], error))
+            return false;
+
+    error.status = ParameterError::OK;
+    return true;
+}
+
+void throw_parameter_error(const ParameterError& error)
+throw (xmppsc::IllegalCommandParameterException, xmppsc::MissingCommandParameterException) {
+    if (error.status == ParameterError::MISSING)
+        throw xmppsc::MissingCommandParameterException(error.name);
+    if (error.status == ParameterError::ILLEGAL)
+        throw xmppsc::IllegalCommandParameterException(error.name, error.reason);
+}
+
+void send_parameter_error(const ParameterError& error, SpaceCommandSink* sink) {
+    SpaceCommand::space_command_params par;
+
+    // same messages as the parameter exceptions
+    std::string what;
+    if (error.status == ParameterError::MISSING) {
+        what = "Missing parameter: ";
+        what += error.name;
+    } else {
+        what = "Illegal parameter (";
+        what += error.name;
+        what += "): ";
+        what += error.reason;
+    }
+
+    par["what"] = std::move(what);
+    par["parameter"] = error.name;
+    sink->sendSpaceCommand(SpaceCommand("exception", std::move(par)));
+}
+
+void send_unknown_command(const std::string& cmd, SpaceCommandSink* sink) {
+    SpaceCommand::space_command_params par;
+    // this used to be the what() of the std::out_of_range from map::at,
+    // keep it for clients that match on it
+    par["what"] = "map::at";
+    std::string text("Unknown command: ");
+    text += cmd;
+    par["text"] = std::move(text);
+    sink->sendSpaceCommand(SpaceCommand("exception", std::move(par)));
 }
  
 } // namespace xmppsc
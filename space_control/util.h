@@ -20,6 +20,7 @@
 
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 #include "spacecontrolclient.h"
 
@@ -33,6 +34,37 @@ namespace xmppsc {
  */
 unsigned int hex2int(const std::string& hex) throw(std::invalid_argument);
 
+//! Convert a hex string to integer value without throwing
+/**
+ * Accepts the same input as hex2int: leading white space, an optional
+ * sign, an optional "0x" prefix and hex digits up to the first non-hex
+ * character. The value must fit into an int, negative values are returned
+ * in two's complement.
+ *
+ * @param hex The hex value
+ * @param len The length of the hex value
+ * @param value Receives the integer value on success
+ * @returns false if the hex value cannot be converted.
+ */
+bool parse_hex(const char* hex, size_t len, unsigned int& value) throw();
+
+//! Convert a hex string to integer value without throwing
+/**
+ * @see parse_hex(const char*, size_t, unsigned int&)
+ */
+bool parse_hex(const std::string& hex, unsigned int& value) throw();
+
+//! Shorten a string for echoing it in a response
+/**
+ * The string is cut at a UTF-8 character boundary and "..." is appended,
+ * if it is longer than the limit.
+ *
+ * @param s The string
+ * @param max The maximal number of bytes taken from the string
+ * @returns the string or its shortened version
+ */
+const std::string abbreviate(const std::string& s, size_t max);
+
 //! Convert an integer value to hex string
 /**
  * @param i the integer value
@@ -40,6 +72,27 @@ unsigned int hex2int(const std::string& hex) throw(std::invalid_argument);
  */
 const std::string int2hex(unsigned int  i);
 
+//! Encode a byte buffer as hex string
+/**
+ * Two lower-case hex digits per byte without prefix or separators,
+ * intended for block transfers.
+ *
+ * @param data The bytes
+ * @param len The number of bytes
+ * @returns the hex string
+ */
+const std::string bytes2hex(const unsigned char* data, size_t len);
+
+//! Decode a hex string to a byte buffer
+/**
+ * Reverse of bytes2hex, upper-case digits and a "0x" prefix are accepted.
+ *
+ * @param hex The hex string with an even number of digits
+ * @param data Receives the bytes, existing content is replaced
+ * @returns false if the string is not a valid byte sequence
+ */
+bool hex2bytes(const std::string& hex, std::vector<unsigned char>& data) throw();
+
 //! Get the numeric value of a hex parameter in a command message
 /**
  * @param parameter The name of the parameter
@@ -52,6 +105,131 @@ const std::string int2hex(unsigned int  i);
 int retrieveHexParameter(const std::string& parameter, const xmppsc::SpaceCommand& sc, bool required=true, int def=0)
   throw (xmppsc::IllegalCommandParameterException, xmppsc::MissingCommandParameterException);
 
+
+//! Declaration of a hex parameter in a command method schema
+struct HexParameter {
+    //! The parameter name
+    const char* name;
+    //! Maximal number of significant bits of the value
+    unsigned int width;
+    //! false if the parameter is not required
+    bool required;
+    //! The default value if a non-required parameter is missing or empty
+    unsigned int def;
+};
+
+//! Declaration of a hex parameter that is decoded into a struct field
+/**
+ * Binding each value to a named field keeps the handlers independent of
+ * the order of the schema entries.
+ */
+template<class P>
+struct HexField {
+    //! The parameter declaration
+    HexParameter param;
+    //! The field receiving the value
+    unsigned int P::* field;
+};
+
+//! Description of a parameter that could not be decoded
+struct ParameterError {
+    enum Status {
+        //! No error
+        OK,
+        //! A required parameter is missing or empty
+        MISSING,
+        //! The value is not a hex value or exceeds the width
+        ILLEGAL
+    };
+
+    ParameterError() : status(OK), name(0) {}
+
+    Status status;
+    //! The parameter name from the schema
+    const char* name;
+    //! Reason for illegal values
+    std::string reason;
+};
+
+//! Decode a single hex parameter of a command
+/**
+ * @param sc the Space Command message
+ * @param p the parameter declaration
+ * @param value receives the decoded value
+ * @param error receives the error
+ * @returns true if the parameter could be decoded
+ */
+bool decode_hex_parameter(const xmppsc::SpaceCommand& sc, const HexParameter& p,
+                          unsigned int& value, ParameterError& error) throw();
+
+//! Decode the hex parameters of a command according to a schema
+/**
+ * All parameters are checked in one pass over the schema without throwing.
+ *
+ * @param sc the Space Command message
+ * @param schema the parameter declarations
+ * @param n the number of parameters in the schema
+ * @param values receives the decoded values, one for each schema entry
+ * @param error receives the first error
+ * @returns true if all parameters could be decoded
+ */
+bool decode_hex_parameters(const xmppsc::SpaceCommand& sc, const HexParameter* schema, size_t n,
+                           unsigned int* values, ParameterError& error) throw();
+
+//! Decode the hex parameters of a command according to a schema
+/**
+ * Array version, the schema size is checked at compile time.
+ */
+template<size_t N>
+inline bool decode_hex_parameters(const xmppsc::SpaceCommand& sc, const HexParameter (&schema)[N],
+                                  unsigned int (&values)[N], ParameterError& error) throw() {
+    return decode_hex_parameters(sc, schema, N, values, error);
+}
+
+//! Decode the hex parameters of a command into the fields of a struct
+/**
+ * @param sc the Space Command message
+ * @param schema the parameter declarations with their fields
+ * @param fields receives the decoded values
+ * @param error receives the first error
+ * @returns true if all parameters could be decoded
+ */
+template<class P, size_t N>
+inline bool decode_hex_fields(const xmppsc::SpaceCommand& sc, const HexField<P> (&schema)[N],
+                              P& fields, ParameterError& error) throw() {
+    for (size_t i = 0; i < N; i++)
+        if (!decode_hex_parameter(sc, schema[i].param, fields.*schema[i].field, error))
+            return false;
+
+    return true;
+}
+
+//! Throw the exception corresponding to a parameter error
+/**
+ * @throws xmppsc::IllegalCommandParameterException for illegal values
+ * @throws MissingCommandParameterException for missing values
+ */
+void throw_parameter_error(const ParameterError& error)
+  throw (xmppsc::IllegalCommandParameterException, xmppsc::MissingCommandParameterException);
+
+//! Send the "exception" command corresponding to a parameter error
+/**
+ * The response is the same as the one MethodHandler sends for a caught
+ * MissingCommandParameterException or IllegalCommandParameterException,
+ * but no exception is thrown on the way.
+ *
+ * @param error the parameter error, must not be OK
+ * @param sink the sink for the response
+ */
+void send_parameter_error(const ParameterError& error, SpaceCommandSink* sink);
+
+//! Send the "exception" command for an unknown command
+/**
+ * @param cmd the name of the unknown command
+ * @param sink the sink for the response
+ */
+void send_unknown_command(const std::string& cmd, SpaceCommandSink* sink);
+
 } // namespace xmppsc
 
 #endif // UTIL_H
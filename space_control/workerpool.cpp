@@ -0,0 +1,123 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "workerpool.h"
+
+#include <exception>
+#include <iostream>
+
+namespace xmppsc {
+
+WorkerPool::Job::~Job() {}
+
+
+WorkerPool::WorkerPool(unsigned int workers, size_t capacity)
+    : m_capacity(capacity), m_rejected(0) {
+    if (workers < 1)
+        workers = 1;
+
+    for (unsigned int i = 0; i < workers; i++) {
+        Worker* w = new Worker();
+        m_workers.push_back(w);
+        w->thread = std::thread(&WorkerPool::serve, w);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+
+    for (std::vector<Worker*>::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+        delete *it;
+}
+
+bool WorkerPool::submit(size_t key, Job* job) {
+    Worker* w = m_workers[key % m_workers.size()];
+
+    {
+        std::lock_guard<std::mutex> lock(w->mutex);
+        if (w->stop) {
+            delete job;
+            return false;
+        }
+        if (m_capacity && w->queue.size() >= m_capacity) {
+            m_rejected++;
+            delete job;
+            return false;
+        }
+        w->queue.push_back(job);
+    }
+    w->cond.notify_one();
+    return true;
+}
+
+void WorkerPool::stop() {
+    for (std::vector<Worker*>::iterator it = m_workers.begin(); it != m_workers.end(); ++it) {
+        Worker* w = *it;
+        {
+            std::lock_guard<std::mutex> lock(w->mutex);
+            w->stop = true;
+        }
+        w->cond.notify_one();
+    }
+
+    for (std::vector<Worker*>::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+        if ((*it)->thread.joinable())
+            (*it)->thread.join();
+}
+
+unsigned int WorkerPool::size() const throw() {
+    return m_workers.size();
+}
+
+size_t WorkerPool::capacity() const throw() {
+    return m_capacity;
+}
+
+unsigned long WorkerPool::rejected() const throw() {
+    return m_rejected;
+}
+
+void WorkerPool::serve(Worker* w) {
+    for (;;) {
+        Job* job;
+        {
+            std::unique_lock<std::mutex> lock(w->mutex);
+            while (w->queue.empty() && !w->stop)
+                w->cond.wait(lock);
+
+            // the queue is drained before stopping
+            if (w->queue.empty())
+                return;
+
+            job = w->queue.front();
+            w->queue.pop_front();
+        }
+
+        // a failing job must not take the worker and its queue down
+        try {
+            job->run();
+        } catch (const std::exception& e) {
+            std::cerr << "Exception in worker job: " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "Unknown exception in worker job!" << std::endl;
+        }
+
+        delete job;
+    }
+}
+
+} // namespace xmppsc
+
+// End of File
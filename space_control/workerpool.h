@@ -0,0 +1,109 @@
+/*
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORKERPOOL_H__
+#define WORKERPOOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace xmppsc {
+
+//! Pool of worker threads with ordered queues.
+/*!
+ * Each worker serves its own queue. Jobs are assigned to a worker by a
+ * key, so jobs with the same key are run one after the other in the order
+ * of submission, while jobs with different keys may run in parallel.
+ *
+ * The queues are bounded, so a peer cannot make the daemon queue work
+ * faster than the bus can do it.
+ */
+class WorkerPool {
+public:
+    //! A unit of work.
+    class Job {
+    public:
+        virtual ~Job();
+
+        //! Do the work; called on a worker thread.
+        virtual void run() = 0;
+    };
+
+    //! Default number of jobs queued per worker.
+    static const size_t DEFAULT_CAPACITY = 256;
+
+    //! Start the workers.
+    /*!
+     * \param workers  The number of worker threads, at least one is started.
+     * \param capacity The maximal number of queued jobs per worker, 0 for no limit.
+     */
+    explicit WorkerPool(unsigned int workers, size_t capacity = DEFAULT_CAPACITY);
+
+    //! Stop the pool, see stop().
+    ~WorkerPool();
+
+    //! Queue a job.
+    /*!
+     * \param key The ordering key.
+     * \param job The job; ownership is transferred to the pool.
+     * \returns false if the queue of the worker is full or the pool has
+     *          been stopped; the job is deleted then.
+     */
+    bool submit(size_t key, Job* job);
+
+    //! Run the queued jobs and stop the workers.
+    /*!
+     * Jobs submitted afterwards are discarded.
+     */
+    void stop();
+
+    //! Get the number of workers.
+    unsigned int size() const throw();
+
+    //! Get the maximal number of queued jobs per worker, 0 for no limit.
+    size_t capacity() const throw();
+
+    //! Get the number of jobs rejected because a queue was full.
+    unsigned long rejected() const throw();
+
+private:
+    struct Worker {
+        Worker() : stop(false) {}
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<Job*> queue;
+        bool stop;
+        std::thread thread;
+    };
+
+    std::vector<Worker*> m_workers;
+    const size_t m_capacity;
+    std::atomic<unsigned long> m_rejected;
+
+    static void serve(Worker* w);
+
+    WorkerPool(const WorkerPool& other);
+    WorkerPool& operator=(const WorkerPool& other);
+};
+
+}
+
+#endif // WORKERPOOL_H__